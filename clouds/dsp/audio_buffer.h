@@ -66,19 +66,31 @@ class AudioBuffer {
       void* buffer,
       int32_t size,
       int16_t* tail_buffer) {
+    Init(buffer, size, tail_buffer, true);
+  }
+  
+  // When clear is false, the buffer is not filled with silence: its content
+  // is kept, and its pages are not touched (for memory-mapped files).
+  void Init(
+      void* buffer,
+      int32_t size,
+      int16_t* tail_buffer,
+      bool clear) {
     s16_ = static_cast<int16_t*>(buffer);
     s8_ = static_cast<int8_t*>(buffer);
     size_ = size - kInterpolationTail;
     write_head_ = 0;
     quantization_error_ = 0.0f;
     crossfade_counter_ = 0;
-    if (resolution == RESOLUTION_16_BIT) {
-      std::fill(&s16_[0], &s16_[size], 0);
-    } else {
-      std::fill(
-          &s8_[0],
-          &s8_[size],
-          resolution == RESOLUTION_8_BIT_MU_LAW ? 127 : 0);
+    if (clear) {
+      if (resolution == RESOLUTION_16_BIT) {
+        std::fill(&s16_[0], &s16_[size], 0);
+      } else {
+        std::fill(
+            &s8_[0],
+            &s8_[size],
+            resolution == RESOLUTION_8_BIT_MU_LAW ? 127 : 0);
+      }
     }
     tail_ = tail_buffer;
   }
@@ -30,6 +30,10 @@
 
 #include <algorithm>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif  // __AVX2__
+
 namespace clouds {
 
 using namespace std;
@@ -72,6 +76,86 @@ void Correlator::EvaluateNextCandidate() {
   done_ = candidate_ >= size_;
 }
 
+#ifdef __AVX2__
+
+static inline __m256i PopCount(__m256i x) {
+  const __m256i lut = _mm256_setr_epi8(
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  __m256i low = _mm256_and_si256(x, mask);
+  __m256i high = _mm256_and_si256(_mm256_srli_epi16(x, 4), mask);
+  __m256i count = _mm256_add_epi8(
+      _mm256_shuffle_epi8(lut, low),
+      _mm256_shuffle_epi8(lut, high));
+  // Sums the bytes into four 64-bit counts.
+  return _mm256_sad_epu8(count, _mm256_setzero_si256());
+}
+
+#endif  // __AVX2__
+
+uint32_t Correlator::Score(int32_t candidate) const {
+  uint32_t num_words = size_ >> 5;
+  uint32_t offset_bits = candidate & 0x1f;
+  const uint32_t* source = &source_[0];
+  const uint32_t* destination = &destination_[candidate >> 5];
+  
+  // Counts the mismatching bits rather than the matching ones. Unlike in
+  // EvaluateNextCandidate, the shift by 32 is avoided when the candidate is
+  // word-aligned.
+  uint32_t mismatches = 0;
+  uint32_t i = 0;
+#ifdef __AVX2__
+  __m128i left_shift = _mm_cvtsi32_si128(offset_bits);
+  __m128i right_shift = _mm_cvtsi32_si128(32 - offset_bits);
+  __m256i sum = _mm256_setzero_si256();
+  for (; i + 8 <= num_words; i += 8) {
+    __m256i source_bits = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(&source[i]));
+    __m256i destination_bits = _mm256_or_si256(
+        _mm256_sll_epi32(
+            _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(&destination[i])),
+            left_shift),
+        _mm256_srl_epi32(
+            _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(&destination[i + 1])),
+            right_shift));
+    sum = _mm256_add_epi64(
+        sum,
+        PopCount(_mm256_xor_si256(source_bits, destination_bits)));
+  }
+  mismatches += _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1) + \
+      _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3);
+#endif  // __AVX2__
+  for (; i < num_words; ++i) {
+    uint32_t destination_bits = destination[i] << offset_bits;
+    if (offset_bits) {
+      destination_bits |= destination[i + 1] >> (32 - offset_bits);
+    }
+    uint32_t count = source[i] ^ destination_bits;
+    count = count - ((count >> 1) & 0x55555555);
+    count = (count & 0x33333333) + ((count >> 2) & 0x33333333);
+    count = (((count + (count >> 4)) & 0xf0f0f0f) * 0x1010101) >> 24;
+    mismatches += count;
+  }
+  return (num_words << 5) - mismatches;
+}
+
+void Correlator::EvaluateAllCandidates() {
+  if (done_) {
+    return;
+  }
+  for (; candidate_ < size_; ++candidate_) {
+    uint32_t xcorr = Score(candidate_);
+    if (xcorr > best_score_) {
+      best_match_ = candidate_;
+      best_score_ = xcorr;
+    }
+  }
+  done_ = true;
+}
+
 void Correlator::StartSearch(
     int32_t size,
     int32_t offset,
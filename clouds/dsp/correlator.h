@@ -26,7 +26,8 @@
 //
 // Search for stretch/shift splicing points by maximizing correlation.
 // Correlation is computed by XOR-ing the bit sign of samples - this allows
-// 32 samples to be matched in one single XOR operation.
+// 32 samples to be matched in one single XOR operation (256 samples when the
+// full sweep is compiled for AVX2).
 
 #ifndef CLOUDS_DSP_CORRELATOR_H_
 #define CLOUDS_DSP_CORRELATOR_H_
@@ -34,10 +35,18 @@
 #include "stmlib/stmlib.h"
 
 namespace clouds {
+
+enum CorrelatorSearchMode {
+  // The candidates are evaluated a few at a time, the search being spread
+  // over several blocks.
+  CORRELATOR_SEARCH_INCREMENTAL,
+  // All candidates are evaluated in the block in which the search starts.
+  CORRELATOR_SEARCH_FULL_SWEEP
+};
   
 class Correlator {
  public:
-  Correlator() { }
+  Correlator() : search_mode_(CORRELATOR_SEARCH_INCREMENTAL) { }
   ~Correlator() { }
   
   void Init(uint32_t* source, uint32_t* destination);
@@ -49,6 +58,10 @@ class Correlator {
   }
 
   inline void EvaluateSomeCandidates() {
+    if (search_mode_ == CORRELATOR_SEARCH_FULL_SWEEP) {
+      EvaluateAllCandidates();
+      return;
+    }
     size_t num_candidates = (size_ >> 2) + 16;
     while (num_candidates) {
       EvaluateNextCandidate();
@@ -57,6 +70,12 @@ class Correlator {
   }
 
   void EvaluateNextCandidate();
+  void EvaluateAllCandidates();
+  
+  inline void set_search_mode(CorrelatorSearchMode search_mode) {
+    search_mode_ = search_mode;
+  }
+  inline CorrelatorSearchMode search_mode() const { return search_mode_; }
 
   inline uint32_t* source() { return source_; }
   inline uint32_t* destination() { return destination_; }
@@ -65,6 +84,8 @@ class Correlator {
   inline bool done() { return done_; }
   
  private:
+  uint32_t Score(int32_t candidate) const;
+  
   uint32_t* source_;
   uint32_t* destination_;
   
@@ -80,6 +101,8 @@ class Correlator {
   
   bool done_;
   
+  CorrelatorSearchMode search_mode_;
+  
   DISALLOW_COPY_AND_ASSIGN(Correlator);
 };
 
@@ -44,6 +44,28 @@ class Diffuser {
     engine_.Init(buffer);
   }
   
+  // Runs at time_scale times 32kHz. The buffer must hold
+  // 2048 * DelayMemoryScale(time_scale) samples.
+  void Init(float* buffer, float time_scale) {
+    engine_.Init(buffer, time_scale);
+  }
+  
+  void Process(FloatFrame* in_out, size_t size) {
+    if (engine_.scaled()) {
+      Process<true>(in_out, size);
+    } else {
+      Process<false>(in_out, size);
+    }
+  }
+  
+  void set_amount(float amount) {
+    amount_ = amount;
+  }
+  
+ private:
+  typedef FxEngine<2048, FORMAT_32_BIT> E;
+  
+  template<bool scaled>
   void Process(FloatFrame* in_out, size_t size) {
     typedef E::Reserve<126,
       E::Reserve<180,
@@ -61,7 +83,7 @@ class Diffuser {
     E::DelayLine<Memory, 5> apr2;
     E::DelayLine<Memory, 6> apr3;
     E::DelayLine<Memory, 7> apr4;
-    E::Context c;
+    E::Context<scaled> c;
     const float kap = 0.625f;
     while (size--) {
       engine_.Start(&c);
@@ -95,12 +117,6 @@ class Diffuser {
     }
   }
   
-  void set_amount(float amount) {
-    amount_ = amount;
-  }
-  
- private:
-  typedef FxEngine<2048, FORMAT_32_BIT> E;
   E engine_;
   
   float amount_;
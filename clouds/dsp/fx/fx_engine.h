@@ -36,6 +36,10 @@
 #include "stmlib/dsp/dsp.h"
 #include "stmlib/dsp/cosine_oscillator.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif  // __SSE2__
+
 namespace clouds {
 
 #define TAIL , -1
@@ -66,6 +70,22 @@ struct DataType<FORMAT_12_BIT> {
     return static_cast<uint16_t>(
         stmlib::Clip16(static_cast<int32_t>(value * 4096.0f)));
   }
+
+#ifdef __SSE2__
+  // 4 values stored at decreasing addresses, from p down to p - 3.
+  static inline __m128 Decompress(const T* p) {
+    __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p - 3));
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+    x = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    return _mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(1.0f / 4096.0f));
+  }
+
+  static inline void Compress(__m128 value, T* p) {
+    __m128i x = _mm_cvttps_epi32(_mm_mul_ps(value, _mm_set1_ps(4096.0f)));
+    x = _mm_shufflelo_epi16(_mm_packs_epi32(x, x), _MM_SHUFFLE(0, 1, 2, 3));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p - 3), x);
+  }
+#endif  // __SSE2__
 };
 
 template<>
@@ -80,6 +100,22 @@ struct DataType<FORMAT_16_BIT> {
     return static_cast<uint16_t>(
         stmlib::Clip16(static_cast<int32_t>(value * 32768.0f)));
   }
+
+#ifdef __SSE2__
+  // 4 values stored at decreasing addresses, from p down to p - 3.
+  static inline __m128 Decompress(const T* p) {
+    __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p - 3));
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+    x = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    return _mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(1.0f / 32768.0f));
+  }
+
+  static inline void Compress(__m128 value, T* p) {
+    __m128i x = _mm_cvttps_epi32(_mm_mul_ps(value, _mm_set1_ps(32768.0f)));
+    x = _mm_shufflelo_epi16(_mm_packs_epi32(x, x), _MM_SHUFFLE(0, 1, 2, 3));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p - 3), x);
+  }
+#endif  // __SSE2__
 };
 
 template<>
@@ -93,8 +129,29 @@ struct DataType<FORMAT_32_BIT> {
   static inline T Compress(float value) {
     return value;
   }
+
+#ifdef __SSE2__
+  static inline __m128 Decompress(const T* p) {
+    return _mm_shuffle_ps(
+        _mm_loadu_ps(p - 3), _mm_loadu_ps(p - 3), _MM_SHUFFLE(0, 1, 2, 3));
+  }
+
+  static inline void Compress(__m128 value, T* p) {
+    _mm_storeu_ps(p - 3, _mm_shuffle_ps(value, value, _MM_SHUFFLE(0, 1, 2, 3)));
+  }
+#endif  // __SSE2__
 };
 
+// Power of 2 by which the delay memory of an FxEngine must be enlarged to run
+// at time_scale times the sample rate for which its delay lengths are given.
+inline size_t DelayMemoryScale(float time_scale) {
+  size_t scale = 1;
+  while (static_cast<float>(scale) < time_scale) {
+    scale <<= 1;
+  }
+  return scale;
+}
+
 template<
     size_t size,
     Format format = FORMAT_12_BIT>
@@ -105,12 +162,33 @@ class FxEngine {
   ~FxEngine() { }
 
   void Init(T* buffer) {
+    Init(buffer, 1.0f);
+  }
+  
+  // Delay lengths, offsets and LFO frequencies are given for the nominal
+  // sample rate, and scaled by time_scale - rounded to a multiple of 1/256, so
+  // that integer and interpolated taps are scaled by the very same value. The
+  // buffer must hold size * DelayMemoryScale(time_scale) samples.
+  void Init(T* buffer, float time_scale) {
     buffer_ = buffer;
+    scale_ = static_cast<int32_t>(time_scale * 256.0f + 0.5f);
+    time_scale_ = static_cast<float>(scale_) / 256.0f;
+    buffer_size_ = size * DelayMemoryScale(time_scale_);
     Clear();
   }
   
+  // Contexts started with scaled = false use the delay lengths as given, with
+  // all addresses folded into constants. The nominal rate should use them.
+  inline bool scaled() const {
+    return scale_ != 256;
+  }
+  
+  inline float time_scale() const {
+    return time_scale_;
+  }
+  
   void Clear() {
-    std::fill(&buffer_[0], &buffer_[size], 0);
+    std::fill(&buffer_[0], &buffer_[buffer_size_], 0);
     write_ptr_ = 0;
   }
 
@@ -128,7 +206,8 @@ class FxEngine {
   struct DelayLine {
     enum {
       length = DelayLine<typename Memory::Tail, index - 1>::length,
-      base = DelayLine<Memory, index - 1>::base + DelayLine<Memory, index - 1>::length + 1
+      base = DelayLine<Memory, index - 1>::base + DelayLine<Memory, index - 1>::length + 1,
+      number = index
     };
   };
 
@@ -136,10 +215,12 @@ class FxEngine {
   struct DelayLine<Memory, 0> {
     enum {
       length = Memory::length,
-      base = 0
+      base = 0,
+      number = 0
     };
   };
 
+  template<bool scaled>
   class Context {
    friend class FxEngine;
    public:
@@ -172,9 +253,9 @@ class FxEngine {
       STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
       T w = DataType<format>::Compress(accumulator_);
       if (offset == -1) {
-        buffer_[(write_ptr_ + D::base + D::length - 1) & MASK] = w;
+        buffer_[(write_ptr_ + base<D>() + length<D>() - 1) & mask()] = w;
       } else {
-        buffer_[(write_ptr_ + D::base + offset) & MASK] = w;
+        buffer_[(write_ptr_ + base<D>() + Scale(offset)) & mask()] = w;
       }
       accumulator_ *= scale;
     }
@@ -200,9 +281,9 @@ class FxEngine {
       STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
       T r;
       if (offset == -1) {
-        r = buffer_[(write_ptr_ + D::base + D::length - 1) & MASK];
+        r = buffer_[(write_ptr_ + base<D>() + length<D>() - 1) & mask()];
       } else {
-        r = buffer_[(write_ptr_ + D::base + offset) & MASK];
+        r = buffer_[(write_ptr_ + base<D>() + Scale(offset)) & mask()];
       }
       float r_f = DataType<format>::Decompress(r);
       previous_read_ = r_f;
@@ -227,11 +308,12 @@ class FxEngine {
     template<typename D>
     inline void Interpolate(D& d, float offset, float scale) {
       STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      offset = Scale(offset);
       MAKE_INTEGRAL_FRACTIONAL(offset);
       float a = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base) & MASK]);
+          buffer_[(write_ptr_ + offset_integral + base<D>()) & mask()]);
       float b = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base + 1) & MASK]);
+          buffer_[(write_ptr_ + offset_integral + base<D>() + 1) & mask()]);
       float x = a + (b - a) * offset_fractional;
       previous_read_ = x;
       accumulator_ += x * scale;
@@ -242,40 +324,326 @@ class FxEngine {
         D& d, float offset, LFOIndex index, float amplitude, float scale) {
       STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
       offset += amplitude * lfo_value_[index];
+      offset = Scale(offset);
       MAKE_INTEGRAL_FRACTIONAL(offset);
       float a = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base) & MASK]);
+          buffer_[(write_ptr_ + offset_integral + base<D>()) & mask()]);
       float b = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base + 1) & MASK]);
+          buffer_[(write_ptr_ + offset_integral + base<D>() + 1) & mask()]);
       float x = a + (b - a) * offset_fractional;
       previous_read_ = x;
       accumulator_ += x * scale;
     }
     
    private:
+    // Below the nominal rate, the 1 sample gap between two delay lines
+    // shrinks and the second sample read by Interpolate could fall into the
+    // next line. Shifting each line by its number keeps them apart.
+    template<typename D>
+    inline int32_t base() const {
+      return scaled
+          ? (D::base * scale_ >> 8) + (scale_ < 256 ? D::number : 0)
+          : D::base;
+    }
+    
+    template<typename D>
+    inline int32_t length() const {
+      return scaled ? D::length * scale_ >> 8 : D::length;
+    }
+    
+    inline int32_t Scale(int32_t offset) const {
+      return scaled ? offset * scale_ >> 8 : offset;
+    }
+    
+    inline float Scale(float offset) const {
+      return scaled ? offset * time_scale_ : offset;
+    }
+    
+    inline int32_t mask() const {
+      return scaled ? mask_ : size - 1;
+    }
+    
     float accumulator_;
     float previous_read_;
     float lfo_value_[2];
     T* buffer_;
     int32_t write_ptr_;
+    int32_t mask_;
+    int32_t scale_;
+    float time_scale_;
 
     DISALLOW_COPY_AND_ASSIGN(Context);
   };
-  
+
+  // Runs each operation on a whole block of samples before moving on to the
+  // next one, so that the buffer is walked one delay line at a time rather
+  // than hopping across all of them at every sample. The result is the same
+  // as with Context as long as nothing written to a delay line is read back
+  // within the block - in other words, as long as the block is shorter than
+  // the delays. For shorter loops, the operations can be restricted to a
+  // range of the block with SetRange.
+  template<size_t max_size, bool scaled>
+  class BlockContext {
+   friend class FxEngine;
+   public:
+    BlockContext() { }
+    ~BlockContext() { }
+
+    inline void SetRange(size_t start, size_t end) {
+      start_ = start;
+      end_ = end;
+    }
+
+    inline void ResetRange() {
+      SetRange(0, size_);
+    }
+
+    inline void Load(float* value) {
+      for (size_t i = start_; i < end_; ++i) {
+        accumulator_[i] = value[i];
+      }
+    }
+
+    inline void Read(float* value, float scale) {
+      for (size_t i = start_; i < end_; ++i) {
+        accumulator_[i] += value[i] * scale;
+      }
+    }
+
+    inline void Read(float* value) {
+      for (size_t i = start_; i < end_; ++i) {
+        accumulator_[i] += value[i];
+      }
+    }
+
+    inline void Write(float* value) {
+      for (size_t i = start_; i < end_; ++i) {
+        value[i] = accumulator_[i];
+      }
+    }
+
+    inline void Write(float* value, float scale) {
+      for (size_t i = start_; i < end_; ++i) {
+        value[i] = accumulator_[i];
+        accumulator_[i] *= scale;
+      }
+    }
+
+    template<typename D>
+    inline void Write(D& d, int32_t offset, float scale) {
+      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      int32_t p = write_ptr_ + base<D>() + \
+          (offset == -1 ? length<D>() - 1 : Scale(offset));
+      for (size_t i = start_; i < end_; ) {
+        T* w = &buffer_[(p - static_cast<int32_t>(i)) & mask()];
+        size_t n = contiguous(w, i);
+        float* a = &accumulator_[i];
+        size_t j = 0;
+#ifdef __SSE2__
+        for (; j + 4 <= n; j += 4) {
+          __m128 a_j = _mm_loadu_ps(&a[j]);
+          DataType<format>::Compress(a_j, &w[-static_cast<int32_t>(j)]);
+          _mm_storeu_ps(&a[j], _mm_mul_ps(a_j, _mm_set1_ps(scale)));
+        }
+#endif  // __SSE2__
+        for (; j < n; ++j) {
+          w[-static_cast<int32_t>(j)] = DataType<format>::Compress(a[j]);
+          a[j] *= scale;
+        }
+        i += n;
+      }
+    }
+
+    template<typename D>
+    inline void Write(D& d, float scale) {
+      Write(d, 0, scale);
+    }
+
+    template<typename D>
+    inline void WriteAllPass(D& d, int32_t offset, float scale) {
+      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      int32_t p = write_ptr_ + base<D>() + \
+          (offset == -1 ? length<D>() - 1 : Scale(offset));
+      for (size_t i = start_; i < end_; ) {
+        T* w = &buffer_[(p - static_cast<int32_t>(i)) & mask()];
+        size_t n = contiguous(w, i);
+        float* a = &accumulator_[i];
+        const float* r = &previous_read_[i];
+        size_t j = 0;
+#ifdef __SSE2__
+        for (; j + 4 <= n; j += 4) {
+          __m128 a_j = _mm_loadu_ps(&a[j]);
+          DataType<format>::Compress(a_j, &w[-static_cast<int32_t>(j)]);
+          a_j = _mm_mul_ps(a_j, _mm_set1_ps(scale));
+          _mm_storeu_ps(&a[j], _mm_add_ps(a_j, _mm_loadu_ps(&r[j])));
+        }
+#endif  // __SSE2__
+        for (; j < n; ++j) {
+          w[-static_cast<int32_t>(j)] = DataType<format>::Compress(a[j]);
+          a[j] *= scale;
+          a[j] += r[j];
+        }
+        i += n;
+      }
+    }
+
+    template<typename D>
+    inline void WriteAllPass(D& d, float scale) {
+      WriteAllPass(d, 0, scale);
+    }
+
+    template<typename D>
+    inline void Read(D& d, int32_t offset, float scale) {
+      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      int32_t p = write_ptr_ + base<D>() + \
+          (offset == -1 ? length<D>() - 1 : Scale(offset));
+      for (size_t i = start_; i < end_; ) {
+        const T* r = &buffer_[(p - static_cast<int32_t>(i)) & mask()];
+        size_t n = contiguous(r, i);
+        float* a = &accumulator_[i];
+        float* previous = &previous_read_[i];
+        size_t j = 0;
+#ifdef __SSE2__
+        for (; j + 4 <= n; j += 4) {
+          __m128 r_f = DataType<format>::Decompress(
+              &r[-static_cast<int32_t>(j)]);
+          _mm_storeu_ps(&previous[j], r_f);
+          _mm_storeu_ps(&a[j], _mm_add_ps(
+              _mm_loadu_ps(&a[j]), _mm_mul_ps(r_f, _mm_set1_ps(scale))));
+        }
+#endif  // __SSE2__
+        for (; j < n; ++j) {
+          float r_f = DataType<format>::Decompress(
+              r[-static_cast<int32_t>(j)]);
+          previous[j] = r_f;
+          a[j] += r_f * scale;
+        }
+        i += n;
+      }
+    }
+
+    template<typename D>
+    inline void Read(D& d, float scale) {
+      Read(d, 0, scale);
+    }
+
+    inline void Lp(float& state, float coefficient) {
+      float s = state;
+      for (size_t i = start_; i < end_; ++i) {
+        s += coefficient * (accumulator_[i] - s);
+        accumulator_[i] = s;
+      }
+      state = s;
+    }
+
+    inline void Hp(float& state, float coefficient) {
+      float s = state;
+      for (size_t i = start_; i < end_; ++i) {
+        s += coefficient * (accumulator_[i] - s);
+        accumulator_[i] -= s;
+      }
+      state = s;
+    }
+
+    template<typename D>
+    inline void Interpolate(D& d, float offset, float scale) {
+      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      offset = Scale(offset);
+      MAKE_INTEGRAL_FRACTIONAL(offset);
+      int32_t p = write_ptr_ + offset_integral + base<D>();
+      for (size_t i = start_; i < end_; ++i) {
+        int32_t p_i = p - static_cast<int32_t>(i);
+        float a = DataType<format>::Decompress(buffer_[p_i & mask()]);
+        float b = DataType<format>::Decompress(buffer_[(p_i + 1) & mask()]);
+        float x = a + (b - a) * offset_fractional;
+        previous_read_[i] = x;
+        accumulator_[i] += x * scale;
+      }
+    }
+
+    template<typename D>
+    inline void Interpolate(
+        D& d, float offset, LFOIndex index, float amplitude, float scale) {
+      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      for (size_t i = start_; i < end_; ++i) {
+        float sample_offset = offset + amplitude * lfo_value_[index][i];
+        sample_offset = Scale(sample_offset);
+        MAKE_INTEGRAL_FRACTIONAL(sample_offset);
+        int32_t p_i = write_ptr_ - static_cast<int32_t>(i) + \
+            sample_offset_integral + base<D>();
+        float a = DataType<format>::Decompress(buffer_[p_i & mask()]);
+        float b = DataType<format>::Decompress(buffer_[(p_i + 1) & mask()]);
+        float x = a + (b - a) * sample_offset_fractional;
+        previous_read_[i] = x;
+        accumulator_[i] += x * scale;
+      }
+    }
+
+   private:
+    // Number of samples, from sample i at address p, that can be accessed at
+    // decreasing addresses without wrapping around the buffer.
+    inline size_t contiguous(const T* p, size_t i) const {
+      return std::min(end_ - i, static_cast<size_t>(p - buffer_) + 1);
+    }
+
+    // See Context.
+    template<typename D>
+    inline int32_t base() const {
+      return scaled
+          ? (D::base * scale_ >> 8) + (scale_ < 256 ? D::number : 0)
+          : D::base;
+    }
+
+    template<typename D>
+    inline int32_t length() const {
+      return scaled ? D::length * scale_ >> 8 : D::length;
+    }
+
+    inline int32_t Scale(int32_t offset) const {
+      return scaled ? offset * scale_ >> 8 : offset;
+    }
+
+    inline float Scale(float offset) const {
+      return scaled ? offset * time_scale_ : offset;
+    }
+
+    inline int32_t mask() const {
+      return scaled ? mask_ : size - 1;
+    }
+
+    float accumulator_[max_size];
+    float previous_read_[max_size];
+    float lfo_value_[2][max_size];
+    size_t size_;
+    size_t start_;
+    size_t end_;
+    T* buffer_;
+    int32_t write_ptr_;  // For the first sample of the block.
+    int32_t mask_;
+    int32_t scale_;
+    float time_scale_;
+
+    DISALLOW_COPY_AND_ASSIGN(BlockContext);
+  };
+
   inline void SetLFOFrequency(LFOIndex index, float frequency) {
     lfo_[index].template Init<stmlib::COSINE_OSCILLATOR_APPROXIMATE>(
-        frequency * 32.0f);
+        frequency / time_scale_ * 32.0f);
   }
   
-  inline void Start(Context* c) {
+  template<bool scaled>
+  inline void Start(Context<scaled>* c) {
     --write_ptr_;
     if (write_ptr_ < 0) {
-      write_ptr_ += size;
+      write_ptr_ += buffer_size_;
     }
     c->accumulator_ = 0.0f;
     c->previous_read_ = 0.0f;
     c->buffer_ = buffer_;
     c->write_ptr_ = write_ptr_;
+    c->mask_ = buffer_size_ - 1;
+    c->scale_ = scale_;
+    c->time_scale_ = time_scale_;
     if ((write_ptr_ & 31) == 0) {
       c->lfo_value_[0] = lfo_[0].Next();
       c->lfo_value_[1] = lfo_[1].Next();
@@ -284,14 +652,42 @@ class FxEngine {
       c->lfo_value_[1] = lfo_[1].value();
     }
   }
-  
+
+  template<size_t max_size, bool scaled>
+  inline void Start(BlockContext<max_size, scaled>* c, size_t block_size) {
+    c->size_ = block_size;
+    c->start_ = 0;
+    c->end_ = block_size;
+    c->buffer_ = buffer_;
+    c->mask_ = buffer_size_ - 1;
+    c->scale_ = scale_;
+    c->time_scale_ = time_scale_;
+    for (size_t i = 0; i < block_size; ++i) {
+      --write_ptr_;
+      if (write_ptr_ < 0) {
+        write_ptr_ += buffer_size_;
+      }
+      if (i == 0) {
+        c->write_ptr_ = write_ptr_;
+      }
+      c->accumulator_[i] = 0.0f;
+      c->previous_read_[i] = 0.0f;
+      if ((write_ptr_ & 31) == 0) {
+        c->lfo_value_[0][i] = lfo_[0].Next();
+        c->lfo_value_[1][i] = lfo_[1].Next();
+      } else {
+        c->lfo_value_[0][i] = lfo_[0].value();
+        c->lfo_value_[1][i] = lfo_[1].value();
+      }
+    }
+  }
+
  private:
-  enum {
-    MASK = size - 1
-  };
-  
   int32_t write_ptr_;
   T* buffer_;
+  int32_t buffer_size_;
+  int32_t scale_;
+  float time_scale_;
   stmlib::CosineOscillator lfo_[2];
   
   DISALLOW_COPY_AND_ASSIGN(FxEngine);
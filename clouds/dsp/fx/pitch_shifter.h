@@ -42,9 +42,16 @@ class PitchShifter {
   ~PitchShifter() { }
   
   void Init(uint16_t* buffer) {
-    engine_.Init(buffer);
+    Init(buffer, 1.0f);
+  }
+  
+  // Runs at time_scale times 32kHz. The buffer must hold
+  // 4096 * DelayMemoryScale(time_scale) samples.
+  void Init(uint16_t* buffer, float time_scale) {
+    engine_.Init(buffer, time_scale);
     phase_ = 0;
     size_ = 2047.0f;
+    time_scale_ = engine_.time_scale();
   }
   
   void Clear() {
@@ -52,20 +59,47 @@ class PitchShifter {
   }
 
   inline void Process(FloatFrame* input_output, size_t size) {
-    while (size--) {
-      Process(input_output);
-      ++input_output;
+    if (engine_.scaled()) {
+      while (size--) {
+        Process<true>(input_output++);
+      }
+    } else {
+      while (size--) {
+        Process<false>(input_output++);
+      }
     }
   }
   
+  void Process(FloatFrame* input_output) {
+    if (engine_.scaled()) {
+      Process<true>(input_output);
+    } else {
+      Process<false>(input_output);
+    }
+  }
+  
+  inline void set_ratio(float ratio) {
+    ratio_ = ratio;
+  }
+  
+  inline void set_size(float size) {
+    float target_size = 128.0f + (2047.0f - 128.0f) * size * size * size;
+    ONE_POLE(size_, target_size, 0.05f)
+  }
+  
+ private:
+  typedef FxEngine<4096, FORMAT_16_BIT> E;
+  
+  template<bool scaled>
   void Process(FloatFrame* input_output) {
     typedef E::Reserve<2047, E::Reserve<2047> > Memory;
     E::DelayLine<Memory, 0> left;
     E::DelayLine<Memory, 1> right;
-    E::Context c;
+    E::Context<scaled> c;
     engine_.Start(&c);
     
-    phase_ += (1.0f - ratio_) / size_;
+    // The window is size_ samples long at 32kHz.
+    phase_ += (1.0f - ratio_) / (size_ * time_scale_);
     if (phase_ >= 1.0f) {
       phase_ -= 1.0f;
     }
@@ -92,21 +126,11 @@ class PitchShifter {
     c.Write(input_output->r, 0.0f);
   }
   
-  inline void set_ratio(float ratio) {
-    ratio_ = ratio;
-  }
-  
-  inline void set_size(float size) {
-    float target_size = 128.0f + (2047.0f - 128.0f) * size * size * size;
-    ONE_POLE(size_, target_size, 0.05f)
-  }
-  
- private:
-  typedef FxEngine<4096, FORMAT_16_BIT> E;
   E engine_;
   float phase_;
   float ratio_;
   float size_;
+  float time_scale_;
   
   DISALLOW_COPY_AND_ASSIGN(PitchShifter);
 };
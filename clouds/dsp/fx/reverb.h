@@ -31,38 +31,115 @@
 
 #include "stmlib/stmlib.h"
 
+#include <algorithm>
+
+#include "clouds/dsp/frame.h"
 #include "clouds/dsp/fx/fx_engine.h"
 
+// #define USE_BLOCK_REVERB
+
 namespace clouds {
 
+const size_t kMaxReverbBlockSize = 128;
+
 class Reverb {
  public:
   Reverb() { }
   ~Reverb() { }
   
   void Init(uint16_t* buffer) {
-    engine_.Init(buffer);
+    Init(buffer, 1.0f);
+  }
+  
+  // Runs at time_scale times 32kHz. The buffer must hold
+  // 16384 * DelayMemoryScale(time_scale) samples.
+  void Init(uint16_t* buffer, float time_scale) {
+    engine_.Init(buffer, time_scale);
     engine_.SetLFOFrequency(LFO_1, 0.5f / 32000.0f);
     engine_.SetLFOFrequency(LFO_2, 0.3f / 32000.0f);
+    time_scale_ = engine_.time_scale();
+    // Blocks must be shorter than AP2, the shortest of the delays processed
+    // a block at a time. AP1 is smeared with samples written only 10 to 70
+    // samples earlier, so it is processed 8 samples at a time.
+    block_size_ = std::max(std::min(
+        kMaxReverbBlockSize,
+        static_cast<size_t>(161.0f * time_scale_)), size_t(1));
+    smear_block_size_ = std::max(
+        static_cast<size_t>(8.0f * time_scale_), size_t(1));
     lp_ = 0.7f;
     diffusion_ = 0.625f;
+    lp_decay_1_ = 0.0f;
+    lp_decay_2_ = 0.0f;
   }
   
   void Process(FloatFrame* in_out, size_t size) {
+#ifdef USE_BLOCK_REVERB
+    ProcessBlocks(in_out, size);
+#else
+    ProcessSamples(in_out, size);
+#endif  // USE_BLOCK_REVERB
+  }
+
+  void ProcessSamples(FloatFrame* in_out, size_t size) {
+    if (engine_.scaled()) {
+      ProcessSamples<true>(in_out, size);
+    } else {
+      ProcessSamples<false>(in_out, size);
+    }
+  }
+
+  void ProcessBlocks(FloatFrame* in_out, size_t size) {
+    if (engine_.scaled()) {
+      ProcessBlocks<true>(in_out, size);
+    } else {
+      ProcessBlocks<false>(in_out, size);
+    }
+  }
+  
+  inline void set_amount(float amount) {
+    amount_ = amount;
+  }
+  
+  inline void set_input_gain(float input_gain) {
+    input_gain_ = input_gain;
+  }
+
+  inline void set_time(float reverb_time) {
+    reverb_time_ = reverb_time;
+  }
+  
+  inline void set_diffusion(float diffusion) {
+    diffusion_ = diffusion;
+  }
+  
+  inline void set_lp(float lp) {
+    if (time_scale_ != 1.0f) {
+      // Same cutoff as at 32kHz. The decay time needs no correction, since
+      // the loop gets longer with the delays.
+      lp = 1.0f - powf(1.0f - lp, 1.0f / time_scale_);
+    }
+    lp_ = lp;
+  }
+  
+ private:
+  typedef FxEngine<16384, FORMAT_12_BIT> E;
+  typedef E::Reserve<113,
+    E::Reserve<162,
+    E::Reserve<241,
+    E::Reserve<399,
+    E::Reserve<1653,
+    E::Reserve<2038,
+    E::Reserve<3411,
+    E::Reserve<1913,
+    E::Reserve<1663,
+    E::Reserve<4782> > > > > > > > > > Memory;
+
+  template<bool scaled>
+  void ProcessSamples(FloatFrame* in_out, size_t size) {
     // This is the Griesinger topology described in the Dattorro paper
     // (4 AP diffusers on the input, then a loop of 2x 2AP+1Delay).
     // Modulation is applied in the loop of the first diffuser AP for additional
     // smearing; and to the two long delays for a slow shimmer/chorus effect.
-    typedef E::Reserve<113,
-      E::Reserve<162,
-      E::Reserve<241,
-      E::Reserve<399,
-      E::Reserve<1653,
-      E::Reserve<2038,
-      E::Reserve<3411,
-      E::Reserve<1913,
-      E::Reserve<1663,
-      E::Reserve<4782> > > > > > > > > > Memory;
     E::DelayLine<Memory, 0> ap1;
     E::DelayLine<Memory, 1> ap2;
     E::DelayLine<Memory, 2> ap3;
@@ -73,7 +150,7 @@ class Reverb {
     E::DelayLine<Memory, 7> dap2a;
     E::DelayLine<Memory, 8> dap2b;
     E::DelayLine<Memory, 9> del2;
-    E::Context c;
+    E::Context<scaled> c;
 
     const float kap = diffusion_;
     const float klp = lp_;
@@ -139,28 +216,103 @@ class Reverb {
     lp_decay_2_ = lp_2;
   }
   
-  inline void set_amount(float amount) {
-    amount_ = amount;
-  }
-  
-  inline void set_input_gain(float input_gain) {
-    input_gain_ = input_gain;
-  }
+  // Same as ProcessSamples, with each delay line processed block_size_
+  // samples at a time.
+  template<bool scaled>
+  void ProcessBlocks(FloatFrame* in_out, size_t size) {
+    E::DelayLine<Memory, 0> ap1;
+    E::DelayLine<Memory, 1> ap2;
+    E::DelayLine<Memory, 2> ap3;
+    E::DelayLine<Memory, 3> ap4;
+    E::DelayLine<Memory, 4> dap1a;
+    E::DelayLine<Memory, 5> dap1b;
+    E::DelayLine<Memory, 6> del1;
+    E::DelayLine<Memory, 7> dap2a;
+    E::DelayLine<Memory, 8> dap2b;
+    E::DelayLine<Memory, 9> del2;
+    E::BlockContext<kMaxReverbBlockSize, scaled> c;
 
-  inline void set_time(float reverb_time) {
-    reverb_time_ = reverb_time;
-  }
-  
-  inline void set_diffusion(float diffusion) {
-    diffusion_ = diffusion;
-  }
-  
-  inline void set_lp(float lp) {
-    lp_ = lp;
+    const float kap = diffusion_;
+    const float klp = lp_;
+    const float krt = reverb_time_;
+    const float amount = amount_;
+    const float gain = input_gain_;
+
+    float lp_1 = lp_decay_1_;
+    float lp_2 = lp_decay_2_;
+
+    float input[kMaxReverbBlockSize];
+    float apout[kMaxReverbBlockSize];
+    float wet[kMaxReverbBlockSize];
+    float del2_tap[kMaxReverbBlockSize];
+
+    while (size) {
+      size_t block_size = std::min(size, block_size_);
+      engine_.Start(&c, block_size);
+      for (size_t i = 0; i < block_size; ++i) {
+        input[i] = in_out[i].l + in_out[i].r;
+      }
+
+      // The delay lines fill the whole buffer, and the modulated tap of DEL2
+      // reaches the memory that AP1 overwrites during the next samples: it
+      // is read first.
+      c.Interpolate(del2, 4680.0f, LFO_2, 100.0f, krt);
+      c.Write(del2_tap, 0.0f);
+
+      for (size_t i = 0; i < block_size; i += smear_block_size_) {
+        c.SetRange(i, std::min(i + smear_block_size_, block_size));
+        c.Interpolate(ap1, 10.0f, LFO_1, 60.0f, 1.0f);
+        c.Write(ap1, 100, 0.0f);
+        c.Read(input, gain);
+        c.Read(ap1 TAIL, kap);
+        c.WriteAllPass(ap1, -kap);
+      }
+      c.ResetRange();
+
+      c.Read(ap2 TAIL, kap);
+      c.WriteAllPass(ap2, -kap);
+      c.Read(ap3 TAIL, kap);
+      c.WriteAllPass(ap3, -kap);
+      c.Read(ap4 TAIL, kap);
+      c.WriteAllPass(ap4, -kap);
+      c.Write(apout);
+
+      c.Load(apout);
+      c.Read(del2_tap);
+      c.Lp(lp_1, klp);
+      c.Read(dap1a TAIL, -kap);
+      c.WriteAllPass(dap1a, kap);
+      c.Read(dap1b TAIL, kap);
+      c.WriteAllPass(dap1b, -kap);
+      c.Write(del1, 2.0f);
+      c.Write(wet, 0.0f);
+
+      for (size_t i = 0; i < block_size; ++i) {
+        in_out[i].l += (wet[i] - in_out[i].l) * amount;
+      }
+
+      c.Load(apout);
+      c.Read(del1 TAIL, krt);
+      c.Lp(lp_2, klp);
+      c.Read(dap2a TAIL, kap);
+      c.WriteAllPass(dap2a, -kap);
+      c.Read(dap2b TAIL, -kap);
+      c.WriteAllPass(dap2b, kap);
+      c.Write(del2, 2.0f);
+      c.Write(wet, 0.0f);
+
+      for (size_t i = 0; i < block_size; ++i) {
+        in_out[i].r += (wet[i] - in_out[i].r) * amount;
+      }
+
+      in_out += block_size;
+      size -= block_size;
+    }
+
+    lp_decay_1_ = lp_1;
+    lp_decay_2_ = lp_2;
   }
-  
- private:
-  typedef FxEngine<16384, FORMAT_12_BIT> E;
+
   E engine_;
   
   float amount_;
@@ -168,6 +320,9 @@ class Reverb {
   float reverb_time_;
   float diffusion_;
   float lp_;
+  float time_scale_;
+  size_t block_size_;
+  size_t smear_block_size_;
   
   float lp_decay_1_;
   float lp_decay_2_;
@@ -42,7 +42,8 @@ namespace clouds {
 enum GrainQuality {
   GRAIN_QUALITY_LOW,
   GRAIN_QUALITY_MEDIUM,
-  GRAIN_QUALITY_HIGH
+  GRAIN_QUALITY_HIGH,
+  GRAIN_QUALITY_LAST
 };
 
 class Grain {
@@ -49,9 +49,14 @@ void GranularProcessor::Init(
   buffer_[1] = small_buffer;
   buffer_size_[0] = large_buffer_size;
   buffer_size_[1] = small_buffer_size;
+  sample_memory_ = NULL;
+  sample_memory_size_ = 0;
+  keep_sample_memory_ = false;
   
   num_channels_ = 2;
   low_fidelity_ = false;
+  decimation_ = true;
+  sample_rate_ = 32000.0f;
   bypass_ = false;
   
   src_down_.Init();
@@ -64,6 +69,25 @@ void GranularProcessor::Init(
   dry_wet_ = 0.0f;
 }
 
+// Size of the delay memories of the diffuser, the reverb, and the correlator
+// - which shares its memory with the pitch shifter.
+static size_t FxMemorySize(size_t memory_scale) {
+  size_t correlator_block_size = (kMaxWSOLASize / 32) + 2;
+  return 2048 * memory_scale * sizeof(float) + \
+      16384 * memory_scale * sizeof(uint16_t) + \
+      max(correlator_block_size * 3, 2048 * memory_scale) * sizeof(uint32_t);
+}
+
+bool GranularProcessor::fx_fit(int32_t num_channels, float sample_rate) const {
+  size_t workspace_size = num_channels == 1
+      ? buffer_size_[1]
+      : (buffer_size_[0] > buffer_size_[1]
+            ? buffer_size_[0] - buffer_size_[1]
+            : 0);
+  return FxMemorySize(DelayMemoryScale(sample_rate / 32000.0f)) <= \
+      workspace_size;
+}
+
 void GranularProcessor::ResetFilters() {
   for (int32_t i = 0; i < 2; ++i) {
     fb_filter_[i].Init();
@@ -202,7 +226,7 @@ void GranularProcessor::Process(
         SoftLimit(fb_gain * 1.4f * fb_[i].r + in_[i].r) - in_[i].r);
   }
   
-  if (low_fidelity_) {
+  if (decimated()) {
     size_t downsampled_size = size / kDownsamplingFactor;
     src_down_.Process(in_, in_downsampled_,size);
     ProcessGranular(in_downsampled_, out_downsampled_, downsampled_size);
@@ -236,6 +260,10 @@ void GranularProcessor::Process(
         (cutoff < 0.5f ? cutoff - 0.5f : 0.0f) * 216.0f);
     float hp_cutoff = 0.25f * SemitonesToRatio(
         (cutoff < 0.5f ? -0.5f : cutoff - 1.0f) * 216.0f);
+    if (sample_rate_ != 32000.0f) {
+      lp_cutoff *= 32000.0f / sample_rate_;
+      hp_cutoff *= 32000.0f / sample_rate_;
+    }
     CONSTRAIN(lp_cutoff, 0.0f, 0.499f);
     CONSTRAIN(hp_cutoff, 0.0f, 0.499f);
     float lpq = 1.0f + 3.0f * (1.0f - feedback) * (0.5f - lp_cutoff);
@@ -305,10 +333,18 @@ void GranularProcessor::GetPersistentData(
   ++block;
 
   // Create save block holding the audio buffers.
+  void* buffer[2] = { buffer_[0], buffer_[1] };
+  size_t buffer_size[2] = {
+    buffer_size_[num_channels_ - 1],
+    buffer_size_[num_channels_ - 1]
+  };
+  if (sample_memory_ && playback_mode_ != PLAYBACK_MODE_SPECTRAL) {
+    GetSampleMemoryLayout(buffer, buffer_size);
+  }
   for (int32_t i = 0; i < num_channels_; ++i) {
     block->tag = FourCC<'b', 'u', 'f', 'f'>::value;
-    block->data = buffer_[i];
-    block->size = buffer_size_[num_channels_ - 1];
+    block->data = buffer[i];
+    block->size = buffer_size[i];
     ++block;
   }
   *num_blocks = block - first_block;
@@ -344,7 +380,10 @@ bool GranularProcessor::LoadPersistentData(const uint32_t* data) {
             ? PLAYBACK_MODE_SPECTRAL
             : PLAYBACK_MODE_GRANULAR);
       }
-      set_quality(persistent_state_.quality);
+      if (!set_quality(persistent_state_.quality)) {
+        silence_ = false;
+        return false;
+      }
 
       // We can force a switch to this mode, and once everything has been
       // initialized for this mode, we continue with the loop to copy the
@@ -355,6 +394,40 @@ bool GranularProcessor::LoadPersistentData(const uint32_t* data) {
   }
   
   // We can finally reset the position of the write heads.
+  ResyncWriteHeads();
+  parameters_.freeze = true;
+  silence_ = false;
+  return true;
+}
+
+bool GranularProcessor::MapPersistentData(
+    const PersistentState& state,
+    void* buffers,
+    size_t size) {
+  if (state.spectral) {
+    return false;
+  }
+  silence_ = true;
+  
+  persistent_state_ = state;
+  if (playback_mode_ == PLAYBACK_MODE_SPECTRAL) {
+    set_playback_mode(PLAYBACK_MODE_GRANULAR);
+  }
+  if (!set_quality(persistent_state_.quality)) {
+    silence_ = false;
+    return false;
+  }
+  set_sample_memory(buffers, size);
+  keep_sample_memory_ = true;
+  Prepare();
+  
+  ResyncWriteHeads();
+  parameters_.freeze = true;
+  silence_ = false;
+  return true;
+}
+
+void GranularProcessor::ResyncWriteHeads() {
   if (low_fidelity_) {
     buffer_8_[0].Resync(persistent_state_.write_head[0]);
     buffer_8_[1].Resync(persistent_state_.write_head[1]);
@@ -362,9 +435,20 @@ bool GranularProcessor::LoadPersistentData(const uint32_t* data) {
     buffer_16_[0].Resync(persistent_state_.write_head[0]);
     buffer_16_[1].Resync(persistent_state_.write_head[1]);
   }
-  parameters_.freeze = true;
-  silence_ = false;
-  return true;
+}
+
+void GranularProcessor::GetSampleMemoryLayout(
+    void** buffer,
+    size_t* buffer_size) const {
+  size_t size = sample_memory_size_ / num_channels_;
+  if (size > kMaxSampleMemorySize) {
+    size = kMaxSampleMemorySize;
+  }
+  size &= ~3;
+  for (int32_t i = 0; i < num_channels_; ++i) {
+    buffer[i] = static_cast<uint8_t*>(sample_memory_) + i * size;
+    buffer_size[i] = size;
+  }
 }
 
 void GranularProcessor::Prepare() {
@@ -407,19 +491,37 @@ void GranularProcessor::Prepare() {
       workspace_size = buffer_size_[0] - buffer_size_[1];
       workspace = static_cast<uint8_t*>(buffer[0]) + buffer_size[0];
     }
+    
+    bool clear = true;
+    if (sample_memory_ && playback_mode_ != PLAYBACK_MODE_SPECTRAL) {
+      GetSampleMemoryLayout(buffer, buffer_size);
+      // Do not touch all the pages of a (mostly zero-filled) file, unless zero
+      // is not silence, as in mu-law - or unless the memory holds a recording
+      // to restore.
+      clear = low_fidelity_ && !keep_sample_memory_;
+    }
+    keep_sample_memory_ = false;
     float sr = sample_rate();
+    float time_scale = sample_rate_ / 32000.0f;
+    size_t memory_scale = DelayMemoryScale(time_scale);
 
+    // set_sample_rate and set_num_channels have checked that the workspace
+    // holds the delay memories at this sample rate.
     BufferAllocator allocator(workspace, workspace_size);
-    diffuser_.Init(allocator.Allocate<float>(2048));
-    reverb_.Init(allocator.Allocate<uint16_t>(16384));
+    diffuser_.Init(
+        allocator.Allocate<float>(2048 * memory_scale), time_scale);
+    reverb_.Init(
+        allocator.Allocate<uint16_t>(16384 * memory_scale), time_scale);
     
+    // The pitch shifter (used in looping mode only) shares its memory with
+    // the correlator (used in stretch mode only).
     size_t correlator_block_size = (kMaxWSOLASize / 32) + 2;
     uint32_t* correlator_data = allocator.Allocate<uint32_t>(
-        correlator_block_size * 3);
+        max(correlator_block_size * 3, 2048 * memory_scale));
     correlator_.Init(
         &correlator_data[0],
         &correlator_data[correlator_block_size]);
-    pitch_shifter_.Init((uint16_t*)correlator_data);
+    pitch_shifter_.Init((uint16_t*)correlator_data, time_scale);
     
     if (playback_mode_ == PLAYBACK_MODE_SPECTRAL) {
       phase_vocoder_.Init(
@@ -432,18 +534,20 @@ void GranularProcessor::Prepare() {
           buffer_8_[i].Init(
               buffer[i],
               (buffer_size[i]),
-              tail_buffer_[i]);
+              tail_buffer_[i],
+              clear);
         } else {
           buffer_16_[i].Init(
               buffer[i],
               ((buffer_size[i]) >> 1),
-              tail_buffer_[i]);
+              tail_buffer_[i],
+              clear);
         }
       }
-      int32_t num_grains = (num_channels_ == 1 ? 40 : 32) * \
-          (low_fidelity_ ? 23 : 16) >> 4;
-      player_.Init(num_channels_, num_grains);
-      ws_player_.Init(&correlator_, num_channels_);
+      int32_t num_grains = ((num_channels_ == 1 ? 40 : 32) * \
+          (decimated() ? 23 : 16) >> 4) * kMaxNumGrains >> 6;
+      player_.Init(num_channels_, num_grains, time_scale);
+      ws_player_.Init(&correlator_, num_channels_, time_scale);
       looper_.Init(num_channels_);
     }
     reset_buffers_ = false;
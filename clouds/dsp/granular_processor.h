@@ -48,6 +48,10 @@ namespace clouds {
 
 const int32_t kDownsamplingFactor = 2;
 
+// Size of the recording buffer of each channel, when using external sample
+// memory: positions in the buffers are int32 sample indices.
+const size_t kMaxSampleMemorySize = 1 << 30;
+
 enum PlaybackMode {
   PLAYBACK_MODE_GRANULAR,
   PLAYBACK_MODE_STRETCH,
@@ -122,14 +126,24 @@ class GranularProcessor {
   
   inline PlaybackMode playback_mode() const { return playback_mode_; }
   
-  inline void set_quality(int32_t quality) {
-    set_num_channels(quality & 1 ? 1 : 2);
+  // Returns false, and leaves the setting unchanged, when the FX workspace
+  // of this number of channels cannot hold the effects at the current sample
+  // rate (see set_sample_rate).
+  inline bool set_quality(int32_t quality) {
+    if (!set_num_channels(quality & 1 ? 1 : 2)) {
+      return false;
+    }
     set_low_fidelity(quality >> 1 ? true : false);
+    return true;
   }
   
-  inline void set_num_channels(int32_t num_channels) {
+  inline bool set_num_channels(int32_t num_channels) {
+    if (!fx_fit(num_channels, sample_rate_)) {
+      return false;
+    }
     reset_buffers_ = reset_buffers_ || num_channels_ != num_channels;
     num_channels_ = num_channels;
+    return true;
   }
   
   inline void set_low_fidelity(bool low_fidelity) {
@@ -137,6 +151,47 @@ class GranularProcessor {
     low_fidelity_ = low_fidelity;
   }
   
+  // When disabled, the low fidelity mode only reduces the resolution of the
+  // recording buffers, and the processing runs at the full sample rate.
+  inline void set_low_fidelity_decimation(bool decimation) {
+    reset_buffers_ = reset_buffers_ || decimation != decimation_;
+    decimation_ = decimation;
+  }
+  
+  // Native sample rate (32kHz by default). All the delay memories of the
+  // effects grow by DelayMemoryScale(sample_rate / 32000), so the FX
+  // workspace - the large buffer minus the small one in stereo, the small
+  // buffer in mono - must hold 48k * DelayMemoryScale(sample_rate / 32000).
+  // Returns false, and leaves the sample rate unchanged, when it does not.
+  // With the module's buffers, only rates up to 32kHz are accepted.
+  inline bool set_sample_rate(float sample_rate) {
+    if (!fx_fit(num_channels_, sample_rate)) {
+      return false;
+    }
+    reset_buffers_ = reset_buffers_ || sample_rate != sample_rate_;
+    sample_rate_ = sample_rate;
+    return true;
+  }
+  
+  // Records into external sample memory - for example a MappedSampleMemory
+  // holding minutes or hours of audio - rather than into the SRAM buffers.
+  // The spectral mode still uses the SRAM buffers. NULL reverts to the SRAM.
+  inline void set_sample_memory(void* memory, size_t size) {
+    sample_memory_ = memory;
+    sample_memory_size_ = size;
+    reset_buffers_ = true;
+  }
+  
+  inline void set_correlator_search_mode(CorrelatorSearchMode mode) {
+    correlator_.set_search_mode(mode);
+  }
+  
+#ifdef USE_GRAIN_THREADS
+  inline void set_num_grain_threads(int32_t num_threads) {
+    player_.set_num_threads(num_threads);
+  }
+#endif  // USE_GRAIN_THREADS
+  
   inline int32_t quality() const {
     int32_t quality = 0;
     if (num_channels_ == 1) quality |= 1;
@@ -147,24 +202,42 @@ class GranularProcessor {
   void GetPersistentData(PersistentBlock* block, size_t *num_blocks);
   bool LoadPersistentData(const uint32_t* data);
   void PreparePersistentData();
+  
+  // Restores a recording from memory holding its 'buff' blocks back to back
+  // (for example a snapshot file mapped in memory): the memory is used as
+  // sample memory as is, instead of being copied. Not possible for a
+  // recording made in spectral mode, whose buffers hold FFT frames.
+  bool MapPersistentData(
+      const PersistentState& state,
+      void* buffers,
+      size_t size);
 
  private:
   inline int32_t resolution() const {
     return low_fidelity_ ? 8 : 16;
   }
 
+  inline bool decimated() const {
+    return low_fidelity_ && decimation_;
+  }
+
   inline float sample_rate() const {
-    return 32000.0f / \
-        (low_fidelity_ ? kDownsamplingFactor : 1);
+    return sample_rate_ / \
+        (decimated() ? kDownsamplingFactor : 1);
   }
      
+  bool fx_fit(int32_t num_channels, float sample_rate) const;
   void ResetFilters();
+  void ResyncWriteHeads();
+  void GetSampleMemoryLayout(void** buffer, size_t* buffer_size) const;
   void ProcessGranular(FloatFrame* input, FloatFrame* output, size_t size);
 
   PlaybackMode playback_mode_;
   PlaybackMode previous_playback_mode_;
   int32_t num_channels_;
   bool low_fidelity_;
+  bool decimation_;
+  float sample_rate_;
   
   bool silence_;
   bool bypass_;
@@ -175,6 +248,10 @@ class GranularProcessor {
   void* buffer_[2];
   size_t buffer_size_[2];
   
+  void* sample_memory_;
+  size_t sample_memory_size_;
+  bool keep_sample_memory_;
+  
   Correlator correlator_;
   
   GranularSamplePlayer player_;
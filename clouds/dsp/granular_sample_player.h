@@ -25,6 +25,11 @@
 // -----------------------------------------------------------------------------
 //
 // Granular playback of audio stored in a buffer.
+//
+// The active grains are kept in one list per quality, in the order in which
+// they were started, and the free grains in a stack. Each list is rendered by
+// a single instance of Grain::OverlapAdd, so the cost of a block only depends
+// on the number of grains actually playing - not on the size of the pool.
 
 #ifndef CLOUDS_DSP_GRANULAR_SAMPLE_PLAYER_H_
 #define CLOUDS_DSP_GRANULAR_SAMPLE_PLAYER_H_
@@ -44,9 +49,26 @@
 
 #include "clouds/resources.h"
 
+#ifdef USE_GRAIN_THREADS
+#include "host/worker_pool.h"
+#endif  // USE_GRAIN_THREADS
+
+// The module uses up to 64 grains. Host builds can raise this limit (to a few
+// thousand grains), the number of grains used by the processor being scaled
+// accordingly.
+#ifndef MAX_NUM_GRAINS
+#define MAX_NUM_GRAINS 64
+#endif  // MAX_NUM_GRAINS
+
 namespace clouds {
 
-const int32_t kMaxNumGrains = 64;
+const int32_t kMaxNumGrains = MAX_NUM_GRAINS;
+
+#ifdef USE_GRAIN_THREADS
+// Below this number of grains per worker, the synchronization costs more than
+// it saves.
+const int32_t kMinNumGrainsPerWorker = 16;
+#endif  // USE_GRAIN_THREADS
 
 using namespace stmlib;
 
@@ -55,16 +77,26 @@ class GranularSamplePlayer {
   GranularSamplePlayer() { }
   ~GranularSamplePlayer() { }
   
-  void Init(int32_t num_channels, int32_t max_num_grains) {
+  // Grain sizes are given for a 32kHz sample rate, and scaled by time_scale.
+  void Init(int32_t num_channels, int32_t max_num_grains, float time_scale) {
+    STATIC_ASSERT(kMaxNumGrains <= 65536, grain_indices_are_16_bit);
     max_num_grains_ = max_num_grains;
+    time_scale_ = time_scale;
     num_midfi_grains_ = 3 * max_num_grains / 4;
     gain_normalization_ = 1.0f;
     for (int32_t i = 0; i < kMaxNumGrains; ++i) {
       grains_[i].Init();
     }
+    for (int32_t i = 0; i < GRAIN_QUALITY_LAST; ++i) {
+      num_active_grains_[i] = 0;
+    }
+    num_available_grains_ = max_num_grains;
+    for (int32_t i = 0; i < max_num_grains; ++i) {
+      available_grains_[i] = i;
+    }
     num_grains_ = 0.0f;
     num_channels_ = num_channels;
-    grain_size_hint_ = 1024.0f;
+    grain_size_hint_ = 1024.0f * time_scale;
   }
   
   template<Resolution resolution>
@@ -83,9 +115,6 @@ class GranularSamplePlayer {
       grain_rate_phasor_ = -1000.0f;
     }
     
-    // Build a list of available grains.
-    int32_t num_available_grains = FillAvailableGrainsList();
-    
     // Try to schedule new grains.
     bool seed_trigger = parameters.trigger;
     for (size_t t = 0; t < size; ++t) {
@@ -94,11 +123,11 @@ class GranularSamplePlayer {
           && target_num_grains > num_grains_;
       bool seed_deterministic = grain_rate_phasor_ >= space_between_grains;
       bool seed = seed_probabilistic || seed_deterministic || seed_trigger;
-      if (num_available_grains && seed) {
-        --num_available_grains;
-        int32_t index = available_grains_[num_available_grains];
+      if (num_available_grains_ && seed) {
+        --num_available_grains_;
+        int32_t index = available_grains_[num_available_grains_];
         GrainQuality quality;
-        if (num_available_grains < num_midfi_grains_) {
+        if (num_available_grains_ < num_midfi_grains_) {
           quality = GRAIN_QUALITY_MEDIUM;
         } else {
           quality = GRAIN_QUALITY_HIGH;
@@ -112,6 +141,7 @@ class GranularSamplePlayer {
             buffer->size(),
             buffer->head() - size + t,
             quality);
+        active_grains_[quality][num_active_grains_[quality]++] = index;
         grain_rate_phasor_ = 0.0f;
         seed_trigger = false;
       }
@@ -119,32 +149,22 @@ class GranularSamplePlayer {
     
     // Overlap grains.
     std::fill(&out[0], &out[size * 2], 0.0f);
-    float* e = envelope_buffer_;
-    for (int32_t i = 0; i < max_num_grains_; ++i) {
-      Grain* g = &grains_[i];
-      if (g->recommended_quality() == GRAIN_QUALITY_HIGH) {
-        if (num_channels_ == 1) {
-          g->OverlapAdd<1, GRAIN_QUALITY_HIGH>(buffer, out, e, size);
-        } else {
-          g->OverlapAdd<2, GRAIN_QUALITY_HIGH>(buffer, out, e, size);
-        }
-      } else if (g->recommended_quality() == GRAIN_QUALITY_MEDIUM) {
-        if (num_channels_ == 1) {
-          g->OverlapAdd<1, GRAIN_QUALITY_MEDIUM>(buffer, out, e, size);
-        } else {
-          g->OverlapAdd<2, GRAIN_QUALITY_MEDIUM>(buffer, out, e, size);
-        }
-      } else {
-        if (num_channels_ == 1) {
-          g->OverlapAdd<1, GRAIN_QUALITY_LOW>(buffer, out, e, size);
-        } else {
-          g->OverlapAdd<2, GRAIN_QUALITY_LOW>(buffer, out, e, size);
-        }
-      }
+#ifdef USE_GRAIN_THREADS
+    int32_t num_workers = workers_.num_workers();
+    if (num_workers > 1 &&
+        num_active_grains() >= kMinNumGrainsPerWorker * num_workers) {
+      OverlapAddParallel(buffer, out, size);
+    } else
+#endif  // USE_GRAIN_THREADS
+    if (num_channels_ == 1) {
+      OverlapAdd<1>(buffer, out, envelope_buffer_, size);
+    } else {
+      OverlapAdd<2>(buffer, out, envelope_buffer_, size);
     }
     
     // Compute normalization factor.
-    int32_t active_grains = max_num_grains_ - num_available_grains;
+    int32_t active_grains = num_active_grains();
+    CollectFinishedGrains();
     SLOPE(num_grains_, static_cast<float>(active_grains), 0.9f, 0.2f);
 
     float gain_normalization = num_grains_ > 2.0f
@@ -163,18 +183,140 @@ class GranularSamplePlayer {
     }
   }
   
+#ifdef USE_GRAIN_THREADS
+  // Spreads the grains rendering over num_threads threads (including the
+  // audio thread). The output is identical to the single-threaded rendering.
+  void set_num_threads(int32_t num_threads) {
+    workers_.Init(num_threads);
+  }
+#endif  // USE_GRAIN_THREADS
+  
+  // Number of grains started and not finished yet - including those still
+  // waiting for their pre-delay.
+  inline int32_t num_active_grains() const {
+    return max_num_grains_ - num_available_grains_;
+  }
+  
  private:
-  int32_t FillAvailableGrainsList() {
-    int32_t num_available_grains = 0;
-    for (int32_t i = 0; i < max_num_grains_; ++i) {
-      if (!grains_[i].active()) {
-        available_grains_[num_available_grains] = i;
-        ++num_available_grains;
+  template<int32_t num_channels, GrainQuality quality, Resolution resolution>
+  inline void OverlapAdd(
+      const AudioBuffer<resolution>* buffer,
+      float* out,
+      float* e,
+      size_t size) {
+    const uint16_t* index = active_grains_[quality];
+    for (int32_t i = 0; i < num_active_grains_[quality]; ++i) {
+      grains_[index[i]].template OverlapAdd<num_channels, quality>(
+          buffer, out, e, size);
+    }
+  }
+  
+  template<int32_t num_channels, Resolution resolution>
+  inline void OverlapAdd(
+      const AudioBuffer<resolution>* buffer,
+      float* out,
+      float* e,
+      size_t size) {
+    OverlapAdd<num_channels, GRAIN_QUALITY_HIGH>(buffer, out, e, size);
+    OverlapAdd<num_channels, GRAIN_QUALITY_MEDIUM>(buffer, out, e, size);
+    OverlapAdd<num_channels, GRAIN_QUALITY_LOW>(buffer, out, e, size);
+  }
+  
+  // Returns the grains which have reached the end of their envelope to the
+  // stack of available grains. The lists of active grains stay in order.
+  void CollectFinishedGrains() {
+    for (int32_t q = 0; q < GRAIN_QUALITY_LAST; ++q) {
+      uint16_t* index = active_grains_[q];
+      int32_t num_active_grains = 0;
+      for (int32_t i = 0; i < num_active_grains_[q]; ++i) {
+        if (grains_[index[i]].active()) {
+          index[num_active_grains++] = index[i];
+        } else {
+          available_grains_[num_available_grains_++] = index[i];
+        }
       }
+      num_active_grains_[q] = num_active_grains;
     }
-    return num_available_grains;
   }
   
+#ifdef USE_GRAIN_THREADS
+  // Each grain is rendered in its own buffer by one of the workers. The
+  // buffers are then summed in the order of the single-threaded loop: since
+  // x + (0 + y) == x + y, the output is bit-exact whatever the number of
+  // workers (as long as the compiler does not fuse multiply-adds).
+  template<Resolution resolution>
+  void OverlapAddParallel(
+      const AudioBuffer<resolution>* buffer,
+      float* out,
+      size_t size) {
+    job_buffer_ = buffer;
+    job_size_ = size;
+    workers_.Run(&OverlapAddTask<resolution>, this);
+    
+    const GrainQuality order[] = {
+      GRAIN_QUALITY_HIGH, GRAIN_QUALITY_MEDIUM, GRAIN_QUALITY_LOW
+    };
+    for (int32_t q = 0; q < GRAIN_QUALITY_LAST; ++q) {
+      const uint16_t* index = active_grains_[order[q]];
+      for (int32_t i = 0; i < num_active_grains_[order[q]]; ++i) {
+        const float* in = grain_out_[index[i]];
+        for (size_t j = 0; j < size * 2; ++j) {
+          out[j] += in[j];
+        }
+      }
+    }
+  }
+  
+  template<int32_t num_channels, GrainQuality quality, Resolution resolution>
+  void OverlapAddSeparate(
+      const AudioBuffer<resolution>* buffer,
+      float* e,
+      size_t size,
+      int32_t worker,
+      int32_t num_workers) {
+    const uint16_t* index = active_grains_[quality];
+    const int32_t n = num_active_grains_[quality];
+    for (int32_t i = worker; i < n; i += num_workers) {
+      float* out = grain_out_[index[i]];
+      std::fill(&out[0], &out[size * 2], 0.0f);
+      grains_[index[i]].template OverlapAdd<num_channels, quality>(
+          buffer, out, e, size);
+    }
+  }
+  
+  template<int32_t num_channels, Resolution resolution>
+  void OverlapAddSeparate(
+      const AudioBuffer<resolution>* buffer,
+      float* e,
+      size_t size,
+      int32_t worker,
+      int32_t num_workers) {
+    OverlapAddSeparate<num_channels, GRAIN_QUALITY_HIGH>(
+        buffer, e, size, worker, num_workers);
+    OverlapAddSeparate<num_channels, GRAIN_QUALITY_MEDIUM>(
+        buffer, e, size, worker, num_workers);
+    OverlapAddSeparate<num_channels, GRAIN_QUALITY_LOW>(
+        buffer, e, size, worker, num_workers);
+  }
+  
+  template<Resolution resolution>
+  static void OverlapAddTask(
+      void* context,
+      int32_t worker,
+      int32_t num_workers) {
+    GranularSamplePlayer* p = static_cast<GranularSamplePlayer*>(context);
+    const AudioBuffer<resolution>* buffer = \
+        static_cast<const AudioBuffer<resolution>*>(p->job_buffer_);
+    const size_t size = p->job_size_;
+    float* e = p->worker_envelope_buffer_[worker];
+    if (p->num_channels_ == 1) {
+      p->OverlapAddSeparate<1>(buffer, e, size, worker, num_workers);
+    } else {
+      p->OverlapAddSeparate<2>(buffer, e, size, worker, num_workers);
+    }
+  }
+#endif  // USE_GRAIN_THREADS
+
   void ScheduleGrain(
       Grain* grain,
       const Parameters& parameters,
@@ -186,6 +328,7 @@ class GranularSamplePlayer {
     float pitch = parameters.pitch;
     float window_shape = parameters.granular.window_shape;
     float grain_size = Interpolate(lut_grain_size, parameters.size, 256.0f);
+    grain_size *= time_scale_;
     float pitch_ratio = SemitonesToRatio(pitch);
     float inv_pitch_ratio = SemitonesToRatio(-pitch);
     float pan = 0.5f + parameters.stereo_spread * (Random::GetFloat() - 0.5f);
@@ -236,6 +379,7 @@ class GranularSamplePlayer {
   }
   
   int32_t max_num_grains_;
+  float time_scale_;
   int32_t num_midfi_grains_;
   int32_t num_channels_;
 
@@ -245,9 +389,20 @@ class GranularSamplePlayer {
   float grain_rate_phasor_;
   
   Grain grains_[kMaxNumGrains];
-  int32_t available_grains_[kMaxNumGrains];
+  uint16_t active_grains_[GRAIN_QUALITY_LAST][kMaxNumGrains];
+  int32_t num_active_grains_[GRAIN_QUALITY_LAST];
+  uint16_t available_grains_[kMaxNumGrains];
+  int32_t num_available_grains_;
   float envelope_buffer_[kMaxBlockSize];
   
+#ifdef USE_GRAIN_THREADS
+  host::WorkerPool workers_;
+  const void* job_buffer_;
+  size_t job_size_;
+  float grain_out_[kMaxNumGrains][kMaxBlockSize * 2];
+  float worker_envelope_buffer_[host::kMaxNumWorkers][kMaxBlockSize];
+#endif  // USE_GRAIN_THREADS
+  
   DISALLOW_COPY_AND_ASSIGN(GranularSamplePlayer);
 };
 
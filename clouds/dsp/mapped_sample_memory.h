@@ -0,0 +1,101 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Sample memory backed by a memory-mapped file, for recording buffers much
+// longer than the module's SRAM. The file is extended (sparsely) to the
+// requested size, and pages are only read from or written to disk when
+// touched by the write head or by a grain. Host only.
+
+#ifndef CLOUDS_DSP_MAPPED_SAMPLE_MEMORY_H_
+#define CLOUDS_DSP_MAPPED_SAMPLE_MEMORY_H_
+
+#include "stmlib/stmlib.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace clouds {
+
+class MappedSampleMemory {
+ public:
+  MappedSampleMemory() : data_(NULL), size_(0) { }
+  ~MappedSampleMemory() { Unmap(); }
+  
+  // Maps the first size bytes of the file, creating it if needed. The content
+  // of an existing file is kept.
+  bool Map(const char* file_name, size_t size) {
+    Unmap();
+    
+    int fd = open(file_name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (static_cast<size_t>(st.st_size) < size &&
+         ftruncate(fd, size) != 0)) {
+      close(fd);
+      return false;
+    }
+    
+    void* mapping = mmap(
+        NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      return false;
+    }
+    // Grains read from anywhere in the buffer: read-ahead would be wasted.
+    madvise(mapping, size, MADV_RANDOM);
+    
+    data_ = mapping;
+    size_ = size;
+    return true;
+  }
+  
+  void Unmap() {
+    if (data_) {
+      munmap(data_, size_);
+      data_ = NULL;
+      size_ = 0;
+    }
+  }
+  
+  inline bool mapped() const { return data_ != NULL; }
+  inline void* data() const { return data_; }
+  inline size_t size() const { return size_; }
+  
+ private:
+  void* data_;
+  size_t size_;
+  
+  DISALLOW_COPY_AND_ASSIGN(MappedSampleMemory);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_MAPPED_SAMPLE_MEMORY_H_
@@ -78,11 +78,7 @@ void FrameTransformation::Process(
   float pitch_ratio = SemitonesToRatio(parameters.pitch);
   
   if (!freeze) {
-    RectangularToPolar(fft_out);
-    StoreMagnitudes(
-        fft_out,
-        parameters.position,
-        parameters.spectral.refresh_rate);
+    Analyze(fft_out, parameters.position, parameters.spectral.refresh_rate);
   }
   float* temp = &fft_out[0];
   ReplayMagnitudes(ifft_in, parameters.position);
@@ -91,9 +87,11 @@ void FrameTransformation::Process(
   if (glitch) {
     AddGlitch(ifft_in);
   }
-  QuantizeMagnitudes(ifft_in, parameters.spectral.quantization);
-  SetPhases(ifft_in, parameters.spectral.phase_randomization, pitch_ratio);
-  PolarToRectangular(ifft_in);
+  Synthesize(
+      ifft_in,
+      parameters.spectral.quantization,
+      parameters.spectral.phase_randomization,
+      pitch_ratio);
 
   if (!glitch) {
     // Decide on which glitch algorithm will be used next time... if glitch
@@ -105,45 +103,157 @@ void FrameTransformation::Process(
   ifft_in[fft_size_ >> 1] = 0.0f;
 }
 
-void FrameTransformation::RectangularToPolar(float* fft_data) {
-  float* real = &fft_data[0];
-  float* imag = &fft_data[fft_size_ >> 1];
-  float* magnitude = &fft_data[0];
-  for (int32_t i = 1; i < size_; ++i) {
-    uint16_t angle = fast_atan2r(imag[i], real[i], &magnitude[i]);
-    phases_delta_[i] = angle - phases_[i];
-    phases_[i] = angle;
+void FrameTransformation::Analyze(
+    const float* fft_data,
+    float position,
+    float feedback) {
+  const float* real = &fft_data[0];
+  const float* imag = &fft_data[fft_size_ >> 1];
+  
+  // Write into magnitude buffers.
+  float index_float = position * float(num_textures_ - 1);
+  int32_t index_int = static_cast<int32_t>(index_float);
+  float index_fractional = index_float - index_int;
+  float gain_a = 1.0f - index_fractional;
+  float gain_b = index_fractional;
+  
+  float* a = textures_[index_int];
+  float* b = textures_[index_int + (position == 1.0f ? 0 : 1)];
+  
+  bool random_refresh = feedback < 0.5f;
+  bool overdub = false;
+  float gain_new_a = 0.0f;
+  float gain_new_b = 0.0f;
+  float gain_old_a = 0.0f;
+  float gain_old_b = 0.0f;
+  uint16_t threshold = 0;
+  if (!random_refresh) {
+    feedback = 2.0f * (feedback - 0.5f);
+    if (feedback < 0.5f) {
+      gain_a *= 1.0f - feedback;
+      gain_b *= 1.0f - feedback;
+    } else {
+      overdub = true;
+      float t = (feedback - 0.5f) * 0.7f + 0.5f;
+      float gain_new = t - 0.5f;
+      gain_new = gain_new * gain_new * 2.0f + 0.5f;
+      gain_new_a = gain_a * gain_new;
+      gain_new_b = gain_b * gain_new;
+      gain_old_a = 1.0f - gain_a * (1.0f - t);
+      gain_old_b = 1.0f - gain_b * (1.0f - t);
+    }
+  } else {
+    feedback *= 2.0f;
+    feedback *= feedback;
+    threshold = feedback * 65535.0f;
+  }
+  
+  float magnitude[kPolarBlockSize];
+  uint16_t angle[kPolarBlockSize];
+  for (int32_t i = 0; i < size_; i += kPolarBlockSize) {
+#ifdef USE_SIMD_FRAME_TRANSFORMATION
+    RectangularToPolarSSE(
+        &real[i], &imag[i], magnitude, angle, kPolarBlockSize);
+#else
+    RectangularToPolar(&real[i], &imag[i], magnitude, angle, kPolarBlockSize);
+#endif  // USE_SIMD_FRAME_TRANSFORMATION
+    
+    // The phase of the DC bin is not tracked (its magnitude is 0).
+    for (int32_t j = i == 0 ? 1 : 0; j < kPolarBlockSize; ++j) {
+      phases_delta_[i + j] = angle[j] - phases_[i + j];
+      phases_[i + j] = angle[j];
+    }
+    
+    float* block_a = &a[i];
+    float* block_b = &b[i];
+    if (random_refresh) {
+      for (int32_t j = 0; j < kPolarBlockSize; ++j) {
+        float x = magnitude[j];
+        float gain = static_cast<uint16_t>(Random::GetSample()) <= threshold
+            ? 1.0f : 0.0f;
+        block_a[j] = Crossfade(block_a[j], x, gain_a * gain);
+        block_b[j] = Crossfade(block_b[j], x, gain_b * gain);
+      }
+    } else if (overdub) {
+      for (int32_t j = 0; j < kPolarBlockSize; ++j) {
+        float x = magnitude[j];
+        block_a[j] = block_a[j] * gain_old_a + x * gain_new_a;
+        block_b[j] = block_b[j] * gain_old_b + x * gain_new_b;
+      }
+    } else {
+      for (int32_t j = 0; j < kPolarBlockSize; ++j) {
+        float x = magnitude[j];
+        block_a[j] = Crossfade(block_a[j], x, gain_a);
+        block_b[j] = Crossfade(block_b[j], x, gain_b);
+      }
+    }
   }
 }
 
-void FrameTransformation::SetPhases(
-    float* destination,
+void FrameTransformation::Synthesize(
+    float* xf_polar,
+    float quantization,
     float phase_randomization,
     float pitch_ratio) {
-  uint32_t* synthesis_phase = (uint32_t*) &destination[fft_size_ >> 1];
-  for (int32_t i = 0; i < size_; ++i) {
-    synthesis_phase[i] = phases_[i];
-    phases_[i] += static_cast<uint16_t>(
-        static_cast<float>(phases_delta_[i]) * pitch_ratio);
+  float* real = &xf_polar[0];
+  float* imag = &xf_polar[fft_size_ >> 1];
+  
+  // Magnitude quantization: either rounding to a coarse grid, or a waveshaper
+  // applied to the normalized spectrum.
+  bool rounding = quantization <= 0.48f;
+  bool shaping = quantization >= 0.52f;
+  float scale_down = 0.0f;
+  float scale_up = 0.0f;
+  float norm = 0.0f;
+  float inv_norm = 0.0f;
+  if (rounding) {
+    quantization = quantization * 2.0f;
+    scale_down = 0.5f * SemitonesToRatio(
+        -108.0f * (1.0f - quantization * quantization)) / float(fft_size_);
+    scale_up = 1.0f / scale_down;
+  } else if (shaping) {
+    quantization = (quantization - 0.52f) * 2.0f;
+    norm = *std::max_element(&xf_polar[0], &xf_polar[size_]);
+    inv_norm = 1.0f / (norm + 0.0001f);
   }
+  
   float r = phase_randomization;
   r = (r - 0.05f) * 1.06f;
   CONSTRAIN(r, 0.0f, 1.0f);
   r *= r;
   int32_t amount = static_cast<int32_t>(r * 32768.0f);
-  for (int32_t i = 0; i < size_; ++i) {
-    synthesis_phase[i] += \
-        static_cast<int32_t>(stmlib::Random::GetSample()) * amount >> 14;
-  }
-}
-
-void FrameTransformation::PolarToRectangular(float* fft_data) {
-  float* real = &fft_data[0];
-  float* imag = &fft_data[fft_size_ >> 1];
-  float* magnitude = &fft_data[0];
-  uint32_t* angle = (uint32_t*) &fft_data[fft_size_ >> 1];
-  for (int32_t i = 1; i < size_; ++i) {
-    fast_p2r(magnitude[i], angle[i], &real[i], &imag[i]);
+  
+  uint16_t angle[kPolarBlockSize];
+  for (int32_t i = 0; i < size_; i += kPolarBlockSize) {
+    float* magnitude = &xf_polar[i];
+    if (rounding) {
+      for (int32_t j = 0; j < kPolarBlockSize; ++j) {
+        magnitude[j] = scale_up * static_cast<float>(
+            static_cast<int32_t>(scale_down * magnitude[j]));
+      }
+    } else if (shaping) {
+      for (int32_t j = i == 0 ? 1 : 0; j < kPolarBlockSize; ++j) {
+        float x = magnitude[j] * inv_norm;
+        float warped = 4.0f * x * (1.0f - x) * (1.0f - x) * (1.0f - x);
+        magnitude[j] = (x + (warped - x) * quantization) * norm;
+      }
+    }
+    
+    for (int32_t j = 0; j < kPolarBlockSize; ++j) {
+      uint32_t synthesis_phase = phases_[i + j];
+      phases_[i + j] += static_cast<uint16_t>(
+          static_cast<float>(phases_delta_[i + j]) * pitch_ratio);
+      synthesis_phase += \
+          static_cast<int32_t>(stmlib::Random::GetSample()) * amount >> 14;
+      angle[j] = synthesis_phase;
+    }
+    
+#ifdef USE_SIMD_FRAME_TRANSFORMATION
+    PolarToRectangularSSE(
+        magnitude, angle, &real[i], &imag[i], kPolarBlockSize);
+#else
+    PolarToRectangular(magnitude, angle, &real[i], &imag[i], kPolarBlockSize);
+#endif  // USE_SIMD_FRAME_TRANSFORMATION
   }
   for (int32_t i = size_; i < fft_size_ >> 1; ++i) {
     real[i] = imag[i] = 0.0f;
@@ -206,28 +316,6 @@ void FrameTransformation::AddGlitch(float* xf_polar) {
   }
 }
 
-void FrameTransformation::QuantizeMagnitudes(float* xf_polar, float amount) {
-  if (amount <= 0.48f) {
-    amount = amount * 2.0f;
-    float scale_down = 0.5f * SemitonesToRatio(
-        -108.0f * (1.0f - amount * amount)) / float(fft_size_);
-    float scale_up = 1.0f / scale_down;
-    for (int32_t i = 0.0f; i < size_; ++i) {
-      xf_polar[i] = scale_up * static_cast<float>(
-          static_cast<int32_t>(scale_down * xf_polar[i]));
-    }
-  } else if (amount >= 0.52f) {
-    amount = (amount - 0.52f) * 2.0f;
-    float norm = *std::max_element(&xf_polar[0], &xf_polar[size_]);
-    float inv_norm = 1.0f / (norm + 0.0001f);
-    for (int32_t i = 1.0f; i < size_; ++i) {
-      float x = xf_polar[i] * inv_norm;
-      float warped = 4.0f * x * (1.0f - x) * (1.0f - x) * (1.0f - x);
-      xf_polar[i] = (x + (warped - x) * amount) * norm;
-    }
-  }
-}
-
 const float kWarpPolynomials[6][4] = {
   { 10.5882f, -14.8824f, 5.29412f, 0.0f },
   { -7.3333f, +9.0, -1.79167f, 0.125f },
@@ -295,58 +383,6 @@ void FrameTransformation::ShiftMagnitudes(
   copy(&temp[0], &temp[size_], &destination[0]);
 }
 
-void FrameTransformation::StoreMagnitudes(
-    float* xf_polar,
-    float position,
-    float feedback) {
-  // Write into magnitude buffers.
-  float index_float = position * float(num_textures_ - 1);
-  int32_t index_int = static_cast<int32_t>(index_float);
-  float index_fractional = index_float - index_int;
-  float gain_a = 1.0f - index_fractional;
-  float gain_b = index_fractional;
-  
-  float* a = textures_[index_int];
-  float* b = textures_[index_int + (position == 1.0f ? 0 : 1)];
-  
-  if (feedback >= 0.5f) {
-    feedback = 2.0f * (feedback - 0.5f);
-    if (feedback < 0.5f) {
-      gain_a *= 1.0f - feedback;
-      gain_b *= 1.0f - feedback;
-      for (int32_t i = 0; i < size_; ++i) {
-        float x = *xf_polar++;
-        a[i] = Crossfade(a[i], x, gain_a);
-        b[i] = Crossfade(b[i], x, gain_b);
-      }
-    } else {
-      float t = (feedback - 0.5f) * 0.7f + 0.5f;
-      float gain_new = t - 0.5f;
-      gain_new = gain_new * gain_new * 2.0f + 0.5f;
-      float gain_new_a = gain_a * gain_new;
-      float gain_new_b = gain_b * gain_new;
-      float gain_old_a = 1.0f - gain_a * (1.0f - t);
-      float gain_old_b = 1.0f - gain_b * (1.0f - t);
-      for (int32_t i = 0; i < size_; ++i) {
-        float x = *xf_polar++;
-        a[i] = a[i] * gain_old_a + x * gain_new_a;
-        b[i] = b[i] * gain_old_b + x * gain_new_b;
-      }
-    }
-  } else {
-    feedback *= 2.0f;
-    feedback *= feedback;
-    uint16_t threshold = feedback * 65535.0f;
-    for (int32_t i = 0; i < size_; ++i) {
-      float x = *xf_polar++;
-      float gain = static_cast<uint16_t>(Random::GetSample()) <= threshold
-          ? 1.0f : 0.0f;
-      a[i] = Crossfade(a[i], x, gain_a * gain);
-      b[i] = Crossfade(b[i], x, gain_b * gain);
-    }
-  }
-}
-
 void FrameTransformation::ReplayMagnitudes(float* xf_polar, float position) {
   float index_float = position * float(num_textures_ - 1);
   int32_t index_int = static_cast<int32_t>(index_float);
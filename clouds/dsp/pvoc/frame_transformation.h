@@ -31,15 +31,22 @@
 
 #include "stmlib/stmlib.h"
 
+#include "clouds/dsp/pvoc/polar_conversion.h"
 #include "clouds/dsp/pvoc/stft.h"
 
 #include "clouds/resources.h"
 
+// #define USE_SIMD_FRAME_TRANSFORMATION
+
 namespace clouds {
 
 const int32_t kMaxNumTextures = 7;
 const int32_t kHighFrequencyTruncation = 16;
 
+// The analysis and synthesis stages run on blocks of bins small enough to
+// stay in L1 cache, instead of making one pass over the frame per stage.
+const int32_t kPolarBlockSize = 16;
+
 struct Parameters;
 
 class FrameTransformation {
@@ -56,8 +63,15 @@ class FrameTransformation {
       float* ifft_in);
   
  private:
-  void RectangularToPolar(float* fft_data);
-  void PolarToRectangular(float* fft_data);
+  // Converts to polar coordinates, tracks phases and stores the magnitudes.
+  void Analyze(const float* fft_data, float position, float feedback);
+  // Quantizes the magnitudes, advances and randomizes the phases, and converts
+  // back to rectangular coordinates.
+  void Synthesize(
+      float* xf_polar,
+      float quantization,
+      float phase_randomization,
+      float pitch_ratio);
   void AddGlitch(float* xf_polar);
   void ShiftMagnitudes(
       float* source,
@@ -67,18 +81,9 @@ class FrameTransformation {
       float* source,
       float* xf_polar,
       float amount);
-  void QuantizeMagnitudes(float* xf_polar, float amount);
-  void StoreMagnitudes(float* xf_polar, float position, float feedback);
-  void SetPhases(float* destination, float diffusion, float pitch_ratio);
   void ReplayMagnitudes(float* xf_polar, float position);
   void DiffuseMagnitudes(float* xf_polar, float diffusion);
   
-  inline void fast_p2r(float magnitude, uint16_t angle, float* re, float* im) {
-    angle >>= 6;
-    *re = magnitude * lut_sin[angle + 256];
-    *im = magnitude * lut_sin[angle];
-  }
-  
   int32_t fft_size_;
   int32_t num_textures_;
   int32_t size_;
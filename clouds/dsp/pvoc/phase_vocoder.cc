@@ -47,7 +47,12 @@ void PhaseVocoder::Init(
     float sample_rate) {
   num_channels_ = num_channels;
 
+  // With float analysis/synthesis buffers, the largest FFT does not fit in
+  // the module's buffers.
   size_t fft_size = largest_fft_size;
+  while (fft_size > kMinFFTSize && !BuffersFit(buffer_size, fft_size)) {
+    fft_size >>= 1;
+  }
   size_t hop_ratio = 4;
   
   BufferAllocator allocator_0(buffer[0], buffer_size[0]);
@@ -59,8 +64,9 @@ void PhaseVocoder::Init(
   size_t num_textures = kMaxNumTextures;
   size_t texture_size = (fft_size >> 1) - kHighFrequencyTruncation;
   for (int32_t i = 0; i < num_channels_; ++i) {
-    short* ana_syn_buffer = allocator[i]->Allocate<short>(
-        (fft_size + (fft_size >> 1)) * 2);
+    STFT<kSTFTBufferFormat>::Sample* ana_syn_buffer = \
+        allocator[i]->Allocate<STFT<kSTFTBufferFormat>::Sample>(
+            (fft_size + (fft_size >> 1)) * 2);
     
     num_textures = min(
         allocator[i]->free() / (sizeof(float) * texture_size),
@@ -82,6 +88,26 @@ void PhaseVocoder::Init(
   }
 }
 
+bool PhaseVocoder::BuffersFit(
+    const size_t* buffer_size,
+    size_t fft_size) const {
+  size_t fft_buffer_size = fft_size * sizeof(float);
+  size_t ana_syn_buffer_size = (fft_size + (fft_size >> 1)) * 2 * \
+      sizeof(STFT<kSTFTBufferFormat>::Sample);
+  size_t texture_size = ((fft_size >> 1) - kHighFrequencyTruncation) * \
+      sizeof(float);
+  for (int32_t i = 0; i < num_channels_; ++i) {
+    // The FFT buffer is in the first buffer, the IFFT buffer in the last one.
+    size_t size = ana_syn_buffer_size + kMinNumTextures * texture_size;
+    size += i == 0 ? fft_buffer_size : 0;
+    size += i == num_channels_ - 1 ? fft_buffer_size : 0;
+    if (size > buffer_size[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void PhaseVocoder::Process(
     const Parameters& parameters,
     const FloatFrame* input,
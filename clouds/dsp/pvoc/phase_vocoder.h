@@ -39,6 +39,13 @@
 
 namespace clouds {
 
+// The FFT size is halved (down to this size) until the buffers of the phase
+// vocoder fit in the memory they are given.
+const size_t kMinFFTSize = 1024;
+
+// One texture, plus the one used for storing phases.
+const size_t kMinNumTextures = 2;
+
 struct Parameters;
 
 class PhaseVocoder {
@@ -61,9 +68,11 @@ class PhaseVocoder {
   void Buffer();
   
  private:
+  bool BuffersFit(const size_t* buffer_size, size_t fft_size) const;
+  
   FFT fft_;
   
-  STFT stft_[2];
+  STFT<kSTFTBufferFormat> stft_[2];
   FrameTransformation frame_transformation_[2];
 
   int32_t num_channels_;
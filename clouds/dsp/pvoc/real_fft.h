@@ -0,0 +1,407 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Real FFT for host builds, with the same interface and data layout as
+// stmlib::ShyFFT. The N-point real FFT is computed with an N/2-point complex
+// FFT (Stockham radix-4 stages, plus one radix-2 stage when needed) on split
+// real/imaginary arrays, vectorized with SSE when available.
+//
+// Layout of the spectrum: out[0 .. N/2 - 1] are the real parts of bins
+// 0 .. N/2 - 1, out[N/2] is the (real) Nyquist bin, out[N/2 + k] is the
+// imaginary part of bin k. The inverse transform is not normalized (it
+// returns N times the original signal).
+
+#ifndef CLOUDS_DSP_PVOC_REAL_FFT_H_
+#define CLOUDS_DSP_PVOC_REAL_FFT_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif  // __SSE__
+
+namespace clouds {
+
+template<size_t size>
+class RealFFT {
+ public:
+  RealFFT() { }
+  ~RealFFT() { }
+  
+  enum {
+    max_size = size
+  };
+  
+  void Init() {
+    // W_M^k for the complex FFT, W_N^k for the split of the real FFT.
+    for (size_t k = 0; k < kHalfSize; ++k) {
+      double t = 2.0 * M_PI * static_cast<double>(k);
+      w_m_r_[k] = cos(t / kHalfSize);
+      w_m_i_[k] = -sin(t / kHalfSize);
+      w_n_r_[k] = cos(t / size);
+      w_n_i_[k] = -sin(t / size);
+    }
+  }
+  
+  inline void Direct(const float* input, float* output) {
+    Direct(input, output, num_passes());
+  }
+  
+  inline void Inverse(const float* input, float* output) {
+    Inverse(input, output, num_passes());
+  }
+  
+  void Direct(const float* input, float* output, size_t num_passes) {
+    const size_t n = static_cast<size_t>(1) << num_passes;
+    const size_t m = n >> 1;
+    const size_t w_stride = size / n;
+    
+    for (size_t i = 0; i < m; ++i) {
+      x_r_[i] = input[2 * i];
+      x_i_[i] = input[2 * i + 1];
+    }
+    const float* z_r;
+    const float* z_i;
+    Transform(m, w_stride, &z_r, &z_i);
+    
+    // Separates the transforms of the even and odd samples, and combines them.
+    output[0] = z_r[0] + z_i[0];
+    output[m] = z_r[0] - z_i[0];
+    for (size_t k = 1; k < m; ++k) {
+      float c_r = z_r[m - k];
+      float c_i = -z_i[m - k];
+      float e_r = 0.5f * (z_r[k] + c_r);
+      float e_i = 0.5f * (z_i[k] + c_i);
+      float o_r = 0.5f * (z_i[k] - c_i);
+      float o_i = -0.5f * (z_r[k] - c_r);
+      float w_r = w_n_r_[k * w_stride];
+      float w_i = w_n_i_[k * w_stride];
+      output[k] = e_r + w_r * o_r - w_i * o_i;
+      output[m + k] = e_i + w_r * o_i + w_i * o_r;
+    }
+  }
+  
+  void Inverse(const float* input, float* output, size_t num_passes) {
+    const size_t n = static_cast<size_t>(1) << num_passes;
+    const size_t m = n >> 1;
+    const size_t w_stride = size / n;
+    
+    // Rebuilds the transforms of the even and odd samples. The result is
+    // conjugated, so that the direct transform computes the inverse one.
+    for (size_t k = 0; k < m; ++k) {
+      float x_r = input[k];
+      float x_i = k ? input[m + k] : 0.0f;
+      float c_r = input[m - k];
+      float c_i = k ? -input[n - k] : 0.0f;
+      float a_r = x_r + c_r;
+      float a_i = x_i + c_i;
+      float d_r = x_r - c_r;
+      float d_i = x_i - c_i;
+      float w_r = w_n_r_[k * w_stride];
+      float w_i = -w_n_i_[k * w_stride];
+      float b_r = d_r * w_r - d_i * w_i;
+      float b_i = d_r * w_i + d_i * w_r;
+      x_r_[k] = a_r - b_i;
+      x_i_[k] = -(a_i + b_r);
+    }
+    const float* z_r;
+    const float* z_i;
+    Transform(m, w_stride, &z_r, &z_i);
+    for (size_t i = 0; i < m; ++i) {
+      output[2 * i] = z_r[i];
+      output[2 * i + 1] = -z_i[i];
+    }
+  }
+  
+ private:
+  enum {
+    kHalfSize = size / 2
+  };
+  
+  static inline size_t num_passes() {
+    size_t num_passes = 0;
+    for (size_t n = size; n > 1; n >>= 1) {
+      ++num_passes;
+    }
+    return num_passes;
+  }
+  
+  // Complex FFT of size n on x_r_/x_i_. The twiddle factor W_n^p is
+  // w_m_[p * w_stride].
+  void Transform(
+      size_t n,
+      size_t w_stride,
+      const float** out_r,
+      const float** out_i) {
+    float* x_r = x_r_;
+    float* x_i = x_i_;
+    float* y_r = y_r_;
+    float* y_i = y_i_;
+    size_t stride = 1;
+    while (n >= 4) {
+      Radix4(n, stride, w_stride, x_r, x_i, y_r, y_i);
+      std::swap(x_r, y_r);
+      std::swap(x_i, y_i);
+      n >>= 2;
+      stride <<= 2;
+      w_stride <<= 2;
+    }
+    if (n == 2) {
+      Radix2(stride, x_r, x_i, y_r, y_i);
+      std::swap(x_r, y_r);
+      std::swap(x_i, y_i);
+    }
+    *out_r = x_r;
+    *out_i = x_i;
+  }
+  
+  // One Stockham stage: n-point sub-transforms interleaved with the given
+  // stride, reduced to 4 interleaved n/4-point ones.
+  void Radix4(
+      size_t n,
+      size_t s,
+      size_t w_stride,
+      const float* x_r,
+      const float* x_i,
+      float* y_r,
+      float* y_i) {
+    const size_t n1 = n >> 2;
+    size_t p = 0;
+#ifdef __SSE__
+    if (s == 1 && n1 >= 4) {
+      // First stage: the butterflies are vectorized across p.
+      for (; p < n1; p += 4) {
+        __m128 w1_r, w1_i, w2_r, w2_i, w3_r, w3_i;
+        LoadTwiddles(p * w_stride, w_stride, &w1_r, &w1_i);
+        LoadTwiddles(2 * p * w_stride, 2 * w_stride, &w2_r, &w2_i);
+        LoadTwiddles(3 * p * w_stride, 3 * w_stride, &w3_r, &w3_i);
+        __m128 r[4], i[4];
+        Butterfly(
+            _mm_loadu_ps(&x_r[p]), _mm_loadu_ps(&x_i[p]),
+            _mm_loadu_ps(&x_r[p + n1]), _mm_loadu_ps(&x_i[p + n1]),
+            _mm_loadu_ps(&x_r[p + 2 * n1]), _mm_loadu_ps(&x_i[p + 2 * n1]),
+            _mm_loadu_ps(&x_r[p + 3 * n1]), _mm_loadu_ps(&x_i[p + 3 * n1]),
+            w1_r, w1_i, w2_r, w2_i, w3_r, w3_i, r, i);
+        _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+        _MM_TRANSPOSE4_PS(i[0], i[1], i[2], i[3]);
+        for (size_t k = 0; k < 4; ++k) {
+          _mm_storeu_ps(&y_r[4 * (p + k)], r[k]);
+          _mm_storeu_ps(&y_i[4 * (p + k)], i[k]);
+        }
+      }
+      return;
+    }
+    if (s >= 4) {
+      // Other stages: the butterflies are vectorized across q.
+      for (; p < n1; ++p) {
+        const __m128 w1_r = _mm_set1_ps(w_m_r_[p * w_stride]);
+        const __m128 w1_i = _mm_set1_ps(w_m_i_[p * w_stride]);
+        const __m128 w2_r = _mm_set1_ps(w_m_r_[2 * p * w_stride]);
+        const __m128 w2_i = _mm_set1_ps(w_m_i_[2 * p * w_stride]);
+        const __m128 w3_r = _mm_set1_ps(w_m_r_[3 * p * w_stride]);
+        const __m128 w3_i = _mm_set1_ps(w_m_i_[3 * p * w_stride]);
+        const float* a_r = &x_r[s * p];
+        const float* a_i = &x_i[s * p];
+        float* b_r = &y_r[s * 4 * p];
+        float* b_i = &y_i[s * 4 * p];
+        for (size_t q = 0; q < s; q += 4) {
+          __m128 r[4], i[4];
+          Butterfly(
+              _mm_loadu_ps(&a_r[q]), _mm_loadu_ps(&a_i[q]),
+              _mm_loadu_ps(&a_r[q + s * n1]), _mm_loadu_ps(&a_i[q + s * n1]),
+              _mm_loadu_ps(&a_r[q + 2 * s * n1]),
+              _mm_loadu_ps(&a_i[q + 2 * s * n1]),
+              _mm_loadu_ps(&a_r[q + 3 * s * n1]),
+              _mm_loadu_ps(&a_i[q + 3 * s * n1]),
+              w1_r, w1_i, w2_r, w2_i, w3_r, w3_i, r, i);
+          for (size_t k = 0; k < 4; ++k) {
+            _mm_storeu_ps(&b_r[q + s * k], r[k]);
+            _mm_storeu_ps(&b_i[q + s * k], i[k]);
+          }
+        }
+      }
+      return;
+    }
+#endif  // __SSE__
+    for (; p < n1; ++p) {
+      const float w1_r = w_m_r_[p * w_stride];
+      const float w1_i = w_m_i_[p * w_stride];
+      const float w2_r = w_m_r_[2 * p * w_stride];
+      const float w2_i = w_m_i_[2 * p * w_stride];
+      const float w3_r = w_m_r_[3 * p * w_stride];
+      const float w3_i = w_m_i_[3 * p * w_stride];
+      for (size_t q = 0; q < s; ++q) {
+        size_t source = q + s * p;
+        float a_r = x_r[source];
+        float a_i = x_i[source];
+        float b_r = x_r[source + s * n1];
+        float b_i = x_i[source + s * n1];
+        float c_r = x_r[source + 2 * s * n1];
+        float c_i = x_i[source + 2 * s * n1];
+        float d_r = x_r[source + 3 * s * n1];
+        float d_i = x_i[source + 3 * s * n1];
+        
+        float apc_r = a_r + c_r;
+        float apc_i = a_i + c_i;
+        float amc_r = a_r - c_r;
+        float amc_i = a_i - c_i;
+        float bpd_r = b_r + d_r;
+        float bpd_i = b_i + d_i;
+        // j * (b - d)
+        float jbmd_r = d_i - b_i;
+        float jbmd_i = b_r - d_r;
+        
+        size_t destination = q + s * 4 * p;
+        y_r[destination] = apc_r + bpd_r;
+        y_i[destination] = apc_i + bpd_i;
+        
+        float t_r = amc_r - jbmd_r;
+        float t_i = amc_i - jbmd_i;
+        y_r[destination + s] = t_r * w1_r - t_i * w1_i;
+        y_i[destination + s] = t_r * w1_i + t_i * w1_r;
+        
+        t_r = apc_r - bpd_r;
+        t_i = apc_i - bpd_i;
+        y_r[destination + 2 * s] = t_r * w2_r - t_i * w2_i;
+        y_i[destination + 2 * s] = t_r * w2_i + t_i * w2_r;
+        
+        t_r = amc_r + jbmd_r;
+        t_i = amc_i + jbmd_i;
+        y_r[destination + 3 * s] = t_r * w3_r - t_i * w3_i;
+        y_i[destination + 3 * s] = t_r * w3_i + t_i * w3_r;
+      }
+    }
+  }
+  
+  // Last stage for odd numbers of passes: 2-point transforms.
+  void Radix2(
+      size_t s,
+      const float* x_r,
+      const float* x_i,
+      float* y_r,
+      float* y_i) {
+    size_t q = 0;
+#ifdef __SSE__
+    for (; q + 4 <= s; q += 4) {
+      __m128 a_r = _mm_loadu_ps(&x_r[q]);
+      __m128 a_i = _mm_loadu_ps(&x_i[q]);
+      __m128 b_r = _mm_loadu_ps(&x_r[q + s]);
+      __m128 b_i = _mm_loadu_ps(&x_i[q + s]);
+      _mm_storeu_ps(&y_r[q], _mm_add_ps(a_r, b_r));
+      _mm_storeu_ps(&y_i[q], _mm_add_ps(a_i, b_i));
+      _mm_storeu_ps(&y_r[q + s], _mm_sub_ps(a_r, b_r));
+      _mm_storeu_ps(&y_i[q + s], _mm_sub_ps(a_i, b_i));
+    }
+#endif  // __SSE__
+    for (; q < s; ++q) {
+      float a_r = x_r[q];
+      float a_i = x_i[q];
+      float b_r = x_r[q + s];
+      float b_i = x_i[q + s];
+      y_r[q] = a_r + b_r;
+      y_i[q] = a_i + b_i;
+      y_r[q + s] = a_r - b_r;
+      y_i[q + s] = a_i - b_i;
+    }
+  }
+  
+#ifdef __SSE__
+  inline void LoadTwiddles(
+      size_t index,
+      size_t stride,
+      __m128* w_r,
+      __m128* w_i) const {
+    *w_r = _mm_setr_ps(
+        w_m_r_[index],
+        w_m_r_[index + stride],
+        w_m_r_[index + 2 * stride],
+        w_m_r_[index + 3 * stride]);
+    *w_i = _mm_setr_ps(
+        w_m_i_[index],
+        w_m_i_[index + stride],
+        w_m_i_[index + 2 * stride],
+        w_m_i_[index + 3 * stride]);
+  }
+  
+  static inline void Multiply(
+      __m128 a_r, __m128 a_i,
+      __m128 b_r, __m128 b_i,
+      __m128* r, __m128* i) {
+    *r = _mm_sub_ps(_mm_mul_ps(a_r, b_r), _mm_mul_ps(a_i, b_i));
+    *i = _mm_add_ps(_mm_mul_ps(a_r, b_i), _mm_mul_ps(a_i, b_r));
+  }
+  
+  static inline void Butterfly(
+      __m128 a_r, __m128 a_i,
+      __m128 b_r, __m128 b_i,
+      __m128 c_r, __m128 c_i,
+      __m128 d_r, __m128 d_i,
+      __m128 w1_r, __m128 w1_i,
+      __m128 w2_r, __m128 w2_i,
+      __m128 w3_r, __m128 w3_i,
+      __m128* r,
+      __m128* i) {
+    __m128 apc_r = _mm_add_ps(a_r, c_r);
+    __m128 apc_i = _mm_add_ps(a_i, c_i);
+    __m128 amc_r = _mm_sub_ps(a_r, c_r);
+    __m128 amc_i = _mm_sub_ps(a_i, c_i);
+    __m128 bpd_r = _mm_add_ps(b_r, d_r);
+    __m128 bpd_i = _mm_add_ps(b_i, d_i);
+    __m128 jbmd_r = _mm_sub_ps(d_i, b_i);
+    __m128 jbmd_i = _mm_sub_ps(b_r, d_r);
+    r[0] = _mm_add_ps(apc_r, bpd_r);
+    i[0] = _mm_add_ps(apc_i, bpd_i);
+    Multiply(
+        _mm_sub_ps(amc_r, jbmd_r), _mm_sub_ps(amc_i, jbmd_i),
+        w1_r, w1_i, &r[1], &i[1]);
+    Multiply(
+        _mm_sub_ps(apc_r, bpd_r), _mm_sub_ps(apc_i, bpd_i),
+        w2_r, w2_i, &r[2], &i[2]);
+    Multiply(
+        _mm_add_ps(amc_r, jbmd_r), _mm_add_ps(amc_i, jbmd_i),
+        w3_r, w3_i, &r[3], &i[3]);
+  }
+#endif  // __SSE__
+  
+  float x_r_[kHalfSize];
+  float x_i_[kHalfSize];
+  float y_r_[kHalfSize];
+  float y_i_[kHalfSize];
+  
+  float w_m_r_[kHalfSize];
+  float w_m_i_[kHalfSize];
+  float w_n_r_[kHalfSize];
+  float w_n_i_[kHalfSize];
+  
+  DISALLOW_COPY_AND_ASSIGN(RealFFT);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_PVOC_REAL_FFT_H_
@@ -38,14 +38,15 @@ namespace clouds {
 using namespace std;
 using namespace stmlib;
 
-void STFT::Init(
+template<STFTBufferFormat format>
+void STFT<format>::Init(
     FFT* fft,
     size_t fft_size,
     size_t hop_size,
     float* fft_buffer,
     float* ifft_buffer,
     const float* window_lut,
-    short* analysis_synthesis_buffer,
+    Sample* analysis_synthesis_buffer,
     Modifier* modifier) {
   fft_size_ = fft_size;
   hop_size_ = hop_size;
@@ -77,7 +78,8 @@ void STFT::Init(
   Reset();
 }
 
-void STFT::Reset() {
+template<STFTBufferFormat format>
+void STFT<format>::Reset() {
   buffer_ptr_ = 0;
   process_ptr_ = (2 * hop_size_) % buffer_size_;
   block_size_ = 0;
@@ -87,7 +89,8 @@ void STFT::Reset() {
   done_ = 0;
 }
 
-void STFT::Process(
+template<STFTBufferFormat format>
+void STFT<format>::Process(
     const Parameters& parameters,
     const float* input,
     float* output,
@@ -97,8 +100,8 @@ void STFT::Process(
   while (size) {
     size_t processed = min(size, hop_size_ - block_size_);
     for (size_t i = 0; i < processed; ++i) {
-      int32_t sample = *input * 32768.0f;
-      analysis_[buffer_ptr_ + i] = Clip16(sample);
+      analysis_[buffer_ptr_ + i] = STFTBuffer<format>::Quantize(
+          *input * 32768.0f);
       *output = static_cast<float>(synthesis_[buffer_ptr_ + i]) / 16384.0f;
       input += stride;
       output += stride;
@@ -117,7 +120,8 @@ void STFT::Process(
   }
 }
 
-void STFT::Buffer() {
+template<STFTBufferFormat format>
+void STFT<format>::Buffer() {
   if (ready_ == done_) {
     return;
   }
@@ -187,12 +191,13 @@ void STFT::Buffer() {
   for (size_t i = 0; i < fft_size_; ++i) {
     float s = ifft_out_[i] * w[0] * inverse_window_size;
     
-    int32_t x = static_cast<int32_t>(s);
     if (i < fft_size_ - hop_size_) {
       // Overlap-add.
-      x += synthesis_[destination_ptr];
+      synthesis_[destination_ptr] = STFTBuffer<format>::Accumulate(
+          synthesis_[destination_ptr], s);
+    } else {
+      synthesis_[destination_ptr] = STFTBuffer<format>::Quantize(s);
     }
-    synthesis_[destination_ptr] = Clip16(x);
     ++destination_ptr;
     if (destination_ptr >= buffer_size_) {
       destination_ptr -= buffer_size_;
@@ -207,4 +212,7 @@ void STFT::Buffer() {
   }
 }
 
+template class STFT<STFT_BUFFER_FORMAT_16_BIT>;
+template class STFT<STFT_BUFFER_FORMAT_FLOAT>;
+
 }  // namespace clouds
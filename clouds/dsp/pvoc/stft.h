@@ -30,11 +30,19 @@
 #define CLOUDS_DSP_PVOC_STFT_H_
 
 #include "stmlib/stmlib.h"
+#include "stmlib/dsp/dsp.h"
 
 // #define USE_ARM_FFT
+// #define USE_SIMD_FFT
+// #define USE_FLOAT_STFT_BUFFERS
 
+// Except for the CMSIS one, the FFT backends have the interface of ShyFFT:
+// Init(), Direct(in, out, num_passes), Inverse(in, out, num_passes), and
+// max_size; and the same data layout and scaling.
 #ifdef USE_ARM_FFT
   #include <arm_math.h>
+#elif defined(USE_SIMD_FFT)
+  #include "clouds/dsp/pvoc/real_fft.h"
 #else
   #include "stmlib/fft/shy_fft.h"
 #endif  // USE_ARM_FFT
@@ -46,14 +54,63 @@ struct Parameters;
 const size_t kMaxFftSize = 4096;
 #ifdef USE_ARM_FFT
   typedef arm_rfft_fast_instance_f32 FFT;
+#elif defined(USE_SIMD_FFT)
+  typedef RealFFT<kMaxFftSize> FFT;
 #else
   typedef stmlib::ShyFFT<float, kMaxFftSize, stmlib::RotationPhasor> FFT;
 #endif  // USE_ARM_FFT
 
 typedef class FrameTransformation Modifier;
 
+enum STFTBufferFormat {
+  STFT_BUFFER_FORMAT_16_BIT,
+  STFT_BUFFER_FORMAT_FLOAT
+};
+
+// Sample type of the analysis/synthesis ring buffers, and how samples are
+// written to them. The 16-bit format halves the memory footprint but costs a
+// conversion per sample and clips the overlap-add; the float format is for
+// host builds, where memory is not a constraint.
+template<STFTBufferFormat format> struct STFTBuffer { };
+
+template<> struct STFTBuffer<STFT_BUFFER_FORMAT_16_BIT> {
+  typedef short Sample;
+  
+  static inline Sample Quantize(float x) {
+    int32_t sample = x;
+    return stmlib::Clip16(sample);
+  }
+  
+  static inline Sample Accumulate(Sample previous, float x) {
+    int32_t sample = static_cast<int32_t>(x);
+    sample += previous;
+    return stmlib::Clip16(sample);
+  }
+};
+
+template<> struct STFTBuffer<STFT_BUFFER_FORMAT_FLOAT> {
+  typedef float Sample;
+  
+  static inline Sample Quantize(float x) {
+    return x;
+  }
+  
+  static inline Sample Accumulate(Sample previous, float x) {
+    return previous + x;
+  }
+};
+
+#ifdef USE_FLOAT_STFT_BUFFERS
+const STFTBufferFormat kSTFTBufferFormat = STFT_BUFFER_FORMAT_FLOAT;
+#else
+const STFTBufferFormat kSTFTBufferFormat = STFT_BUFFER_FORMAT_16_BIT;
+#endif  // USE_FLOAT_STFT_BUFFERS
+
+template<STFTBufferFormat format>
 class STFT {
  public:
+  typedef typename STFTBuffer<format>::Sample Sample;
+  
   STFT() { }
   ~STFT() { }
   
@@ -66,7 +123,7 @@ class STFT {
       float* fft_buffer,
       float* ifft_buffer,
       const float* window_lut,
-      short* stft_frame_processor_buffer,
+      Sample* analysis_synthesis_buffer,
       Modifier* modifier);
 
   void Reset();
@@ -94,8 +151,8 @@ class STFT {
   const float* window_;
   size_t window_stride_;
 
-  short* analysis_;
-  short* synthesis_;
+  Sample* analysis_;
+  Sample* synthesis_;
   
   size_t buffer_ptr_;
   size_t process_ptr_;
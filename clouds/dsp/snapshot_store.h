@@ -0,0 +1,367 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Store of GranularProcessor recordings on disk - the host counterpart of the
+// module's 4 sample memory slots, for any number of snapshots. Host only.
+//
+// A snapshot file holds the blocks of GetPersistentData: a header, the state
+// block, then the audio buffers, back to back from a page boundary. 16-bit
+// buffers can be stored as mu-law, halving the size of the file.
+//
+// Restoring an uncompressed snapshot maps the file in memory (copy-on-write,
+// so that the snapshot is not modified by further recording) and makes it the
+// sample memory of the processor: switching between snapshots only costs the
+// page faults of the parts of the buffer actually played. Compressed snapshots
+// are decoded from the mapped file into anonymous memory. Snapshots recorded
+// in spectral mode are copied with LoadPersistentData.
+//
+// The store owns the sample memory of the processor from the first Restore.
+
+#ifndef CLOUDS_DSP_SNAPSHOT_STORE_H_
+#define CLOUDS_DSP_SNAPSHOT_STORE_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "clouds/dsp/granular_processor.h"
+#include "clouds/dsp/mu_law.h"
+
+namespace clouds {
+
+const uint32_t kSnapshotMagic = stmlib::FourCC<'c', 'l', 's', 'n'>::value;
+const uint32_t kSnapshotVersion = 1;
+const size_t kMaxSnapshotBlocks = 4;
+const size_t kSnapshotPageSize = 4096;
+const size_t kMaxSnapshotPathLength = 1024;
+
+enum SnapshotEncoding {
+  SNAPSHOT_ENCODING_RAW,
+  SNAPSHOT_ENCODING_MU_LAW
+};
+
+struct SnapshotBlock {
+  uint32_t tag;
+  uint32_t size;  // Size in the processor.
+  uint32_t encoding;
+  uint32_t stored_size;  // Size in the file.
+  uint64_t offset;
+};
+
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_blocks;
+  uint32_t reserved;
+  SnapshotBlock block[kMaxSnapshotBlocks];
+};
+
+class SnapshotStore {
+ public:
+  SnapshotStore() : memory_(NULL), memory_size_(0) { }
+  ~SnapshotStore() { Release(); }
+
+  // Snapshots are stored in directory, as name.snapshot files.
+  void Init(const char* directory) {
+    Release();
+    snprintf(directory_, sizeof(directory_), "%s", directory);
+  }
+
+  bool Save(GranularProcessor* processor, const char* name, bool mu_law) {
+    PersistentBlock blocks[kMaxSnapshotBlocks];
+    size_t num_blocks;
+    processor->PreparePersistentData();
+    processor->GetPersistentData(blocks, &num_blocks);
+
+    const PersistentState* state = static_cast<const PersistentState*>(
+        blocks[0].data);
+    // Only the 16-bit recordings of the time-domain modes are compressed: the
+    // low-fidelity buffers already are mu-law, and the spectral ones are FFT
+    // frames.
+    bool compress = mu_law && !(state->quality & 2) && !state->spectral;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kSnapshotMagic;
+    header.version = kSnapshotVersion;
+    header.num_blocks = num_blocks;
+    uint64_t offset = sizeof(header);
+    for (size_t i = 0; i < num_blocks; ++i) {
+      SnapshotBlock* b = &header.block[i];
+      b->tag = blocks[i].tag;
+      b->size = blocks[i].size;
+      b->encoding = i > 0 && compress
+          ? SNAPSHOT_ENCODING_MU_LAW
+          : SNAPSHOT_ENCODING_RAW;
+      b->stored_size = b->encoding == SNAPSHOT_ENCODING_MU_LAW
+          ? b->size / 2
+          : b->size;
+      if (i == 1) {
+        // The buffers start on a page boundary so that they can be mapped.
+        offset = (offset + kSnapshotPageSize - 1) & ~(kSnapshotPageSize - 1);
+      }
+      b->offset = offset;
+      offset += b->stored_size;
+    }
+
+    // Written to a temporary file first: the snapshot being replaced might be
+    // mapped, and must not change under the processor.
+    char path[kMaxSnapshotPathLength];
+    char temp_path[kMaxSnapshotPathLength + 4];
+    if (!Path(name, path)) {
+      return false;
+    }
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE* fp = fopen(temp_path, "wb");
+    if (!fp) {
+      return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (size_t i = 0; i < num_blocks && ok; ++i) {
+      const SnapshotBlock& b = header.block[i];
+      ok = fseek(fp, b.offset, SEEK_SET) == 0;
+      if (b.encoding == SNAPSHOT_ENCODING_MU_LAW) {
+        const int16_t* samples = static_cast<const int16_t*>(blocks[i].data);
+        uint8_t encoded[1024];
+        for (size_t j = 0; j < b.stored_size && ok; j += sizeof(encoded)) {
+          size_t size = std::min(sizeof(encoded), b.stored_size - j);
+          for (size_t k = 0; k < size; ++k) {
+            encoded[k] = Lin2MuLaw(samples[j + k]);
+          }
+          ok = fwrite(encoded, 1, size, fp) == size;
+        }
+      } else {
+        ok = ok && fwrite(blocks[i].data, 1, b.size, fp) == b.size;
+      }
+    }
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(temp_path, path) != 0) {
+      unlink(temp_path);
+      return false;
+    }
+    return true;
+  }
+
+  bool Restore(GranularProcessor* processor, const char* name) {
+    char path[kMaxSnapshotPathLength];
+    if (!Path(name, path)) {
+      return false;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+      close(fd);
+      return false;
+    }
+    size_t file_size = st.st_size;
+    void* mapping = mmap(
+        NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      return false;
+    }
+    uint8_t* file = static_cast<uint8_t*>(mapping);
+
+    SnapshotHeader header;
+    memcpy(&header, file, sizeof(header));
+    if (!Validate(header, file_size)) {
+      munmap(mapping, file_size);
+      return false;
+    }
+    PersistentState state;
+    memcpy(&state, file + header.block[0].offset, sizeof(state));
+    if (!Validate(header, state)) {
+      munmap(mapping, file_size);
+      return false;
+    }
+
+    const SnapshotBlock& first = header.block[1];
+    size_t buffers_size = 0;
+    bool compressed = false;
+    for (size_t i = 1; i < header.num_blocks; ++i) {
+      buffers_size += header.block[i].size;
+      compressed = header.block[i].encoding == SNAPSHOT_ENCODING_MU_LAW;
+    }
+
+    if (state.spectral) {
+      // Copy with LoadPersistentData, which expects each block to be preceded
+      // by its tag and size.
+      processor->set_sample_memory(NULL, 0);
+      size_t stream_size = 0;
+      for (size_t i = 0; i < header.num_blocks; ++i) {
+        stream_size += 8 + ((header.block[i].size + 3) & ~3);
+      }
+      uint32_t* stream = new uint32_t[stream_size / 4];
+      uint32_t* p = stream;
+      for (size_t i = 0; i < header.num_blocks; ++i) {
+        const SnapshotBlock& b = header.block[i];
+        *p++ = b.tag;
+        *p++ = b.size;
+        memcpy(p, file + b.offset, b.size);
+        p += (b.size + 3) / 4;
+      }
+      munmap(mapping, file_size);
+      bool ok = processor->LoadPersistentData(stream);
+      delete[] stream;
+      Release();
+      return ok;
+    }
+
+    void* memory = mapping;
+    size_t memory_size = file_size;
+    uint8_t* buffers = file + first.offset;
+    if (compressed) {
+      memory_size = buffers_size;
+      memory = mmap(
+          NULL, memory_size, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (memory == MAP_FAILED) {
+        munmap(mapping, file_size);
+        return false;
+      }
+      int16_t* samples = static_cast<int16_t*>(memory);
+      for (size_t i = 0; i < buffers_size / 2; ++i) {
+        samples[i] = MuLaw2Lin(buffers[i]);
+      }
+      munmap(mapping, file_size);
+      buffers = static_cast<uint8_t*>(memory);
+    } else {
+      // Grains read from anywhere in the buffer: read-ahead would be wasted.
+      madvise(mapping, file_size, MADV_RANDOM);
+    }
+
+    processor->MapPersistentData(state, buffers, buffers_size);
+
+    // The previous snapshot is no longer used by the processor.
+    Release();
+    memory_ = memory;
+    memory_size_ = memory_size;
+    return true;
+  }
+
+  bool Remove(const char* name) {
+    char path[kMaxSnapshotPathLength];
+    return Path(name, path) && unlink(path) == 0;
+  }
+
+ private:
+  bool Path(const char* name, char* path) const {
+    size_t length = snprintf(
+        path, kMaxSnapshotPathLength, "%s/%s.snapshot", directory_, name);
+    return length < kMaxSnapshotPathLength;
+  }
+
+  // Checks that all blocks are within the file, and that their size in the
+  // file is consistent with their encoding.
+  bool Validate(const SnapshotHeader& header, size_t file_size) const {
+    if (header.magic != kSnapshotMagic ||
+        header.version != kSnapshotVersion ||
+        header.num_blocks < 2 ||
+        header.num_blocks > kMaxSnapshotBlocks ||
+        header.block[0].size != sizeof(PersistentState) ||
+        header.block[0].encoding != SNAPSHOT_ENCODING_RAW) {
+      return false;
+    }
+    for (size_t i = 0; i < header.num_blocks; ++i) {
+      const SnapshotBlock& b = header.block[i];
+      if (b.encoding == SNAPSHOT_ENCODING_RAW) {
+        if (b.stored_size != b.size) {
+          return false;
+        }
+      } else if (b.encoding == SNAPSHOT_ENCODING_MU_LAW) {
+        if (b.size % 2 || b.stored_size != b.size / 2) {
+          return false;
+        }
+      } else {
+        return false;
+      }
+      if (b.offset > file_size || b.stored_size > file_size - b.offset) {
+        return false;
+      }
+      if (i >= 2 && (b.offset != header.block[i - 1].offset + \
+              header.block[i - 1].stored_size ||
+          b.encoding != header.block[1].encoding ||
+          b.size != header.block[1].size)) {
+        // The buffers must be back to back and of the same size, as in sample
+        // memory.
+        return false;
+      }
+    }
+    return true;
+  }
+  
+  // Checks that the recording state matches the buffers, so that the write
+  // heads stay within them.
+  bool Validate(const SnapshotHeader& header, const PersistentState& state)
+      const {
+    const SnapshotBlock& first = header.block[1];
+    if (state.spectral) {
+      // Spectral recordings are FFT frames, never compressed.
+      return first.encoding == SNAPSHOT_ENCODING_RAW;
+    }
+    size_t num_buffers = state.quality & 1 ? 1 : 2;
+    size_t num_samples = state.quality & 2 ? first.size : first.size / 2;
+    if (state.quality > 3 || header.num_blocks != num_buffers + 1) {
+      return false;
+    }
+    for (size_t i = 0; i < num_buffers; ++i) {
+      if (state.write_head[i] < 0 ||
+          static_cast<size_t>(state.write_head[i]) >= num_samples) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Release() {
+    if (memory_) {
+      munmap(memory_, memory_size_);
+      memory_ = NULL;
+      memory_size_ = 0;
+    }
+  }
+
+  char directory_[kMaxSnapshotPathLength];
+
+  void* memory_;
+  size_t memory_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(SnapshotStore);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_SNAPSHOT_STORE_H_
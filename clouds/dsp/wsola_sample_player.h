@@ -56,11 +56,16 @@ class WSOLASamplePlayer {
   WSOLASamplePlayer() { }
   ~WSOLASamplePlayer() { }
   
+  // Window sizes are given for a 32kHz sample rate, and scaled by
+  // time_scale. The sign bits fed to the correlator are decimated by the same
+  // factor, so that it needs the same memory at all sample rates.
   void Init(
       Correlator* correlator,
-      int32_t num_channels) {
+      int32_t num_channels,
+      float time_scale) {
     correlator_ = correlator;
     num_channels_ = num_channels;
+    time_scale_ = time_scale;
 
     pitch_ = 0.0f;
     position_ = 0.0f;
@@ -74,7 +79,7 @@ class WSOLASamplePlayer {
     search_source_ = 0;
     search_target_ = 0;
     
-    window_size_ = kMaxWSOLASize / 2;
+    window_size_ = (static_cast<int32_t>(kMaxWSOLASize * time_scale) / 2) & ~3;
     env_phase_ = 0.0f;
     env_phase_increment_ = 0.5f;
     elapsed_ = 0;
@@ -174,7 +179,7 @@ class WSOLASamplePlayer {
       return;
     }
     float stride = window_size_ / 2048.0f;
-    CONSTRAIN(stride, 1.0f, 2.0f);
+    CONSTRAIN(stride, time_scale_, 2.0f * time_scale_);
     stride *= 65536.0f;
     int32_t increment = static_cast<int32_t>(
           stride * (next_pitch_ratio_ < 1.25f ? 1.25f : next_pitch_ratio_));
@@ -237,7 +242,8 @@ class WSOLASamplePlayer {
     next_pitch_ratio_ = pitch_ratio;
     
     float size_factor = SemitonesToRatio((size_factor_ - 1.0f) * 60.0f);
-    int32_t new_window_size = static_cast<int32_t>(size_factor * kMaxWSOLASize);
+    int32_t new_window_size = static_cast<int32_t>(
+        size_factor * kMaxWSOLASize * time_scale_);
     if (abs(new_window_size - window_size_) > 64) {
       int32_t error = (new_window_size - window_size_) >> 5;
       new_window_size = window_size_ + error;
@@ -267,6 +273,7 @@ class WSOLASamplePlayer {
 
   int32_t window_size_;
   int32_t num_channels_;
+  float time_scale_;
   
   float pitch_;
   float smoothed_pitch_;
@@ -0,0 +1,676 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Offline batch processor: streams WAV files through a GranularProcessor,
+// with the same parameter automation script for all of them, and reports the
+// real-time factor.
+//
+// Usage: clouds_batch [options] script.{csv,json} input.wav [input.wav ...]
+//
+// Options:
+//   --jobs n         Number of files processed in parallel, by as many worker
+//                    processes with their own GranularProcessor (default:
+//                    number of cores).
+//   --output-dir d   Directory of the output files, which have the same name
+//                    as the input files (default: next to the input files,
+//                    with a _clouds suffix).
+//   --tail s         Silence appended to each file (default: 2s).
+//   --seed n         Seed of the random number generator, reset at the start
+//                    of each file (default: 0).
+//
+// The processor runs at the sample rate of each file, up to 128kHz. Inputs
+// are 16, 24 or 32-bit integer, or 32-bit float WAV files, of any length; the
+// outputs are 16-bit stereo. Above 32kHz, the effects of the mono qualities
+// (1 and 3) do not fit in the module-sized small buffer, and files switching
+// to them are rejected.
+//
+// The script is a list of events. Each event has a time (in seconds, from the
+// start of the file, positive or zero) and sets some of the following fields,
+// which keep their value until the next event setting them: mode (0 to 3),
+// quality (0 to 3), position, size, pitch, density, texture, dry_wet,
+// stereo_spread, feedback, reverb, freeze, gate. An event with a non-zero
+// trigger field fires a trigger. The formats are the same as those of
+// plaits_render:
+//
+//   time,mode,position,size,density,texture,freeze
+//   0.0,0,0.2,0.5,0.7,0.5,0
+//   4.0,,0.8,,,,1
+//
+//   [{ "time": 0.0, "mode": 0, "position": 0.2, "density": 0.7 },
+//    { "time": 4.0, "position": 0.8, "freeze": true }]
+//
+// The workers are processes rather than threads, since the state of the random
+// number generator is global. The output of a file does not depend on the
+// number of jobs.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <xmmintrin.h>
+
+#include "stmlib/utils/random.h"
+
+#include "clouds/dsp/granular_processor.h"
+
+// Same script formats as plaits_render.
+#include "host/event_script.h"
+
+using namespace clouds;
+using namespace std;
+using namespace stmlib;
+
+const size_t kBlockSize = 32;
+const float kDefaultTailDuration = 2.0f;
+const float kMaxSampleRate = 128000.0f;
+
+// Same sizes as on the module, with 4 times more FX workspace for the higher
+// sample rates.
+const size_t kLargeBufferSize = 65536 - 128 + 49152 * 4;
+const size_t kSmallBufferSize = 65536 - 128;
+
+enum Field {
+  FIELD_MODE,
+  FIELD_QUALITY,
+  FIELD_POSITION,
+  FIELD_SIZE,
+  FIELD_PITCH,
+  FIELD_DENSITY,
+  FIELD_TEXTURE,
+  FIELD_DRY_WET,
+  FIELD_STEREO_SPREAD,
+  FIELD_FEEDBACK,
+  FIELD_REVERB,
+  FIELD_FREEZE,
+  FIELD_GATE,
+  FIELD_TRIGGER,
+  FIELD_LAST
+};
+
+const char* field_names[FIELD_LAST] = {
+  "mode",
+  "quality",
+  "position",
+  "size",
+  "pitch",
+  "density",
+  "texture",
+  "dry_wet",
+  "stereo_spread",
+  "feedback",
+  "reverb",
+  "freeze",
+  "gate",
+  "trigger"
+};
+
+typedef host::ScriptEvent<FIELD_LAST> Event;
+typedef host::EventScriptParser<FIELD_LAST> Parser;
+
+inline uint32_t ReadLittleEndian(const uint8_t* p, size_t num_bytes) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < num_bytes; ++i) {
+    value |= static_cast<uint32_t>(p[i]) << (8 * i);
+  }
+  return value;
+}
+
+// Streams the frames of a PCM or float WAV file. Only the first two channels
+// are used; mono files are played on both channels.
+class WavReader {
+ public:
+  WavReader() : fp_(NULL) { }
+  ~WavReader() { Close(); }
+
+  bool Open(const char* file_name, string* error) {
+    fp_ = fopen(file_name, "rb");
+    if (!fp_) {
+      *error = "cannot open file";
+      return false;
+    }
+    uint8_t header[12];
+    if (fread(header, 1, 12, fp_) != 12 || memcmp(header, "RIFF", 4) ||
+        memcmp(header + 8, "WAVE", 4)) {
+      *error = "not a WAV file";
+      return false;
+    }
+    bool has_format = false;
+    while (true) {
+      uint8_t chunk[8];
+      if (fread(chunk, 1, 8, fp_) != 8) {
+        *error = "no data chunk";
+        return false;
+      }
+      uint32_t size = ReadLittleEndian(chunk + 4, 4);
+      if (!memcmp(chunk, "fmt ", 4)) {
+        uint8_t format[40];
+        size_t read_size = min(size, static_cast<uint32_t>(sizeof(format)));
+        if (size < 16 || fread(format, 1, read_size, fp_) != read_size) {
+          *error = "invalid format chunk";
+          return false;
+        }
+        format_tag_ = ReadLittleEndian(format, 2);
+        num_channels_ = ReadLittleEndian(format + 2, 2);
+        sample_rate_ = ReadLittleEndian(format + 4, 4);
+        bits_per_sample_ = ReadLittleEndian(format + 14, 2);
+        if (format_tag_ == 0xfffe && read_size >= 26) {
+          // WAVE_FORMAT_EXTENSIBLE: the format is in the sub-format GUID.
+          format_tag_ = ReadLittleEndian(format + 24, 2);
+        }
+        fseek(fp_, size - read_size + (size & 1), SEEK_CUR);
+        has_format = true;
+      } else if (!memcmp(chunk, "data", 4)) {
+        if (!has_format) {
+          *error = "data chunk before format chunk";
+          return false;
+        }
+        data_size_ = size;
+        break;
+      } else {
+        fseek(fp_, size + (size & 1), SEEK_CUR);
+      }
+    }
+    bool pcm = format_tag_ == 1 && (bits_per_sample_ == 16 || \
+        bits_per_sample_ == 24 || bits_per_sample_ == 32);
+    bool ieee_float = format_tag_ == 3 && bits_per_sample_ == 32;
+    if (!(pcm || ieee_float) || num_channels_ == 0) {
+      *error = "unsupported sample format";
+      return false;
+    }
+    bytes_per_frame_ = num_channels_ * bits_per_sample_ / 8;
+    // Streaming recorders often leave the size of the data chunk empty: the
+    // file is then read until its end.
+    if (data_size_ == 0 || data_size_ == 0xffffffff) {
+      remaining_frames_ = static_cast<size_t>(-1);
+    } else {
+      remaining_frames_ = data_size_ / bytes_per_frame_;
+    }
+    return true;
+  }
+
+  void Close() {
+    if (fp_) {
+      fclose(fp_);
+      fp_ = NULL;
+    }
+  }
+
+  // Returns the number of frames read, 0 at the end of the data chunk. The
+  // chunks following it (LIST, id3...) are not read.
+  size_t Read(ShortFrame* frames, size_t size) {
+    size = min(size, remaining_frames_);
+    if (!size) {
+      return 0;
+    }
+    buffer_.resize(size * bytes_per_frame_);
+    size_t num_frames = fread(&buffer_[0], bytes_per_frame_, size, fp_);
+    remaining_frames_ -= num_frames;
+    size_t bytes_per_sample = bits_per_sample_ / 8;
+    for (size_t i = 0; i < num_frames; ++i) {
+      const uint8_t* frame = &buffer_[i * bytes_per_frame_];
+      frames[i].l = ReadSample(frame);
+      frames[i].r = num_channels_ == 1
+          ? frames[i].l
+          : ReadSample(frame + bytes_per_sample);
+    }
+    return num_frames;
+  }
+
+  inline uint32_t sample_rate() const { return sample_rate_; }
+
+ private:
+  inline int16_t ReadSample(const uint8_t* p) const {
+    if (format_tag_ == 3) {
+      uint32_t word = ReadLittleEndian(p, 4);
+      float value;
+      memcpy(&value, &word, 4);
+      return Clip16(static_cast<int32_t>(value * 32768.0f));
+    } else {
+      // Keep the 16 most significant bits.
+      size_t bytes_per_sample = bits_per_sample_ / 8;
+      return ReadLittleEndian(p + bytes_per_sample - 2, 2);
+    }
+  }
+
+  FILE* fp_;
+  uint32_t format_tag_;
+  uint32_t num_channels_;
+  uint32_t sample_rate_;
+  uint32_t bits_per_sample_;
+  size_t bytes_per_frame_;
+  uint32_t data_size_;
+  size_t remaining_frames_;
+  vector<uint8_t> buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(WavReader);
+};
+
+// Writes a 16-bit stereo WAV file, whose length is only known when closing.
+class WavFileWriter {
+ public:
+  WavFileWriter() : fp_(NULL), num_frames_(0) { }
+  ~WavFileWriter() { Close(); }
+
+  bool Open(const char* file_name, uint32_t sample_rate) {
+    fp_ = fopen(file_name, "wb");
+    if (!fp_) {
+      return false;
+    }
+    sample_rate_ = sample_rate;
+    num_frames_ = 0;
+    WriteHeader();
+    return true;
+  }
+
+  void Write(const ShortFrame* frames, size_t size) {
+    fwrite(frames, sizeof(ShortFrame), size, fp_);
+    num_frames_ += size;
+  }
+
+  void Close() {
+    if (fp_) {
+      fseek(fp_, 0, SEEK_SET);
+      WriteHeader();
+      fclose(fp_);
+      fp_ = NULL;
+    }
+  }
+
+ private:
+  void WriteHeader() {
+    uint32_t data_size = num_frames_ * sizeof(ShortFrame);
+    uint32_t l;
+    uint16_t s;
+    fwrite("RIFF", 4, 1, fp_);
+    l = 36 + data_size;
+    fwrite(&l, 4, 1, fp_);
+    fwrite("WAVE", 4, 1, fp_);
+    fwrite("fmt ", 4, 1, fp_);
+    l = 16;
+    fwrite(&l, 4, 1, fp_);
+    s = 1;
+    fwrite(&s, 2, 1, fp_);
+    s = 2;
+    fwrite(&s, 2, 1, fp_);
+    l = sample_rate_;
+    fwrite(&l, 4, 1, fp_);
+    l = sample_rate_ * sizeof(ShortFrame);
+    fwrite(&l, 4, 1, fp_);
+    s = sizeof(ShortFrame);
+    fwrite(&s, 2, 1, fp_);
+    s = 16;
+    fwrite(&s, 2, 1, fp_);
+    fwrite("data", 4, 1, fp_);
+    fwrite(&data_size, 4, 1, fp_);
+  }
+
+  FILE* fp_;
+  uint32_t sample_rate_;
+  size_t num_frames_;
+
+  DISALLOW_COPY_AND_ASSIGN(WavFileWriter);
+};
+
+struct Job {
+  string input;
+  string output;
+};
+
+// Results are written by the worker processes to shared memory.
+struct JobResult {
+  bool ok;
+  double audio_duration;
+  double elapsed;
+};
+
+struct Batch {
+  const vector<Event>* events;
+  float tail_duration;
+  uint32_t seed;
+  vector<Job> jobs;
+  
+  // In memory shared by all workers.
+  atomic<size_t>* next_job;
+  JobResult* results;
+};
+
+// Default patch: that of a module with all knobs at noon, and the dry/wet
+// knob fully clockwise.
+void ResetParameters(Parameters* p) {
+  memset(p, 0, sizeof(Parameters));
+  p->position = 0.5f;
+  p->size = 0.5f;
+  p->pitch = 0.0f;
+  p->density = 0.5f;
+  p->texture = 0.5f;
+  p->dry_wet = 1.0f;
+  p->stereo_spread = 0.5f;
+  p->feedback = 0.5f;
+  p->reverb = 0.5f;
+}
+
+void ProcessFile(
+    GranularProcessor* processor,
+    void* large_buffer,
+    void* small_buffer,
+    const vector<Event>& events,
+    float tail_duration,
+    const Job& job,
+    JobResult* result,
+    string* error) {
+  WavReader reader;
+  if (!reader.Open(job.input.c_str(), error)) {
+    return;
+  }
+  float sample_rate = reader.sample_rate();
+  if (sample_rate < 8000.0f || sample_rate > kMaxSampleRate) {
+    *error = "unsupported sample rate";
+    return;
+  }
+  WavFileWriter writer;
+  if (!writer.Open(job.output.c_str(), reader.sample_rate())) {
+    *error = "cannot create " + job.output;
+    return;
+  }
+
+  processor->Init(
+      large_buffer, kLargeBufferSize,
+      small_buffer, kSmallBufferSize);
+  if (!processor->set_sample_rate(sample_rate)) {
+    *error = "not enough FX memory at this sample rate";
+    return;
+  }
+  processor->set_silence(false);
+  processor->set_playback_mode(PLAYBACK_MODE_GRANULAR);
+  processor->set_quality(0);
+  Parameters* p = processor->mutable_parameters();
+  ResetParameters(p);
+  processor->Prepare();
+
+  float* targets[FIELD_LAST] = {
+    NULL,
+    NULL,
+    &p->position,
+    &p->size,
+    &p->pitch,
+    &p->density,
+    &p->texture,
+    &p->dry_wet,
+    &p->stereo_spread,
+    &p->feedback,
+    &p->reverb,
+    NULL,
+    NULL,
+    NULL
+  };
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  const size_t tail_size = static_cast<size_t>(tail_duration * sample_rate);
+  size_t tail_remaining = tail_size;
+  size_t next_event = 0;
+  size_t position = 0;
+  ShortFrame input[kBlockSize];
+  ShortFrame output[kBlockSize];
+  while (true) {
+    p->trigger = false;
+    while (next_event < events.size() && \
+           static_cast<size_t>(events[next_event].time * sample_rate) <= \
+               position) {
+      const Event& e = events[next_event++];
+      for (int field = 0; field < FIELD_LAST; ++field) {
+        if (!(e.mask & (1 << field))) {
+          continue;
+        }
+        const float value = e.value[field];
+        if (field == FIELD_MODE) {
+          processor->set_playback_mode(
+              PlaybackMode(static_cast<int>(value)));
+        } else if (field == FIELD_QUALITY) {
+          if (!processor->set_quality(static_cast<int>(value))) {
+            *error = "not enough FX memory for a mono quality at this "
+                "sample rate";
+            return;
+          }
+        } else if (field == FIELD_FREEZE) {
+          p->freeze = value != 0.0f;
+        } else if (field == FIELD_GATE) {
+          p->gate = value != 0.0f;
+        } else if (field == FIELD_TRIGGER) {
+          p->trigger = p->trigger || value != 0.0f;
+        } else {
+          *targets[field] = value;
+        }
+      }
+    }
+
+    // Blocks are cut at event boundaries, so that events are sample-accurate.
+    size_t size = kBlockSize;
+    if (next_event < events.size()) {
+      size_t event_position = static_cast<size_t>(
+          events[next_event].time * sample_rate);
+      size = max(min(size, event_position - position), static_cast<size_t>(1));
+    }
+    size_t read = reader.Read(input, size);
+    if (read < size) {
+      size_t silence = min(size - read, tail_remaining);
+      fill(&input[read], &input[read + silence], ShortFrame());
+      tail_remaining -= silence;
+      size = read + silence;
+      if (!size) {
+        break;
+      }
+    }
+    processor->Process(input, output, size);
+    processor->Prepare();
+    writer.Write(output, size);
+    position += size;
+  }
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  result->elapsed = elapsed.count();
+  result->audio_duration = position / sample_rate;
+  result->ok = true;
+}
+
+void Work(Batch* batch) {
+  void* storage = malloc(sizeof(GranularProcessor));
+  vector<uint8_t> large_buffer(kLargeBufferSize);
+  vector<uint8_t> small_buffer(kSmallBufferSize);
+
+  while (true) {
+    size_t index = batch->next_job->fetch_add(1);
+    if (index >= batch->jobs.size()) {
+      break;
+    }
+    const Job& job = batch->jobs[index];
+    JobResult* result = &batch->results[index];
+    string error;
+    
+    // Each file starts from the state of a module just powered on, where the
+    // processor is a zero-initialized global, so that its output does not
+    // depend on the files processed before by the same worker.
+    memset(storage, 0, sizeof(GranularProcessor));
+    fill(large_buffer.begin(), large_buffer.end(), 0);
+    fill(small_buffer.begin(), small_buffer.end(), 0);
+    GranularProcessor* processor = new(storage) GranularProcessor;
+    Random::Seed(batch->seed);
+    ProcessFile(
+        processor,
+        &large_buffer[0],
+        &small_buffer[0],
+        *batch->events,
+        batch->tail_duration,
+        job,
+        result,
+        &error);
+    processor->~GranularProcessor();
+    if (result->ok) {
+      printf("%-40s %8.2fs %8.2fs %8.1fx\n",
+          job.input.c_str(),
+          result->audio_duration,
+          result->elapsed,
+          result->elapsed > 0.0
+              ? result->audio_duration / result->elapsed
+              : 0.0);
+      fflush(stdout);
+    } else {
+      fprintf(stderr, "%s: %s\n", job.input.c_str(), error.c_str());
+    }
+  }
+  free(storage);
+}
+
+string OutputFileName(const string& input, const char* output_dir) {
+  if (output_dir) {
+    size_t slash = input.find_last_of('/');
+    string base = slash == string::npos ? input : input.substr(slash + 1);
+    return string(output_dir) + "/" + base;
+  }
+  size_t dot = input.find_last_of('.');
+  size_t slash = input.find_last_of('/');
+  if (dot == string::npos || (slash != string::npos && dot < slash)) {
+    return input + "_clouds.wav";
+  }
+  return input.substr(0, dot) + "_clouds" + input.substr(dot);
+}
+
+int main(int argc, char** argv) {
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+
+  int num_jobs = thread::hardware_concurrency();
+  const char* output_dir = NULL;
+  float tail_duration = kDefaultTailDuration;
+  uint32_t seed = 0;
+  vector<const char*> files;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+      num_jobs = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--output-dir") && i + 1 < argc) {
+      output_dir = argv[++i];
+    } else if (!strcmp(argv[i], "--tail") && i + 1 < argc) {
+      tail_duration = max(static_cast<float>(atof(argv[++i])), 0.0f);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = strtoul(argv[++i], NULL, 0);
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+
+  if (files.size() < 2) {
+    fprintf(stderr,
+        "Usage: %s [--jobs n] [--output-dir d] [--tail s] [--seed n] "
+        "script.{csv,json} input.wav [input.wav ...]\n", argv[0]);
+    return 1;
+  }
+
+  vector<Event> events;
+  Parser parser(field_names);
+  if (!parser.Load(files[0], &events) || \
+      !parser.CheckIndex(events, FIELD_MODE, PLAYBACK_MODE_LAST) || \
+      !parser.CheckIndex(events, FIELD_QUALITY, 4)) {
+    return 1;
+  }
+  Batch batch;
+  batch.events = &events;
+  batch.tail_duration = tail_duration;
+  batch.seed = seed;
+  batch.jobs.resize(files.size() - 1);
+  for (size_t i = 1; i < files.size(); ++i) {
+    Job* job = &batch.jobs[i - 1];
+    job->input = files[i];
+    job->output = OutputFileName(job->input, output_dir);
+  }
+  
+  size_t shared_size = sizeof(atomic<size_t>) + \
+      batch.jobs.size() * sizeof(JobResult);
+  void* shared = mmap(
+      NULL,
+      shared_size,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS,
+      -1,
+      0);
+  if (shared == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  batch.next_job = new(shared) atomic<size_t>(0);
+  batch.results = reinterpret_cast<JobResult*>(batch.next_job + 1);
+  for (size_t i = 0; i < batch.jobs.size(); ++i) {
+    batch.results[i].ok = false;
+    batch.results[i].audio_duration = batch.results[i].elapsed = 0.0;
+  }
+
+  num_jobs = max(min(num_jobs, static_cast<int>(batch.jobs.size())), 1);
+  printf("%-40s %9s %9s %9s\n", "file", "audio", "wall", "realtime");
+  fflush(stdout);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<pid_t> workers;
+  for (int i = 1; i < num_jobs; ++i) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      Work(&batch);
+      _exit(0);
+    } else if (pid > 0) {
+      workers.push_back(pid);
+    }
+  }
+  Work(&batch);
+  for (size_t i = 0; i < workers.size(); ++i) {
+    waitpid(workers[i], NULL, 0);
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  double audio_duration = 0.0;
+  size_t num_failed = 0;
+  for (size_t i = 0; i < batch.jobs.size(); ++i) {
+    audio_duration += batch.results[i].audio_duration;
+    num_failed += batch.results[i].ok ? 0 : 1;
+  }
+  printf("%-40s %8.2fs %8.2fs %8.1fx (%d jobs)\n",
+      "total",
+      audio_duration,
+      elapsed.count(),
+      elapsed.count() > 0.0 ? audio_duration / elapsed.count() : 0.0,
+      num_jobs);
+  munmap(shared, shared_size);
+  return num_failed ? 1 : 0;
+}
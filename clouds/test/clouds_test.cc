@@ -29,10 +29,20 @@
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <vector>
 #include <xmmintrin.h>
 
+#include "clouds/dsp/fx/reverb.h"
 #include "clouds/dsp/granular_processor.h"
+#include "clouds/dsp/mapped_sample_memory.h"
+#include "clouds/dsp/parameters.h"
+#include "clouds/dsp/pvoc/frame_transformation.h"
+#include "clouds/dsp/pvoc/polar_conversion.h"
+#include "clouds/dsp/pvoc/stft.h"
+#include "clouds/dsp/pvoc/real_fft.h"
+#include "clouds/dsp/snapshot_store.h"
+#include "stmlib/fft/shy_fft.h"
 #include "clouds/resources.h"
 
 using namespace clouds;
@@ -223,8 +233,890 @@ void TestGrainSize() {
   }
 }
 
+void RenderGranular(
+    GranularProcessor* processor,
+    int32_t num_threads,
+    ShortFrame* output,
+    size_t num_blocks) {
+#ifdef USE_GRAIN_THREADS
+  processor->set_num_grain_threads(num_threads);
+#endif  // USE_GRAIN_THREADS
+  processor->set_num_channels(2);
+  processor->set_low_fidelity(false);
+  processor->set_playback_mode(PLAYBACK_MODE_GRANULAR);
+  
+  Parameters* p = processor->mutable_parameters();
+  float phase = 0.0f;
+  processor->Prepare();
+  for (size_t block = 0; block < num_blocks; ++block) {
+    p->trigger = false;
+    p->freeze = false;
+    p->position = 0.3f;
+    p->size = 0.6f;
+    p->pitch = (block & 1024) ? 7.0f : 0.0f;
+    p->density = 0.95f;
+    p->texture = 0.5f;
+    p->feedback = 0.0f;
+    p->dry_wet = 1.0f;
+    p->reverb = 0.0f;
+    p->stereo_spread = 0.5f;
+    
+    ShortFrame input[kBlockSize];
+    for (size_t i = 0; i < kBlockSize; ++i) {
+      phase += 220.0f / kSampleRate;
+      if (phase >= 1.0f) {
+        phase -= 1.0f;
+      }
+      input[i].l = 16384.0f * sinf(phase * M_PI * 2);
+      input[i].r = 8192.0f * (phase - 0.5f);
+    }
+    processor->Process(input, output, kBlockSize);
+    processor->Prepare();
+    output += kBlockSize;
+  }
+}
+
+void TestGrainThreads() {
+  const size_t kNumBlocks = kSampleRate * 10 / kBlockSize;
+  const int32_t kNumThreads = 4;
+  
+  static uint8_t large_buffer[2][118784];
+  static uint8_t small_buffer[2][65536 - 128];
+  static GranularProcessor processor[2];
+  static ShortFrame output[2][kNumBlocks * kBlockSize];
+  
+  clock_t elapsed[2];
+  for (int i = 0; i < 2; ++i) {
+    processor[i].Init(
+        &large_buffer[i][0], sizeof(large_buffer[i]),
+        &small_buffer[i][0], sizeof(small_buffer[i]));
+    Random::Seed(0x21);
+    clock_t start = clock();
+    RenderGranular(&processor[i], i ? kNumThreads : 1, output[i], kNumBlocks);
+    elapsed[i] = clock() - start;
+  }
+  
+  size_t mismatches = 0;
+  for (size_t i = 0; i < kNumBlocks * kBlockSize; ++i) {
+    mismatches += output[0][i].l != output[1][i].l ? 1 : 0;
+    mismatches += output[0][i].r != output[1][i].r ? 1 : 0;
+  }
+  printf("%d grains, 1 thread: %.3fs, %d threads: %.3fs (CPU), "
+      "%zu mismatches\n",
+      static_cast<int>(kMaxNumGrains),
+      static_cast<float>(elapsed[0]) / CLOCKS_PER_SEC,
+      static_cast<int>(kNumThreads),
+      static_cast<float>(elapsed[1]) / CLOCKS_PER_SEC,
+      mismatches);
+}
+
+void TestGrainDensity() {
+  const size_t kNumBlocks = kSampleRate * 4 / kBlockSize;
+  const int32_t kBufferSize = 65536;
+  const int32_t kNumGrains[] = { 64, 256, 1024 };
+  const float kOverlap[] = { 0.5f, 1.0f };
+  
+  static int16_t memory[2][kBufferSize];
+  static int16_t tail[2][kInterpolationTail];
+  static AudioBuffer<RESOLUTION_16_BIT> buffer[2];
+  static GranularSamplePlayer player;
+  
+  Parameters p;
+  memset(&p, 0, sizeof(p));
+  p.size = 0.8f;
+  p.stereo_spread = 0.5f;
+  p.granular.window_shape = 0.5f;
+  
+  for (size_t n = 0; n < sizeof(kNumGrains) / sizeof(kNumGrains[0]); ++n) {
+    if (kNumGrains[n] > kMaxNumGrains) {
+      printf("%d grains: MAX_NUM_GRAINS too small\n", kNumGrains[n]);
+      continue;
+    }
+    for (size_t o = 0; o < sizeof(kOverlap) / sizeof(kOverlap[0]); ++o) {
+      for (int32_t i = 0; i < 2; ++i) {
+        buffer[i].Init(&memory[i][0], kBufferSize, &tail[i][0]);
+      }
+      player.Init(2, kNumGrains[n], 1.0f);
+      p.granular.overlap = kOverlap[o];
+      Random::Seed(0x21);
+      
+      float phase = 0.0f;
+      float out[kBlockSize * 2];
+      int64_t grain_samples = 0;
+      clock_t start = clock();
+      for (size_t block = 0; block < kNumBlocks; ++block) {
+        for (size_t i = 0; i < kBlockSize; ++i) {
+          phase += 220.0f / kSampleRate;
+          if (phase >= 1.0f) {
+            phase -= 1.0f;
+          }
+          buffer[0].Write(0.5f * sinf(phase * M_PI * 2));
+          buffer[1].Write(0.25f * (phase - 0.5f));
+        }
+        player.Play(buffer, p, out, kBlockSize);
+        grain_samples += player.num_active_grains() * kBlockSize;
+      }
+      float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+      printf("%d grains, overlap %.1f: %.1f active on average, "
+          "%.2f us per block, %.1f ns per grain sample\n",
+          kNumGrains[n],
+          kOverlap[o],
+          static_cast<float>(grain_samples) / (kNumBlocks * kBlockSize),
+          elapsed * 1e6f / kNumBlocks,
+          elapsed * 1e9f / grain_samples);
+    }
+  }
+}
+
+void TestCorrelator() {
+  const int32_t kNumSamples = 2048;
+  const int32_t kNumWords = kNumSamples / 32;
+  const int32_t kNumSearches = 200;
+  
+  uint32_t source[kNumWords + 2];
+  uint32_t destination[kNumWords * 2 + 2];
+  Correlator correlator;
+  correlator.Init(source, destination);
+  
+  const char* names[] = { "incremental", "full sweep" };
+  for (int32_t mode = 0; mode < 2; ++mode) {
+    correlator.set_search_mode(CorrelatorSearchMode(mode));
+    Random::Seed(0x42);
+    int32_t num_blocks = 0;
+    int32_t errors = 0;
+    clock_t elapsed = 0;
+    for (int32_t search = 0; search < kNumSearches; ++search) {
+      // Hides the source at a random position in a noisy destination.
+      int32_t position = Random::GetWord() % kNumSamples;
+      for (int32_t i = 0; i < kNumWords * 2 + 2; ++i) {
+        destination[i] = Random::GetWord();
+      }
+      for (int32_t i = 0; i < kNumSamples; ++i) {
+        int32_t bit = i + position;
+        uint32_t value = Random::GetWord() >> 31;
+        source[i >> 5] = (source[i >> 5] << 1) | value;
+        uint32_t mask = 0x80000000 >> (bit & 0x1f);
+        destination[bit >> 5] = (destination[bit >> 5] & ~mask) | \
+            (value ? mask : 0);
+      }
+      correlator.StartSearch(kNumSamples, 0, 65536);
+      clock_t start = clock();
+      while (!correlator.done()) {
+        correlator.EvaluateSomeCandidates();
+        ++num_blocks;
+      }
+      elapsed += clock() - start;
+      errors += correlator.best_match() != position ? 1 : 0;
+    }
+    printf("%s: %.1f blocks to align, %.2f us per search, %d errors\n",
+        names[mode],
+        static_cast<float>(num_blocks) / kNumSearches,
+        1e6f * elapsed / CLOCKS_PER_SEC / kNumSearches,
+        errors);
+  }
+}
+
+void TestSampleMemory() {
+  const size_t kNumBlocks = kSampleRate * 20 / kBlockSize;
+  // 10 minutes of stereo 16-bit audio.
+  const size_t kSampleMemorySize = kSampleRate * 60 * 10 * 2 * 2;
+  
+  MappedSampleMemory memory;
+  unlink("sample_memory.bin");
+  if (!memory.Map("sample_memory.bin", kSampleMemorySize)) {
+    printf("Cannot map sample_memory.bin\n");
+    return;
+  }
+  
+  static uint8_t large_buffer[118784];
+  static uint8_t small_buffer[65536 - 128];
+  static GranularProcessor processor;
+  processor.Init(
+      &large_buffer[0], sizeof(large_buffer),
+      &small_buffer[0], sizeof(small_buffer));
+  processor.set_sample_memory(memory.data(), memory.size());
+  processor.set_num_channels(2);
+  processor.set_low_fidelity(false);
+  
+  Parameters* p = processor.mutable_parameters();
+  float phase = 0.0f;
+  for (int32_t mode = 0; mode < PLAYBACK_MODE_SPECTRAL; ++mode) {
+    processor.set_playback_mode(PlaybackMode(mode));
+    processor.Prepare();
+    float peak = 0.0f;
+    clock_t start = clock();
+    for (size_t block = 0; block < kNumBlocks; ++block) {
+      p->trigger = false;
+      p->freeze = block > kNumBlocks / 2;
+      // Sweeps the whole buffer, including the parts not recorded yet.
+      p->position = static_cast<float>(block) / kNumBlocks;
+      p->size = 0.5f;
+      p->pitch = 0.0f;
+      p->density = 0.7f;
+      p->texture = 0.5f;
+      p->feedback = 0.0f;
+      p->dry_wet = 1.0f;
+      p->reverb = 0.0f;
+      p->stereo_spread = 0.0f;
+      
+      ShortFrame input[kBlockSize];
+      ShortFrame output[kBlockSize];
+      for (size_t i = 0; i < kBlockSize; ++i) {
+        phase += 220.0f / kSampleRate;
+        if (phase >= 1.0f) {
+          phase -= 1.0f;
+        }
+        input[i].l = input[i].r = 16384.0f * sinf(phase * M_PI * 2);
+      }
+      processor.Process(input, output, kBlockSize);
+      processor.Prepare();
+      for (size_t i = 0; i < kBlockSize; ++i) {
+        peak = max(peak, fabsf(output[i].l / 32768.0f));
+      }
+    }
+    printf("mode %d: peak %.3f, %.3fs\n",
+        static_cast<int>(mode),
+        peak,
+        static_cast<float>(clock() - start) / CLOCKS_PER_SEC);
+  }
+  
+  struct stat st;
+  stat("sample_memory.bin", &st);
+  printf("%.1f MB of sample memory, %.1f MB written to disk\n",
+      kSampleMemorySize / 1048576.0f,
+      st.st_blocks * 512 / 1048576.0f);
+}
+
+void TestSampleRates() {
+  const float sample_rates[] = {
+      22050.0f, 32000.0f, 44100.0f, 48000.0f, 96000.0f };
+  
+  // Sample memory + FX workspace for the highest sample rate, then the
+  // module buffer sizes, which only hold the effects up to 32kHz.
+  static uint8_t large_buffer[65536 - 128 + 49152 * 4];
+  static uint8_t small_buffer[65536 - 128];
+  static GranularProcessor processor;
+  const size_t large_buffer_sizes[] = { sizeof(large_buffer), 118784 };
+  
+  for (size_t k = 0; k < 2; ++k) {
+    for (size_t i = 0; i < sizeof(sample_rates) / sizeof(float); ++i) {
+      float sample_rate = sample_rates[i];
+      processor.Init(
+          &large_buffer[0], large_buffer_sizes[k],
+          &small_buffer[0], sizeof(small_buffer));
+      bool accepted = processor.set_sample_rate(sample_rate);
+      bool expected = k == 0 || sample_rate <= 32000.0f;
+      if (!accepted) {
+        printf("%s, %.0f Hz: rejected, %s\n",
+            k ? "module buffers" : "large buffers",
+            sample_rate, accepted == expected ? "PASS" : "FAIL");
+        continue;
+      } else if (!expected) {
+        printf("%s, %.0f Hz: accepted, FAIL\n",
+            k ? "module buffers" : "large buffers", sample_rate);
+      }
+      // In mono, the FX workspace is the small buffer.
+      bool mono_accepted = processor.set_num_channels(1);
+      if (mono_accepted != (sample_rate <= 32000.0f)) {
+        printf("%.0f Hz: mono %s, FAIL\n",
+            sample_rate, mono_accepted ? "accepted" : "rejected");
+      }
+      processor.set_num_channels(2);
+      processor.set_low_fidelity(false);
+      processor.set_playback_mode(PLAYBACK_MODE_LOOPING_DELAY);
+      processor.Prepare();
+    
+      Parameters* p = processor.mutable_parameters();
+      const size_t num_blocks = sample_rate * 4 / kBlockSize;
+      float phase = 0.0f;
+      float peak = 0.0f;
+      float decay_time = 0.0f;
+      clock_t start = clock();
+      for (size_t block = 0; block < num_blocks; ++block) {
+        // 1s of 220Hz sine, then silence. With no delay, this measures the
+        // decay time of the reverb, which should not depend on the sample
+        // rate.
+        bool silence = block * kBlockSize >= sample_rate;
+        p->trigger = false;
+        p->freeze = false;
+        p->position = 0.0f;
+        p->size = 0.5f;
+        p->pitch = 0.0f;
+        p->density = 0.3f;
+        p->texture = 0.5f;
+        p->feedback = 0.0f;
+        p->dry_wet = 1.0f;
+        p->reverb = 0.3f;
+        p->stereo_spread = 0.0f;
+      
+        ShortFrame input[kBlockSize];
+        ShortFrame output[kBlockSize];
+        for (size_t j = 0; j < kBlockSize; ++j) {
+          phase += 220.0f / sample_rate;
+          if (phase >= 1.0f) {
+            phase -= 1.0f;
+          }
+          input[j].l = input[j].r = silence
+              ? 0 : 16384.0f * sinf(phase * M_PI * 2);
+        }
+        processor.Process(input, output, kBlockSize);
+        processor.Prepare();
+        for (size_t j = 0; j < kBlockSize; ++j) {
+          float level = fabsf(output[j].l / 32768.0f);
+          if (!silence) {
+            peak = max(peak, level);
+          } else if (level > peak * 0.01f) {
+            decay_time = (block * kBlockSize + j) / sample_rate - 1.0f;
+          }
+        }
+      }
+      float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+      printf("%s, %.0f Hz: peak %.3f, -40 dB after %.2fs, %.1f%% CPU\n",
+          k ? "module buffers" : "large buffers",
+          sample_rate, peak, decay_time, elapsed / 4.0f * 100.0f);
+    }
+  }
+}
+
+void TestSpectralMode() {
+  // Module buffer sizes - with -DUSE_FLOAT_STFT_BUFFERS, the phase vocoder
+  // falls back to a smaller FFT to fit in them.
+  static uint8_t large_buffer[118784];
+  static uint8_t small_buffer[65536 - 128];
+  static GranularProcessor processor;
+  
+#ifdef USE_FLOAT_STFT_BUFFERS
+  const char* format = "float";
+#else
+  const char* format = "16-bit";
+#endif  // USE_FLOAT_STFT_BUFFERS
+  
+  for (int32_t num_channels = 1; num_channels <= 2; ++num_channels) {
+    processor.Init(
+        &large_buffer[0], sizeof(large_buffer),
+        &small_buffer[0], sizeof(small_buffer));
+    processor.set_num_channels(num_channels);
+    processor.set_low_fidelity(false);
+    processor.set_playback_mode(PLAYBACK_MODE_SPECTRAL);
+    processor.Prepare();
+    
+    Parameters* p = processor.mutable_parameters();
+    const size_t num_blocks = kSampleRate * 4 / kBlockSize;
+    float phase = 0.0f;
+    float peak = 0.0f;
+    clock_t start = clock();
+    for (size_t block = 0; block < num_blocks; ++block) {
+      p->trigger = false;
+      p->freeze = false;
+      p->position = 0.0f;
+      p->size = 0.5f;
+      p->pitch = 0.0f;
+      p->density = 0.5f;
+      p->texture = 0.5f;
+      p->feedback = 0.0f;
+      p->dry_wet = 1.0f;
+      p->reverb = 0.0f;
+      p->stereo_spread = 0.0f;
+      
+      ShortFrame input[kBlockSize];
+      ShortFrame output[kBlockSize];
+      for (size_t j = 0; j < kBlockSize; ++j) {
+        phase += 220.0f / kSampleRate;
+        if (phase >= 1.0f) {
+          phase -= 1.0f;
+        }
+        input[j].l = input[j].r = 16384.0f * sinf(phase * M_PI * 2);
+      }
+      processor.Process(input, output, kBlockSize);
+      processor.Prepare();
+      for (size_t j = 0; j < kBlockSize; ++j) {
+        peak = max(peak, fabsf(output[j].l / 32768.0f));
+        peak = max(peak, fabsf(output[j].r / 32768.0f));
+      }
+    }
+    float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    printf("Spectral mode, %s buffers, %d channel(s): peak %.3f, "
+        "%.1f%% CPU %s\n",
+        format,
+        num_channels,
+        peak,
+        elapsed / 4.0f * 100.0f,
+        peak > 0.01f ? "PASS" : "FAIL");
+  }
+}
+
+void TestFFT() {
+  const size_t kNumIterations = 2000;
+  static stmlib::ShyFFT<float, kMaxFftSize, stmlib::RotationPhasor> shy_fft;
+  static RealFFT<kMaxFftSize> real_fft;
+  shy_fft.Init();
+  real_fft.Init();
+  
+  static float in[kMaxFftSize];
+  static float out[2][kMaxFftSize];
+  static float inverse[kMaxFftSize];
+  
+  for (size_t num_passes = 6; num_passes <= 12; ++num_passes) {
+    size_t size = 1 << num_passes;
+    for (size_t i = 0; i < size; ++i) {
+      in[i] = Random::GetFloat() * 2.0f - 1.0f;
+    }
+    
+    clock_t start = clock();
+    for (size_t i = 0; i < kNumIterations; ++i) {
+      shy_fft.Direct(in, out[0], num_passes);
+      shy_fft.Inverse(out[0], inverse, num_passes);
+    }
+    float shy_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    
+    start = clock();
+    for (size_t i = 0; i < kNumIterations; ++i) {
+      real_fft.Direct(in, out[1], num_passes);
+      real_fft.Inverse(out[1], inverse, num_passes);
+    }
+    float real_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    
+    // Compares the spectra, and checks the round trip.
+    float spectrum_error = 0.0f;
+    for (size_t i = 0; i < size; ++i) {
+      if (i == size / 2) {
+        // The Nyquist bin is not used by the frame transformation.
+        continue;
+      }
+      spectrum_error = max(spectrum_error, fabsf(out[0][i] - out[1][i]));
+    }
+    float round_trip_error = 0.0f;
+    for (size_t i = 0; i < size; ++i) {
+      round_trip_error = max(
+          round_trip_error, fabsf(inverse[i] / size - in[i]));
+    }
+    printf("%4zu: ShyFFT %6.2f us, RealFFT %6.2f us, "
+        "error %.2e, round trip error %.2e\n",
+        size,
+        shy_time * 1e6f / kNumIterations,
+        real_time * 1e6f / kNumIterations,
+        spectrum_error / sqrtf(size),
+        round_trip_error);
+  }
+}
+
+template<STFTBufferFormat format>
+float RenderSTFT(const float* input, float* output, size_t size) {
+  const size_t kFftSize = 2048;
+  const size_t kHopSize = kFftSize / 4;
+  static FFT fft;
+  static float fft_buffer[kFftSize];
+  static float ifft_buffer[kFftSize];
+  static typename STFT<format>::Sample buffer[(kFftSize + kHopSize) * 2];
+  static STFT<format> stft;
+  
+  Parameters parameters;
+  memset(&parameters, 0, sizeof(Parameters));
+  stft.Init(
+      &fft, kFftSize, kHopSize,
+      fft_buffer, ifft_buffer,
+      lut_sine_window_4096,
+      buffer,
+      NULL);
+  
+  clock_t start = clock();
+  for (size_t i = 0; i < size; i += kBlockSize) {
+    stft.Process(parameters, input + i, output + i, kBlockSize, 1);
+    stft.Buffer();
+  }
+  return static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+}
+
+void TestSTFT() {
+  const size_t kNumSamples = kSampleRate * 20;
+  vector<float> input(kNumSamples);
+  vector<float> output[2];
+  output[0].resize(kNumSamples);
+  output[1].resize(kNumSamples);
+  
+  // A quiet signal, to compare the quantization noise of both formats, and
+  // a signal 6dB above full scale, to check the headroom.
+  const float amplitudes[] = { 0.01f, 0.5f, 2.0f };
+  for (size_t a = 0; a < sizeof(amplitudes) / sizeof(float); ++a) {
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      float t = static_cast<float>(i) / kSampleRate;
+      input[i] = amplitudes[a] * (0.7f * sinf(2.0f * M_PI * 220.0f * t) + \
+          0.3f * sinf(2.0f * M_PI * 1375.0f * t));
+    }
+    float time_16_bit = RenderSTFT<STFT_BUFFER_FORMAT_16_BIT>(
+        &input[0], &output[0][0], kNumSamples);
+    float time_float = RenderSTFT<STFT_BUFFER_FORMAT_FLOAT>(
+        &input[0], &output[1][0], kNumSamples);
+    
+    float peak[2] = { 0.0f, 0.0f };
+    float difference = 0.0f;
+    for (size_t i = kSampleRate; i < kNumSamples; ++i) {
+      peak[0] = max(peak[0], fabsf(output[0][i]));
+      peak[1] = max(peak[1], fabsf(output[1][i]));
+      difference = max(difference, fabsf(output[0][i] - output[1][i]));
+    }
+    printf("amplitude %.2f: 16-bit %.2f ns/sample (peak %.3f), "
+        "float %.2f ns/sample (peak %.3f), difference %.2e\n",
+        amplitudes[a],
+        time_16_bit * 1e9f / kNumSamples, peak[0],
+        time_float * 1e9f / kNumSamples, peak[1],
+        difference / amplitudes[a]);
+  }
+}
+
+void TestFrameTransformation() {
+  const size_t kNumBins = kMaxFftSize / 2;
+  const size_t kNumIterations = 2000;
+  static float real[kNumBins];
+  static float imag[kNumBins];
+  static float magnitude[2][kNumBins];
+  static uint16_t angle[2][kNumBins];
+  static float rectangular[4][kNumBins];
+  
+  for (size_t i = 0; i < kNumBins; ++i) {
+    // Spans a wide dynamic range, with a few exact zeros and axis points.
+    float scale = powf(10.0f, Random::GetFloat() * 8.0f - 4.0f);
+    real[i] = (i % 97) == 0 ? 0.0f : (Random::GetFloat() - 0.5f) * scale;
+    imag[i] = (i % 89) == 0 ? 0.0f : (Random::GetFloat() - 0.5f) * scale;
+  }
+  
+  clock_t start = clock();
+  for (size_t i = 0; i < kNumIterations; ++i) {
+    RectangularToPolar(real, imag, magnitude[0], angle[0], kNumBins);
+    PolarToRectangular(
+        magnitude[0], angle[0], rectangular[0], rectangular[1], kNumBins);
+  }
+  float scalar_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  
+  start = clock();
+  for (size_t i = 0; i < kNumIterations; ++i) {
+    RectangularToPolarSSE(real, imag, magnitude[1], angle[1], kNumBins);
+    PolarToRectangularSSE(
+        magnitude[0], angle[0], rectangular[2], rectangular[3], kNumBins);
+  }
+  float sse_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  
+  // Bounds: 2 LSB on the angle, 1e-6 relative error on the magnitude, and
+  // no difference at all for the conversion back to rectangular.
+  int32_t angle_error = 0;
+  float magnitude_error = 0.0f;
+  size_t rectangular_mismatches = 0;
+  for (size_t i = 0; i < kNumBins; ++i) {
+    int16_t error = angle[1][i] - angle[0][i];
+    angle_error = max(angle_error, abs(static_cast<int32_t>(error)));
+    if (magnitude[0][i] > 0.0f) {
+      magnitude_error = max(
+          magnitude_error,
+          fabsf(magnitude[1][i] - magnitude[0][i]) / magnitude[0][i]);
+    }
+    if (rectangular[0][i] != rectangular[2][i] ||
+        rectangular[1][i] != rectangular[3][i]) {
+      ++rectangular_mismatches;
+    }
+  }
+  printf("Polar conversion: scalar %.2f us, SSE %.2f us per %zu bins\n",
+      scalar_time * 1e6f / kNumIterations,
+      sse_time * 1e6f / kNumIterations,
+      kNumBins);
+  printf("Angle error %d LSB, magnitude error %.2e, %zu mismatches: %s\n",
+      angle_error, magnitude_error, rectangular_mismatches,
+      angle_error <= 2 && magnitude_error <= 1e-6f &&
+          rectangular_mismatches == 0 ? "PASS" : "FAIL");
+  
+  // Whole frame transformation, with the conversion selected at build time
+  // by USE_SIMD_FRAME_TRANSFORMATION.
+  static float texture_buffer[kMaxNumTextures * kNumBins];
+  static float fft_out[kMaxFftSize];
+  static float ifft_in[kMaxFftSize];
+  FrameTransformation transformation;
+  transformation.Init(texture_buffer, kMaxFftSize, kMaxNumTextures);
+  Parameters parameters;
+  memset(&parameters, 0, sizeof(Parameters));
+  parameters.position = 0.3f;
+  parameters.spectral.quantization = 0.3f;
+  parameters.spectral.refresh_rate = 0.7f;
+  parameters.spectral.phase_randomization = 0.2f;
+  parameters.spectral.warp = 0.5f;
+  
+  start = clock();
+  for (size_t i = 0; i < kNumIterations; ++i) {
+    copy(&real[0], &real[kNumBins], &fft_out[0]);
+    copy(&imag[0], &imag[kNumBins], &fft_out[kNumBins]);
+    transformation.Process(parameters, fft_out, ifft_in);
+  }
+  float process_time = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  printf("FrameTransformation::Process: %.2f us per %zu-point frame\n",
+      process_time * 1e6f / kNumIterations, kMaxFftSize);
+}
+
+void RecordSine(
+    GranularProcessor* processor,
+    float frequency,
+    size_t num_blocks) {
+  Parameters* p = processor->mutable_parameters();
+  float phase = 0.0f;
+  for (size_t block = 0; block < num_blocks; ++block) {
+    p->trigger = false;
+    p->freeze = false;
+    p->position = 0.5f;
+    p->size = 0.5f;
+    p->pitch = 0.0f;
+    p->density = 0.7f;
+    p->texture = 0.5f;
+    p->feedback = 0.0f;
+    p->dry_wet = 1.0f;
+    p->reverb = 0.0f;
+    p->stereo_spread = 0.0f;
+    ShortFrame input[kBlockSize];
+    ShortFrame output[kBlockSize];
+    for (size_t i = 0; i < kBlockSize; ++i) {
+      phase += frequency / kSampleRate;
+      if (phase >= 1.0f) {
+        phase -= 1.0f;
+      }
+      input[i].l = 16384.0f * sinf(phase * M_PI * 2);
+      input[i].r = -input[i].l;
+    }
+    processor->Process(input, output, kBlockSize);
+    processor->Prepare();
+  }
+}
+
+void ReadFile(const char* path, vector<uint8_t>* contents) {
+  FILE* fp = fopen(path, "rb");
+  uint8_t buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+    contents->insert(contents->end(), buffer, buffer + read);
+  }
+  fclose(fp);
+}
+
+void WriteFile(const char* path, const vector<uint8_t>& contents) {
+  FILE* fp = fopen(path, "wb");
+  fwrite(&contents[0], 1, contents.size(), fp);
+  fclose(fp);
+}
+
+void TestSnapshots() {
+  const size_t kNumSnapshots = 20;
+  // 30s of stereo 16-bit audio per snapshot, 1s of it recorded.
+  const size_t kSampleMemorySize = kSampleRate * 30 * 2 * 2;
+  const size_t kNumBlocks = kSampleRate / kBlockSize;
+  
+  static uint8_t large_buffer[118784];
+  static uint8_t small_buffer[65536 - 128];
+  static GranularProcessor processor;
+  processor.Init(
+      &large_buffer[0], sizeof(large_buffer),
+      &small_buffer[0], sizeof(small_buffer));
+  vector<uint8_t> sample_memory(kSampleMemorySize);
+  processor.set_sample_memory(&sample_memory[0], sample_memory.size());
+  processor.set_num_channels(2);
+  processor.set_low_fidelity(false);
+  processor.set_playback_mode(PLAYBACK_MODE_GRANULAR);
+  processor.Prepare();
+  
+  mkdir("snapshots", 0755);
+  SnapshotStore store;
+  store.Init("snapshots");
+  
+  char name[64];
+  vector<uint8_t> reference;
+  for (size_t i = 0; i < kNumSnapshots; ++i) {
+    RecordSine(&processor, 110.0f * (i + 1), kNumBlocks);
+    snprintf(name, sizeof(name), "raw_%zu", i);
+    store.Save(&processor, name, false);
+    snprintf(name, sizeof(name), "mu_law_%zu", i);
+    store.Save(&processor, name, true);
+    if (i == 0) {
+      reference = sample_memory;
+    }
+  }
+  
+  // Restores the first snapshot, and compares it with the recording. The
+  // raw snapshot must be identical; the mu-law one within the quantization
+  // error of mu-law (1/32nd of the amplitude, plus a few LSBs near 0).
+  PersistentBlock blocks[4];
+  size_t num_blocks;
+  const char* names[] = { "raw_0", "mu_law_0" };
+  for (size_t n = 0; n < 2; ++n) {
+    bool restored_ok = store.Restore(&processor, names[n]);
+    processor.GetPersistentData(blocks, &num_blocks);
+    size_t mismatches = 0;
+    size_t out_of_bound = 0;
+    int32_t error = 0;
+    for (size_t i = 1; i < num_blocks && restored_ok; ++i) {
+      const int16_t* restored = static_cast<const int16_t*>(blocks[i].data);
+      const int16_t* original = reinterpret_cast<const int16_t*>(
+          &reference[(i - 1) * blocks[i].size]);
+      for (size_t j = 0; j < blocks[i].size / 2; ++j) {
+        int32_t e = abs(restored[j] - original[j]);
+        int32_t tolerance = n == 0 ? 0 : abs(original[j]) / 32 + 8;
+        mismatches += e ? 1 : 0;
+        out_of_bound += e > tolerance ? 1 : 0;
+        error = max(error, e);
+      }
+    }
+    printf("%s: %zu blocks, %zu mismatches, max error %d: %s\n",
+        names[n], num_blocks, mismatches, error,
+        restored_ok && num_blocks == 3 && !out_of_bound ? "PASS" : "FAIL");
+  }
+  
+  // Corrupt snapshots must be rejected.
+  vector<uint8_t> file;
+  ReadFile("snapshots/raw_0.snapshot", &file);
+  SnapshotHeader header;
+  memcpy(&header, &file[0], sizeof(header));
+  size_t num_rejected = 0;
+  for (int32_t corruption = 0; corruption < 6; ++corruption) {
+    SnapshotHeader h = header;
+    size_t size = file.size();
+    switch (corruption) {
+      case 0: size -= 4096; break;  // Truncated.
+      case 1: h.block[2].stored_size /= 2; break;
+      case 2: h.block[1].encoding = SNAPSHOT_ENCODING_MU_LAW; break;
+      case 3: h.block[0].offset = file.size() - 4; break;
+      case 4: h.block[0].stored_size = 0; break;
+    }
+    vector<uint8_t> corrupt(file.begin(), file.begin() + size);
+    memcpy(&corrupt[0], &h, sizeof(h));
+    if (corruption == 5) {
+      // Write head outside of the buffer.
+      int32_t head = 0x7fffffff;
+      memcpy(&corrupt[h.block[0].offset], &head, sizeof(head));
+    }
+    WriteFile("snapshots/corrupt.snapshot", corrupt);
+    num_rejected += store.Restore(&processor, "corrupt") ? 0 : 1;
+  }
+  printf("corrupt snapshots: %zu/6 rejected: %s\n",
+      num_rejected, num_rejected == 6 ? "PASS" : "FAIL");
+  store.Remove("corrupt");
+  
+  // Switches between snapshots, playing one block of each.
+  for (size_t n = 0; n < 2; ++n) {
+    clock_t start = clock();
+    for (size_t i = 0; i < kNumSnapshots; ++i) {
+      snprintf(name, sizeof(name), n == 0 ? "raw_%zu" : "mu_law_%zu", i);
+      store.Restore(&processor, name);
+      RecordSine(&processor, 0.0f, 1);
+    }
+    float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    printf("%s snapshots: %.1f us per restore\n",
+        n == 0 ? "raw" : "mu-law",
+        elapsed * 1e6f / kNumSnapshots);
+  }
+  
+  // The same, reading the whole files and copying them with
+  // LoadPersistentData.
+  processor.set_sample_memory(&sample_memory[0], sample_memory.size());
+  processor.Prepare();
+  vector<uint32_t> data(kSampleMemorySize / 4 + 64);
+  clock_t start = clock();
+  for (size_t i = 0; i < kNumSnapshots; ++i) {
+    snprintf(name, sizeof(name), "snapshots/raw_%zu.snapshot", i);
+    FILE* fp = fopen(name, "rb");
+    SnapshotHeader header;
+    fread(&header, sizeof(header), 1, fp);
+    uint32_t* p = &data[0];
+    for (size_t j = 0; j < header.num_blocks; ++j) {
+      *p++ = header.block[j].tag;
+      *p++ = header.block[j].size;
+      fseek(fp, header.block[j].offset, SEEK_SET);
+      fread(p, 1, header.block[j].size, fp);
+      p += (header.block[j].size + 3) / 4;
+    }
+    fclose(fp);
+    processor.LoadPersistentData(&data[0]);
+    RecordSine(&processor, 0.0f, 1);
+  }
+  float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+  printf("copied snapshots: %.1f us per restore\n",
+      elapsed * 1e6f / kNumSnapshots);
+  
+  struct stat st[2];
+  stat("snapshots/raw_0.snapshot", &st[0]);
+  stat("snapshots/mu_law_0.snapshot", &st[1]);
+  printf("%.1f MB raw, %.1f MB mu-law\n",
+      st[0].st_size / 1048576.0f, st[1].st_size / 1048576.0f);
+  
+  for (size_t i = 0; i < kNumSnapshots; ++i) {
+    snprintf(name, sizeof(name), "raw_%zu", i);
+    store.Remove(name);
+    snprintf(name, sizeof(name), "mu_law_%zu", i);
+    store.Remove(name);
+  }
+  rmdir("snapshots");
+}
+
+void TestReverb() {
+  const size_t kNumSamples = 32000 * 20;
+  const size_t kBlockSizes[] = { 32, 64, 128, 256 };
+  static uint16_t buffer[2][16384];
+  static FloatFrame input[kNumSamples];
+  static FloatFrame output[2][kNumSamples];
+  
+  // Bursts of noise, to hear (and compare) both the attack and the tail.
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    float gate = (i % 32000) < 4000 ? 1.0f : 0.0f;
+    input[i].l = (Random::GetFloat() - 0.5f) * gate;
+    input[i].r = (Random::GetFloat() - 0.5f) * gate;
+  }
+  
+  for (size_t b = 0; b < sizeof(kBlockSizes) / sizeof(size_t); ++b) {
+    size_t block_size = kBlockSizes[b];
+    float elapsed[2];
+    for (int variant = 0; variant < 2; ++variant) {
+      Reverb reverb;
+      reverb.Init(buffer[variant]);
+      reverb.set_amount(0.54f);
+      reverb.set_diffusion(0.7f);
+      reverb.set_time(0.9f);
+      reverb.set_input_gain(0.2f);
+      reverb.set_lp(0.8f);
+      copy(&input[0], &input[kNumSamples], &output[variant][0]);
+      
+      clock_t start = clock();
+      for (size_t i = 0; i < kNumSamples; i += block_size) {
+        if (variant == 0) {
+          reverb.ProcessSamples(&output[variant][i], block_size);
+        } else {
+          reverb.ProcessBlocks(&output[variant][i], block_size);
+        }
+      }
+      elapsed[variant] = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    }
+    
+    size_t mismatches = 0;
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      if (output[0][i].l != output[1][i].l ||
+          output[0][i].r != output[1][i].r) {
+        ++mismatches;
+      }
+    }
+    printf("Reverb, %3zu samples blocks: sample by sample %.2f ns/sample, "
+        "by block %.2f ns/sample, %zu mismatches: %s\n",
+        block_size,
+        elapsed[0] * 1e9f / kNumSamples,
+        elapsed[1] * 1e9f / kNumSamples,
+        mismatches,
+        mismatches == 0 ? "PASS" : "FAIL");
+  }
+}
+
 int main(void) {
   _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
   TestDSP();
   // TestGrainSize();
+  // TestGrainThreads();
+  // TestGrainDensity();
+  // TestCorrelator();
+  // TestSampleMemory();
+  // TestSampleRates();
+  // TestSpectralMode();
+  // TestFFT();
+  // TestSTFT();
+  // TestFrameTransformation();
+  // TestSnapshots();
+  // TestReverb();
 }
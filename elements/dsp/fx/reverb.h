@@ -31,10 +31,21 @@
 
 #include "stmlib/stmlib.h"
 
+#include <algorithm>
+
 #include "elements/dsp/fx/fx_engine.h"
 
+// #define USE_BLOCK_REVERB
+
 namespace elements {
 
+// Must be shorter than the shortest delay.
+const size_t kMaxReverbBlockSize = 128;
+
+// AP1 is smeared with samples written only 10 to 90 samples earlier, so it
+// is processed by blocks of 8 samples.
+const size_t kReverbSmearBlockSize = 8;
+
 class Reverb {
  public:
   Reverb() { }
@@ -46,23 +57,23 @@ class Reverb {
     engine_.SetLFOFrequency(LFO_2, 0.3f / 32000.0f);
     lp_ = 0.7f;
     diffusion_ = 0.625f;
+    lp_decay_1_ = 0.0f;
+    lp_decay_2_ = 0.0f;
   }
   
   void Process(float* left, float* right, size_t size) {
+#ifdef USE_BLOCK_REVERB
+    ProcessBlocks(left, right, size);
+#else
+    ProcessSamples(left, right, size);
+#endif  // USE_BLOCK_REVERB
+  }
+
+  void ProcessSamples(float* left, float* right, size_t size) {
     // This is the Griesinger topology described in the Dattorro paper
     // (4 AP diffusers on the input, then a loop of 2x 2AP+1Delay).
     // Modulation is applied in the loop of the first diffuser AP for additional
     // smearing; and to the two long delays for a slow shimmer/chorus effect.
-    typedef E::Reserve<150,
-      E::Reserve<214,
-      E::Reserve<319,
-      E::Reserve<527,
-      E::Reserve<2182,
-      E::Reserve<2690,
-      E::Reserve<4501,
-      E::Reserve<2525,
-      E::Reserve<2197,
-      E::Reserve<6312> > > > > > > > > > Memory;
     E::DelayLine<Memory, 0> ap1;
     E::DelayLine<Memory, 1> ap2;
     E::DelayLine<Memory, 2> ap3;
@@ -140,6 +151,96 @@ class Reverb {
     lp_decay_2_ = lp_2;
   }
   
+  // Same as ProcessSamples, with each delay line processed
+  // kMaxReverbBlockSize samples at a time.
+  void ProcessBlocks(float* left, float* right, size_t size) {
+    E::DelayLine<Memory, 0> ap1;
+    E::DelayLine<Memory, 1> ap2;
+    E::DelayLine<Memory, 2> ap3;
+    E::DelayLine<Memory, 3> ap4;
+    E::DelayLine<Memory, 4> dap1a;
+    E::DelayLine<Memory, 5> dap1b;
+    E::DelayLine<Memory, 6> del1;
+    E::DelayLine<Memory, 7> dap2a;
+    E::DelayLine<Memory, 8> dap2b;
+    E::DelayLine<Memory, 9> del2;
+    E::BlockContext<kMaxReverbBlockSize> c;
+
+    const float kap = diffusion_;
+    const float klp = lp_;
+    const float krt = reverb_time_;
+    const float amount = amount_;
+    const float gain = input_gain_;
+
+    float lp_1 = lp_decay_1_;
+    float lp_2 = lp_decay_2_;
+
+    float input[kMaxReverbBlockSize];
+    float apout[kMaxReverbBlockSize];
+    float wet[kMaxReverbBlockSize];
+
+    while (size) {
+      size_t block_size = std::min(size, kMaxReverbBlockSize);
+      engine_.Start(&c, block_size);
+      for (size_t i = 0; i < block_size; ++i) {
+        input[i] = left[i] + right[i];
+      }
+
+      for (size_t i = 0; i < block_size; i += kReverbSmearBlockSize) {
+        c.SetRange(i, std::min(i + kReverbSmearBlockSize, block_size));
+        c.Interpolate(ap1, 10.0f, LFO_1, 80.0f, 1.0f);
+        c.Write(ap1, 100, 0.0f);
+        c.Read(input, gain);
+        c.Read(ap1 TAIL, kap);
+        c.WriteAllPass(ap1, -kap);
+      }
+      c.ResetRange();
+
+      c.Read(ap2 TAIL, kap);
+      c.WriteAllPass(ap2, -kap);
+      c.Read(ap3 TAIL, kap);
+      c.WriteAllPass(ap3, -kap);
+      c.Read(ap4 TAIL, kap);
+      c.WriteAllPass(ap4, -kap);
+      c.Write(apout);
+
+      c.Load(apout);
+      c.Interpolate(del2, 6211.0f, LFO_2, 100.0f, krt);
+      c.Lp(lp_1, klp);
+      c.Read(dap1a TAIL, -kap);
+      c.WriteAllPass(dap1a, kap);
+      c.Read(dap1b TAIL, kap);
+      c.WriteAllPass(dap1b, -kap);
+      c.Write(del1, 2.0f);
+      c.Write(wet, 0.0f);
+
+      for (size_t i = 0; i < block_size; ++i) {
+        left[i] += (wet[i] - left[i]) * amount;
+      }
+
+      c.Load(apout);
+      c.Read(del1 TAIL, krt);
+      c.Lp(lp_2, klp);
+      c.Read(dap2a TAIL, kap);
+      c.WriteAllPass(dap2a, -kap);
+      c.Read(dap2b TAIL, -kap);
+      c.WriteAllPass(dap2b, kap);
+      c.Write(del2, 2.0f);
+      c.Write(wet, 0.0f);
+
+      for (size_t i = 0; i < block_size; ++i) {
+        right[i] += (wet[i] - right[i]) * amount;
+      }
+
+      left += block_size;
+      right += block_size;
+      size -= block_size;
+    }
+
+    lp_decay_1_ = lp_1;
+    lp_decay_2_ = lp_2;
+  }
+  
   inline void set_amount(float amount) {
     amount_ = amount;
   }
@@ -162,6 +263,17 @@ class Reverb {
   
  private:
   typedef FxEngine<32768, FORMAT_16_BIT> E;
+  typedef E::Reserve<150,
+    E::Reserve<214,
+    E::Reserve<319,
+    E::Reserve<527,
+    E::Reserve<2182,
+    E::Reserve<2690,
+    E::Reserve<4501,
+    E::Reserve<2525,
+    E::Reserve<2197,
+    E::Reserve<6312> > > > > > > > > > Memory;
+
   E engine_;
   
   float amount_;
@@ -17,6 +17,7 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
 #include <xmmintrin.h>
 
 #include "elements/dsp/exciter.h"
@@ -491,6 +492,62 @@ void TestFilterAccuracy() {
 }
 
 
+void TestReverb() {
+  const size_t kNumSamples = ::kSampleRate * 10;
+  const size_t kBlockSizes[] = { 32, 64, 128, 256 };
+  static uint16_t reverb_buffer[2][32768];
+  static float in_l[kNumSamples];
+  static float in_r[kNumSamples];
+  static float l[2][kNumSamples];
+  static float r[2][kNumSamples];
+  
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    float gate = (i % ::kSampleRate) < (::kSampleRate / 8) ? 1.0f : 0.0f;
+    in_l[i] = (Random::GetFloat() - 0.5f) * gate;
+    in_r[i] = (Random::GetFloat() - 0.5f) * gate;
+  }
+  
+  for (size_t b = 0; b < sizeof(kBlockSizes) / sizeof(size_t); ++b) {
+    size_t block_size = kBlockSizes[b];
+    float elapsed[2];
+    for (int variant = 0; variant < 2; ++variant) {
+      Reverb reverb;
+      reverb.Init(variant == 0 ? reverb_buffer[0] : reverb_buffer[1]);
+      reverb.set_amount(0.5f);
+      reverb.set_diffusion(0.625f);
+      reverb.set_time(0.9f);
+      reverb.set_input_gain(0.2f);
+      reverb.set_lp(0.6f);
+      std::copy(&in_l[0], &in_l[kNumSamples], &l[variant][0]);
+      std::copy(&in_r[0], &in_r[kNumSamples], &r[variant][0]);
+      
+      clock_t start = clock();
+      for (size_t i = 0; i < kNumSamples; i += block_size) {
+        if (variant == 0) {
+          reverb.ProcessSamples(&l[variant][i], &r[variant][i], block_size);
+        } else {
+          reverb.ProcessBlocks(&l[variant][i], &r[variant][i], block_size);
+        }
+      }
+      elapsed[variant] = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    }
+    
+    size_t mismatches = 0;
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      if (l[0][i] != l[1][i] || r[0][i] != r[1][i]) {
+        ++mismatches;
+      }
+    }
+    printf("Reverb, %3zu samples blocks: sample by sample %.2f ns/sample, "
+        "by block %.2f ns/sample, %zu mismatches: %s\n",
+        block_size,
+        elapsed[0] * 1e9f / kNumSamples,
+        elapsed[1] * 1e9f / kNumSamples,
+        mismatches,
+        mismatches == 0 ? "PASS" : "FAIL");
+  }
+}
+
 int main(void) {
   _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
   // TestFilterAccuracy();
@@ -498,4 +555,5 @@ int main(void) {
   // TestExciter();
   // TestResonator();
   // TestEasterEgg();
+  // TestReverb();
 }
@@ -0,0 +1,291 @@
+// Copyright 2016 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Parameter automation scripts of the offline renderers of the modules
+// (plaits_render, clouds_batch): lists of timed events, each setting some of
+// the fields named by a table of the renderer. See plaits_render.cc for the
+// CSV and JSON formats. Host only.
+
+#ifndef HOST_EVENT_SCRIPT_H_
+#define HOST_EVENT_SCRIPT_H_
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "stmlib/stmlib.h"
+
+namespace host {
+
+template<int num_fields>
+struct ScriptEvent {
+  float time;
+  uint32_t mask;
+  float value[num_fields];
+
+  ScriptEvent() : time(0.0f), mask(0) { }
+
+  void Set(int field, float v) {
+    mask |= 1 << field;
+    value[field] = v;
+  }
+
+  bool operator<(const ScriptEvent& other) const {
+    return time < other.time;
+  }
+};
+
+// field_names is an array of num_fields names.
+template<int num_fields>
+class EventScriptParser {
+ public:
+  typedef ScriptEvent<num_fields> Event;
+
+  explicit EventScriptParser(const char* const* field_names)
+      : field_names_(field_names) { }
+  ~EventScriptParser() { }
+
+  // Parses a CSV or JSON script, and sorts its events by time.
+  bool Load(const char* file_name, std::vector<Event>* events) const {
+    std::string text;
+    if (!ReadFile(file_name, &text)) {
+      fprintf(stderr, "Cannot read %s\n", file_name);
+      return false;
+    }
+    size_t first = text.find_first_not_of(" \t\r\n");
+    bool json = first != std::string::npos && \
+        (text[first] == '[' || text[first] == '{');
+    if (!(json ? ParseJSON(text, events) : ParseCSV(text, events))) {
+      return false;
+    }
+    std::stable_sort(events->begin(), events->end());
+    return true;
+  }
+
+  // Checks that all the values of a field used as an index (an engine or a
+  // mode number) are between 0 and num_values - 1. Fractional values are
+  // truncated by the renderers.
+  bool CheckIndex(
+      const std::vector<Event>& events,
+      int field,
+      int num_values) const {
+    for (size_t i = 0; i < events.size(); ++i) {
+      const Event& e = events[i];
+      if (!(e.mask & (1 << field))) {
+        continue;
+      }
+      float value = e.value[field];
+      if (!(value >= 0.0f && value < static_cast<float>(num_values))) {
+        fprintf(stderr, "Invalid %s at %gs: %g (0 to %d)\n",
+            field_names_[field], e.time, value, num_values - 1);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool ParseCSV(const std::string& text, std::vector<Event>* events) const {
+    std::vector<int> columns;
+    std::vector<std::string> cells;
+    int time_column = -1;
+    size_t start = 0;
+    int line_number = 0;
+    while (start < text.size()) {
+      size_t end = text.find('\n', start);
+      std::string line = Trim(text.substr(start, end - start));
+      start = end == std::string::npos ? text.size() : end + 1;
+      ++line_number;
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      Split(line, &cells);
+      if (columns.empty()) {
+        for (size_t i = 0; i < cells.size(); ++i) {
+          if (cells[i] == "time") {
+            time_column = i;
+          } else if (FieldIndex(cells[i]) == -1) {
+            fprintf(stderr, "Unknown column: %s\n", cells[i].c_str());
+            return false;
+          }
+          columns.push_back(FieldIndex(cells[i]));
+        }
+        if (time_column == -1) {
+          fprintf(stderr, "Missing time column\n");
+          return false;
+        }
+        continue;
+      }
+      Event e;
+      for (size_t i = 0; i < cells.size() && i < columns.size(); ++i) {
+        if (cells[i].empty()) {
+          continue;
+        }
+        char* parse_end;
+        float value = strtof(cells[i].c_str(), &parse_end);
+        if (*parse_end) {
+          fprintf(stderr, "Line %d: invalid value %s\n", line_number,
+              cells[i].c_str());
+          return false;
+        }
+        if (static_cast<int>(i) == time_column) {
+          if (!(value >= 0.0f)) {
+            fprintf(stderr, "Line %d: invalid time %s\n", line_number,
+                cells[i].c_str());
+            return false;
+          }
+          e.time = value;
+        } else {
+          e.Set(columns[i], value);
+        }
+      }
+      events->push_back(e);
+    }
+    return true;
+  }
+
+  // Only understands what the scripts need: objects (possibly nested in a
+  // list or in another object) made of numeric or boolean members.
+  bool ParseJSON(const std::string& text, std::vector<Event>* events) const {
+    size_t p = 0;
+    while ((p = text.find('{', p)) != std::string::npos) {
+      size_t end = text.find_first_of("{}", p + 1);
+      if (end == std::string::npos) {
+        fprintf(stderr, "Unterminated object\n");
+        return false;
+      }
+      if (text[end] == '{') {
+        // Not an event, but a container for events.
+        p = end;
+        continue;
+      }
+
+      Event e;
+      bool has_time = false;
+      std::string object = text.substr(p + 1, end - p - 1);
+      size_t q = 0;
+      while ((q = object.find('"', q)) != std::string::npos) {
+        size_t name_end = object.find('"', q + 1);
+        size_t colon = object.find(':', name_end);
+        if (name_end == std::string::npos || colon == std::string::npos) {
+          fprintf(stderr, "Invalid object: {%s}\n", object.c_str());
+          return false;
+        }
+        std::string name = object.substr(q + 1, name_end - q - 1);
+        size_t value_end = object.find(',', colon);
+        std::string value_string = Trim(
+            object.substr(colon + 1, value_end - colon - 1));
+        float value;
+        if (value_string == "true") {
+          value = 1.0f;
+        } else if (value_string == "false") {
+          value = 0.0f;
+        } else {
+          char* parse_end;
+          value = strtof(value_string.c_str(), &parse_end);
+          if (value_string.empty() || *parse_end) {
+            fprintf(stderr, "Invalid value for %s: %s\n", name.c_str(),
+                value_string.c_str());
+            return false;
+          }
+        }
+        if (name == "time") {
+          if (!(value >= 0.0f)) {
+            fprintf(stderr, "Invalid time: {%s}\n", object.c_str());
+            return false;
+          }
+          e.time = value;
+          has_time = true;
+        } else if (FieldIndex(name) != -1) {
+          e.Set(FieldIndex(name), value);
+        } else {
+          fprintf(stderr, "Unknown field: %s\n", name.c_str());
+          return false;
+        }
+        q = value_end == std::string::npos ? object.size() : value_end + 1;
+      }
+      if (!has_time) {
+        fprintf(stderr, "Event without time: {%s}\n", object.c_str());
+        return false;
+      }
+      events->push_back(e);
+      p = end + 1;
+    }
+    return true;
+  }
+
+ private:
+  int FieldIndex(const std::string& name) const {
+    for (int i = 0; i < num_fields; ++i) {
+      if (name == field_names_[i]) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  static bool ReadFile(const char* file_name, std::string* contents) {
+    FILE* fp = fopen(file_name, "rb");
+    if (!fp) {
+      return false;
+    }
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+      contents->append(buffer, read);
+    }
+    fclose(fp);
+    return true;
+  }
+
+  static std::string Trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r\n\"");
+    size_t end = s.find_last_not_of(" \t\r\n\"");
+    return start == std::string::npos ? "" : s.substr(start, end - start + 1);
+  }
+
+  static void Split(const std::string& line, std::vector<std::string>* cells) {
+    cells->clear();
+    size_t start = 0;
+    while (true) {
+      size_t comma = line.find(',', start);
+      cells->push_back(Trim(line.substr(start, comma - start)));
+      if (comma == std::string::npos) {
+        break;
+      }
+      start = comma + 1;
+    }
+  }
+
+  const char* const* field_names_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventScriptParser);
+};
+
+}  // namespace host
+
+#endif  // HOST_EVENT_SCRIPT_H_
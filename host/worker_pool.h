@@ -0,0 +1,166 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Pool of threads running the same task on each block, for the host builds of
+// the modules (clouds with -DUSE_GRAIN_THREADS, rings' PartEnsemble). Host
+// only. The calling thread takes part in the work: it is worker 0. There are
+// never more workers than cores: a worker waiting for a block would keep
+// another one from running.
+
+#ifndef HOST_WORKER_POOL_H_
+#define HOST_WORKER_POOL_H_
+
+#include "stmlib/stmlib.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <xmmintrin.h>
+
+namespace host {
+
+const int32_t kMaxNumWorkers = 16;
+
+// Polling iterations before a waiting thread starts yielding its time slice
+// (so that it does not keep the other workers from running when there are
+// fewer cores than workers), then before an idle worker goes to sleep. Blocks
+// are about 1ms apart, so workers do not sleep while audio is running.
+const int32_t kWorkerSpinCount = 1000;
+const int32_t kWorkerSleepCount = 100000;
+
+class WorkerPool {
+ public:
+  typedef void (*Task)(void* context, int32_t worker, int32_t num_workers);
+  
+  WorkerPool() : num_workers_(1), generation_(0), stop_(false) { }
+  ~WorkerPool() { Stop(); }
+  
+  void Init(int32_t num_workers) {
+    Stop();
+    if (num_workers > kMaxNumWorkers) {
+      num_workers = kMaxNumWorkers;
+    }
+    int32_t num_cores = std::thread::hardware_concurrency();
+    if (num_cores && num_workers > num_cores) {
+      num_workers = num_cores;
+    }
+    num_workers_ = num_workers < 1 ? 1 : num_workers;
+    stop_ = false;
+    uint32_t generation = generation_.load(std::memory_order_relaxed);
+    for (int32_t i = 1; i < num_workers_; ++i) {
+      threads_[i] = std::thread(&WorkerPool::Work, this, i, generation);
+    }
+  }
+  
+  void Stop() {
+    if (num_workers_ == 1) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      generation_.fetch_add(1, std::memory_order_release);
+    }
+    condition_.notify_all();
+    for (int32_t i = 1; i < num_workers_; ++i) {
+      threads_[i].join();
+    }
+    num_workers_ = 1;
+  }
+  
+  // Runs the task on all workers and returns once they are all done.
+  void Run(Task task, void* context) {
+    task_ = task;
+    context_ = context;
+    pending_.store(num_workers_ - 1, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      generation_.fetch_add(1, std::memory_order_release);
+    }
+    condition_.notify_all();
+    task(context, 0, num_workers_);
+    int32_t count = 0;
+    while (pending_.load(std::memory_order_acquire)) {
+      Backoff(&count);
+    }
+  }
+  
+  inline int32_t num_workers() const { return num_workers_; }
+
+ private:
+  static inline void Backoff(int32_t* count) {
+    if (*count < kWorkerSpinCount) {
+      _mm_pause();
+      ++*count;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  
+  void Work(int32_t worker, uint32_t done) {
+    while (true) {
+      uint32_t generation;
+      int32_t count = 0;
+      int32_t remaining = kWorkerSleepCount;
+      while ((generation = generation_.load(std::memory_order_acquire)) == \
+                 done && remaining--) {
+        Backoff(&count);
+      }
+      if (generation == done) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while ((generation = generation_.load(std::memory_order_acquire)) == \
+                   done) {
+          condition_.wait(lock);
+        }
+      }
+      done = generation;
+      if (stop_) {
+        return;
+      }
+      task_(context_, worker, num_workers_);
+      pending_.fetch_sub(1, std::memory_order_release);
+    }
+  }
+  
+  int32_t num_workers_;
+  Task task_;
+  void* context_;
+  
+  std::atomic<uint32_t> generation_;
+  std::atomic<int32_t> pending_;
+  bool stop_;
+  
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::thread threads_[kMaxNumWorkers];
+  
+  DISALLOW_COPY_AND_ASSIGN(WorkerPool);
+};
+
+}  // namespace host
+
+#endif  // HOST_WORKER_POOL_H_
@@ -58,6 +58,10 @@ class SpeechEngine : public Engine {
   inline void set_speed(float speed) {
     speed_ = speed;
   }
+  
+  inline void set_word_bank_cache(const LPCSpeechSynthWordBankCache* cache) {
+    lpc_speech_synth_word_bank_.set_cache(cache);
+  }
 
  private:
   stmlib::HysteresisQuantizer word_bank_quantizer_;
@@ -71,16 +71,24 @@ inline float Clamp(float x, float amount) {
 const size_t table_size = 256;
 const float table_size_f = float(table_size);
 
+template<bool mipmapped>
 inline float ReadWave(
     int x,
     int y,
     int z,
     int randomize,
     int phase_integral,
-    float phase_fractional) {
+    float phase_fractional,
+    const int16_t* waves) {
   int wave = ((x + y * 8 + z * 64) * randomize) % 192;
+  if (mipmapped) {
+    return InterpolateWave(
+        waves + wave * (table_size + 1),
+        phase_integral,
+        phase_fractional);
+  }
   return InterpolateWaveHermite(
-      wav_integrated_waves + wave * (table_size + 4),
+      waves + wave * (table_size + 4),
       phase_integral,
       phase_fractional);
 }
@@ -122,15 +130,43 @@ void WavetableEngine::Render(
 
   ParameterInterpolator f0_modulation(&previous_f0_, f0, size);
   
+  // The octave is chosen once per block, for the highest frequency reached.
+  if (mipmaps_) {
+    RenderWaves<true>(
+        mipmaps_->level(WavetableMipmaps::level_for_frequency(
+            max(f0, previous_f0_))),
+        lp_coefficient,
+        &x_modulation, &y_modulation, &z_modulation, &f0_modulation,
+        out, aux, size);
+  } else {
+    RenderWaves<false>(
+        wav_integrated_waves,
+        lp_coefficient,
+        &x_modulation, &y_modulation, &z_modulation, &f0_modulation,
+        out, aux, size);
+  }
+}
+
+template<bool mipmapped>
+void WavetableEngine::RenderWaves(
+    const int16_t* waves,
+    float lp_coefficient,
+    ParameterInterpolator* x_modulation,
+    ParameterInterpolator* y_modulation,
+    ParameterInterpolator* z_modulation,
+    ParameterInterpolator* f0_modulation,
+    float* out,
+    float* aux,
+    size_t size) {
   while (size--) {
-    const float f0 = f0_modulation.Next();
+    const float f0 = f0_modulation->Next();
     
     const float gain = (1.0f / (f0 * 131072.0f)) * (0.95f - f0);
     const float cutoff = min(table_size_f * f0, 1.0f);
     
-    ONE_POLE(x_lp_, x_modulation.Next(), lp_coefficient);
-    ONE_POLE(y_lp_, y_modulation.Next(), lp_coefficient);
-    ONE_POLE(z_lp_, z_modulation.Next(), lp_coefficient);
+    ONE_POLE(x_lp_, x_modulation->Next(), lp_coefficient);
+    ONE_POLE(y_lp_, y_modulation->Next(), lp_coefficient);
+    ONE_POLE(z_lp_, z_modulation->Next(), lp_coefficient);
     
     const float x = x_lp_;
     const float y = y_lp_;
@@ -166,28 +202,38 @@ void WavetableEngine::Render(
       int r0 = z0 == 3 ? 101 : 1;
       int r1 = z1 == 3 ? 101 : 1;
 
-      float x0y0z0 = ReadWave(x0, y0, z0, r0, p_integral, p_fractional);
-      float x1y0z0 = ReadWave(x1, y0, z0, r0, p_integral, p_fractional);
+      float x0y0z0 = ReadWave<mipmapped>(
+          x0, y0, z0, r0, p_integral, p_fractional, waves);
+      float x1y0z0 = ReadWave<mipmapped>(
+          x1, y0, z0, r0, p_integral, p_fractional, waves);
       float xy0z0 = x0y0z0 + (x1y0z0 - x0y0z0) * x_fractional;
 
-      float x0y1z0 = ReadWave(x0, y1, z0, r0, p_integral, p_fractional); 
-      float x1y1z0 = ReadWave(x1, y1, z0, r0, p_integral, p_fractional);
+      float x0y1z0 = ReadWave<mipmapped>(
+          x0, y1, z0, r0, p_integral, p_fractional, waves); 
+      float x1y1z0 = ReadWave<mipmapped>(
+          x1, y1, z0, r0, p_integral, p_fractional, waves);
       float xy1z0 = x0y1z0 + (x1y1z0 - x0y1z0) * x_fractional;
 
       float xyz0 = xy0z0 + (xy1z0 - xy0z0) * y_fractional;
 
-      float x0y0z1 = ReadWave(x0, y0, z1, r1, p_integral, p_fractional);
-      float x1y0z1 = ReadWave(x1, y0, z1, r1, p_integral, p_fractional);
+      float x0y0z1 = ReadWave<mipmapped>(
+          x0, y0, z1, r1, p_integral, p_fractional, waves);
+      float x1y0z1 = ReadWave<mipmapped>(
+          x1, y0, z1, r1, p_integral, p_fractional, waves);
       float xy0z1 = x0y0z1 + (x1y0z1 - x0y0z1) * x_fractional;
 
-      float x0y1z1 = ReadWave(x0, y1, z1, r1, p_integral, p_fractional);
-      float x1y1z1 = ReadWave(x1, y1, z1, r1, p_integral, p_fractional);
+      float x0y1z1 = ReadWave<mipmapped>(
+          x0, y1, z1, r1, p_integral, p_fractional, waves);
+      float x1y1z1 = ReadWave<mipmapped>(
+          x1, y1, z1, r1, p_integral, p_fractional, waves);
       float xy1z1 = x0y1z1 + (x1y1z1 - x0y1z1) * x_fractional;
       
       float xyz1 = xy0z1 + (xy1z1 - xy0z1) * y_fractional;
 
       float mix = xyz0 + (xyz1 - xyz0) * z_fractional;
-      mix = diff_out_.Process(cutoff, mix) * gain;
+      mix = mipmapped
+          ? mix * (0.95f - f0) * (1.0f / kWavetableMipmapsFullScale)
+          : diff_out_.Process(cutoff, mix) * gain;
       *out++ = mix;
       *aux++ = static_cast<float>(static_cast<int>(mix * 32.0f)) / 32.0f;
     }
@@ -32,13 +32,14 @@
 #include "stmlib/dsp/hysteresis_quantizer.h"
 
 #include "plaits/dsp/engine/engine.h"
+#include "plaits/dsp/oscillator/wavetable_mipmaps.h"
 #include "plaits/dsp/oscillator/wavetable_oscillator.h"
 
 namespace plaits {
 
 class WavetableEngine : public Engine {
  public:
-  WavetableEngine() { }
+  WavetableEngine() : mipmaps_(NULL) { }
   ~WavetableEngine() { }
   
   virtual void Init(stmlib::BufferAllocator* allocator);
@@ -49,7 +50,28 @@ class WavetableEngine : public Engine {
       size_t size,
       bool* already_enveloped);
   
+  // When a mapped pyramid is provided, the waves are read from the octave
+  // matching the note instead of being differentiated from the integrated
+  // waves: no aliasing, and linear interpolation is enough.
+  inline void set_mipmaps(const WavetableMipmaps* mipmaps) {
+    mipmaps_ = mipmaps && mipmaps->mapped() ? mipmaps : NULL;
+  }
+  
  private:
+  // The source of the waves is fixed for a whole block, so that the choice
+  // between the two costs nothing per sample.
+  template<bool mipmapped>
+  void RenderWaves(
+      const int16_t* waves,
+      float lp_coefficient,
+      stmlib::ParameterInterpolator* x_modulation,
+      stmlib::ParameterInterpolator* y_modulation,
+      stmlib::ParameterInterpolator* z_modulation,
+      stmlib::ParameterInterpolator* f0_modulation,
+      float* out,
+      float* aux,
+      size_t size);
+
   float phase_;
   
   float x_pre_lp_;
@@ -67,6 +89,8 @@ class WavetableEngine : public Engine {
   
   Differentiator diff_out_;
   
+  const WavetableMipmaps* mipmaps_;
+  
   DISALLOW_COPY_AND_ASSIGN(WavetableEngine);
 };
 
@@ -0,0 +1,95 @@
+// Copyright 2016 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Band-limited mipmap pyramid of the wavetables, memory-mapped from a file
+// generated by plaits/resources/wavetable_mipmaps.py. Host only.
+
+#include "plaits/dsp/oscillator/wavetable_mipmaps.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace plaits {
+
+bool WavetableMipmaps::Map(const char* file_name) {
+  Unmap();
+  
+  int fd = open(file_name, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  
+  const size_t data_size = kWavetableMipmapsNumLevels * \
+      kWavetableMipmapsNumWaves * (kWavetableMipmapsTableSize + 1) * \
+      sizeof(int16_t);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != \
+          kWavetableMipmapsHeaderSize + data_size) {
+    close(fd);
+    return false;
+  }
+  
+  void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  
+  const uint32_t expected[4] = {
+    1,
+    kWavetableMipmapsNumWaves,
+    kWavetableMipmapsNumLevels,
+    kWavetableMipmapsTableSize
+  };
+  uint32_t header[4];
+  memcpy(header, static_cast<const uint8_t*>(mapping) + 4, sizeof(header));
+  if (memcmp(mapping, "PWMM", 4) != 0 ||
+      memcmp(header, expected, sizeof(header)) != 0) {
+    munmap(mapping, st.st_size);
+    return false;
+  }
+  
+  mapping_ = mapping;
+  mapping_size_ = st.st_size;
+  data_ = reinterpret_cast<const int16_t*>(
+      static_cast<const uint8_t*>(mapping) + kWavetableMipmapsHeaderSize);
+  return true;
+}
+
+void WavetableMipmaps::Unmap() {
+  if (mapping_) {
+    munmap(mapping_, mapping_size_);
+  }
+  mapping_ = NULL;
+  mapping_size_ = 0;
+  data_ = NULL;
+}
+
+}  // namespace plaits
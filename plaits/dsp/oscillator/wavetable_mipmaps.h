@@ -0,0 +1,85 @@
+// Copyright 2016 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Band-limited mipmap pyramid of the wavetables, memory-mapped from a file
+// generated by plaits/resources/wavetable_mipmaps.py. Host only.
+
+#ifndef PLAITS_DSP_OSCILLATOR_WAVETABLE_MIPMAPS_H_
+#define PLAITS_DSP_OSCILLATOR_WAVETABLE_MIPMAPS_H_
+
+#include "stmlib/stmlib.h"
+
+namespace plaits {
+
+const int kWavetableMipmapsNumWaves = 192;
+const int kWavetableMipmapsNumLevels = 8;
+const int kWavetableMipmapsTableSize = 256;
+const size_t kWavetableMipmapsHeaderSize = 32;
+const float kWavetableMipmapsFullScale = 16384.0f;
+
+class WavetableMipmaps {
+ public:
+  WavetableMipmaps() : mapping_(NULL), mapping_size_(0), data_(NULL) { }
+  ~WavetableMipmaps() { Unmap(); }
+  
+  // Returns false if the file cannot be mapped or if its layout does not match
+  // the one expected by the engine.
+  bool Map(const char* file_name);
+  void Unmap();
+  
+  inline bool mapped() const { return data_ != NULL; }
+  
+  // Level 0 contains the first 127 harmonics of each wave, level n the first
+  // 128 >> n harmonics.
+  inline const int16_t* level(int index) const {
+    return data_ + index * kWavetableMipmapsNumWaves * \
+        (kWavetableMipmapsTableSize + 1);
+  }
+  
+  // Returns the first level without harmonics above Nyquist for a given
+  // frequency (as a fraction of the sample rate).
+  static inline int level_for_frequency(float f0) {
+    int level = 0;
+    float max_frequency = static_cast<float>(
+        kWavetableMipmapsTableSize >> 1) * f0;
+    while (max_frequency > 0.5f && level < kWavetableMipmapsNumLevels - 1) {
+      max_frequency *= 0.5f;
+      ++level;
+    }
+    return level;
+  }
+
+ private:
+  void* mapping_;
+  size_t mapping_size_;
+  const int16_t* data_;
+  
+  DISALLOW_COPY_AND_ASSIGN(WavetableMipmaps);
+};
+
+}  // namespace plaits
+
+#endif  // PLAITS_DSP_OSCILLATOR_WAVETABLE_MIPMAPS_H_
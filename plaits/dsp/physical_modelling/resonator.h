@@ -34,11 +34,23 @@
 namespace plaits {
 
 const int kMaxNumModes = 24;
+
+// On AVX hosts, batches of 8 modes are processed with 8-wide vector
+// instructions (about 1.7x faster). With SSE only, GCC already vectorizes the
+// scalar loop, so it is used everywhere else, firmware included.
+#if defined(__AVX__)
+const int kModeVectorSize = 8;
+const int kModeBatchSize = 8;
+#else
+const int kModeVectorSize = 1;
 const int kModeBatchSize = 4;
+#endif  // __AVX__
 
 // We render 4 modes simultaneously since there are enough registers to hold
 // all state variables.
-template<int batch_size>
+template<
+    int batch_size,
+    bool vectorized = (kModeVectorSize > 1 && batch_size % kModeVectorSize == 0)>
 class ResonatorSvf {
  public:
   ResonatorSvf() { }
@@ -105,6 +117,92 @@ class ResonatorSvf {
   DISALLOW_COPY_AND_ASSIGN(ResonatorSvf);
 };
 
+#if defined(__AVX__)
+
+// Same as above, with kModeVectorSize modes per instruction. The modes are
+// summed in a different order, so the output of AVX builds differs from the
+// scalar version by a few LSBs (below 5e-7 for a full-scale signal).
+template<int batch_size>
+class ResonatorSvf<batch_size, true> {
+ public:
+  ResonatorSvf() { }
+  ~ResonatorSvf() { }
+  
+  typedef float Vector __attribute__((
+      vector_size(sizeof(float) * kModeVectorSize)));
+  
+  void Init() {
+    for (int i = 0; i < kNumVectors; ++i) {
+      state_1_[i] = state_2_[i] = Vector();
+    }
+  }
+  
+  template<stmlib::FilterMode mode, bool add>
+  void Process(
+      const float* f,
+      const float* q,
+      const float* gain,
+      const float* in,
+      float* out,
+      size_t size) {
+    Vector g[kNumVectors];
+    Vector r_plus_g[kNumVectors];
+    Vector h[kNumVectors];
+    Vector state_1[kNumVectors];
+    Vector state_2[kNumVectors];
+    Vector gains[kNumVectors];
+    for (int i = 0; i < kNumVectors; ++i) {
+      for (int j = 0; j < kModeVectorSize; ++j) {
+        const int n = i * kModeVectorSize + j;
+        const float g_n = stmlib::OnePole::tan<stmlib::FREQUENCY_FAST>(f[n]);
+        const float r_n = 1.0f / q[n];
+        g[i][j] = g_n;
+        r_plus_g[i][j] = r_n + g_n;
+        h[i][j] = 1.0f / (1.0f + r_n * g_n + g_n * g_n);
+        gains[i][j] = gain[n];
+      }
+      state_1[i] = state_1_[i];
+      state_2[i] = state_2_[i];
+    }
+    
+    while (size--) {
+      const float s_in = *in++;
+      Vector s_out = Vector();
+      for (int i = 0; i < kNumVectors; ++i) {
+        const Vector hp = (s_in - r_plus_g[i] * state_1[i] - state_2[i]) * h[i];
+        const Vector bp = g[i] * hp + state_1[i];
+        state_1[i] = g[i] * hp + bp;
+        const Vector lp = g[i] * bp + state_2[i];
+        state_2[i] = g[i] * bp + lp;
+        s_out += gains[i] * ((mode == stmlib::FILTER_MODE_LOW_PASS) ? lp : bp);
+      }
+      float sum = 0.0f;
+      for (int j = 0; j < kModeVectorSize; ++j) {
+        sum += s_out[j];
+      }
+      if (add) {
+        *out++ += sum;
+      } else {
+        *out++ = sum;
+      }
+    }
+    for (int i = 0; i < kNumVectors; ++i) {
+      state_1_[i] = state_1[i];
+      state_2_[i] = state_2[i];
+    }
+  }
+  
+ private:
+  static const int kNumVectors = batch_size / kModeVectorSize;
+  
+  Vector state_1_[kNumVectors];
+  Vector state_2_[kNumVectors];
+  
+  DISALLOW_COPY_AND_ASSIGN(ResonatorSvf);
+};
+
+#endif  // __AVX__
+
 class Resonator {
  public:
   Resonator() { }
@@ -0,0 +1,193 @@
+// Copyright 2016 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Bank of voices rendered together.
+//
+// Instead of running the complete Voice::Render() for each voice in turn, the
+// control-rate code is run for all voices, then the voices are grouped by
+// active engine so that each engine's code and lookup tables are used by
+// several voices in a row, and finally the post-processing is applied. The
+// engine outputs are stored in planar buffers, one row per voice.
+//
+// The engines still render one voice at a time: they are not vectorized
+// across voices, and the grouping alone does not make the rendering faster
+// than calling Voice::Render() on each voice (TestPolyVoice measures both).
+// The output is sample-identical to Voice::Render().
+
+#ifndef PLAITS_DSP_POLY_VOICE_H_
+#define PLAITS_DSP_POLY_VOICE_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+#include "stmlib/utils/buffer_allocator.h"
+
+#include "plaits/dsp/voice.h"
+
+namespace plaits {
+
+template<int max_voices>
+class PolyVoice {
+ public:
+  PolyVoice() { }
+  ~PolyVoice() { }
+  
+  // The voices share all the RAM left in the allocator. The RAM needed by
+  // the engines is measured on the first voice, and each voice then gets
+  // exactly this amount. Returns false if there is not enough RAM for
+  // num_voices voices.
+  bool Init(stmlib::BufferAllocator* allocator, int num_voices) {
+    CONSTRAIN(num_voices, 0, max_voices);
+    num_voices_ = 0;
+    voice_ram_size_ = 0;
+    
+    const size_t ram_size = allocator->free();
+    uint8_t* ram = allocator->Allocate<uint8_t>(ram_size);
+    if (!ram || !num_voices) {
+      return num_voices == 0;
+    }
+    
+    stmlib::BufferAllocator probe_allocator(ram, ram_size);
+    voice_[0].Init(&probe_allocator);
+    // Rounded up so that the RAM of all voices stays 16-byte aligned.
+    voice_ram_size_ = (voice_[0].ComputeRamUsage() + 15) & ~size_t(15);
+    if (voice_ram_size_ * num_voices > ram_size) {
+      return false;
+    }
+    
+    for (int i = 0; i < num_voices; ++i) {
+      stmlib::BufferAllocator voice_allocator(
+          ram + i * voice_ram_size_, voice_ram_size_);
+      voice_[i].Init(&voice_allocator);
+      ++num_voices_;
+    }
+    return true;
+  }
+  
+  // patch and modulations are arrays of num_voices() elements. The frames
+  // rendered by voice i are written at frames[i * size]. Blocks larger than
+  // kMaxBlockSize are split in chunks exactly like Voice::Render() does, with
+  // the parameters interpolated from their values at the previous call.
+  void Render(
+      const Patch* patch,
+      const Modulations* modulations,
+      Voice::Frame* frames,
+      size_t size) {
+    if (size <= kMaxBlockSize) {
+      RenderBlock(patch, modulations, frames, size, size);
+    } else {
+      size_t done = 0;
+      while (done < size) {
+        size_t chunk_size = std::min(size - done, kMaxBlockSize);
+        size_t offset = done;
+        done += chunk_size;
+        for (int i = 0; i < num_voices_; ++i) {
+          voice_[i].ComputeChunkParameters(
+              patch[i],
+              modulations[i],
+              done,
+              size,
+              &chunk_patch_[i],
+              &chunk_modulations_[i]);
+        }
+        RenderBlock(
+            chunk_patch_,
+            chunk_modulations_,
+            &frames[offset],
+            size,
+            chunk_size);
+      }
+    }
+    for (int i = 0; i < num_voices_; ++i) {
+      voice_[i].EndBlock(patch[i], modulations[i]);
+    }
+  }
+  
+  inline int num_voices() const { return num_voices_; }
+  inline Voice* voice(int i) { return &voice_[i]; }
+  inline size_t voice_ram_size() const { return voice_ram_size_; }
+  
+ private:
+  // The frames rendered by voice i are written at frames[i * stride].
+  void RenderBlock(
+      const Patch* patch,
+      const Modulations* modulations,
+      Voice::Frame* frames,
+      size_t stride,
+      size_t size) {
+    int count[kMaxEngines + 1];
+    std::fill(&count[0], &count[kMaxEngines + 1], 0);
+    
+    for (int i = 0; i < num_voices_; ++i) {
+      engine_[i] = voice_[i].ComputeEngineParameters(
+          patch[i], modulations[i]);
+      ++count[engine_[i] + 1];
+    }
+    
+    // Counting sort of the voices by engine index.
+    for (int i = 0; i < kMaxEngines; ++i) {
+      count[i + 1] += count[i];
+    }
+    for (int i = 0; i < num_voices_; ++i) {
+      order_[count[engine_[i]]++] = i;
+    }
+    
+    for (int i = 0; i < num_voices_; ++i) {
+      const int v = order_[i];
+      voice_[v].RenderEngine(out_[v], aux_[v], size);
+    }
+    
+    for (int i = 0; i < num_voices_; ++i) {
+      voice_[i].PostProcess(
+          patch[i],
+          modulations[i],
+          out_[i],
+          aux_[i],
+          &frames[i * stride],
+          size);
+    }
+  }
+  
+  Voice voice_[max_voices];
+  int num_voices_;
+  size_t voice_ram_size_;
+  
+  int engine_[max_voices];
+  int order_[max_voices];
+  
+  float out_[max_voices][kMaxBlockSize];
+  float aux_[max_voices][kMaxBlockSize];
+  
+  Patch chunk_patch_[max_voices];
+  Modulations chunk_modulations_[max_voices];
+  
+  DISALLOW_COPY_AND_ASSIGN(PolyVoice);
+};
+
+}  // namespace plaits
+
+#endif  // PLAITS_DSP_POLY_VOICE_H_
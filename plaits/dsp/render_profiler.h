@@ -0,0 +1,200 @@
+// Copyright 2016 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Instrumentation of the engines and post-processors rendering time, enabled
+// with -DPROFILE_RENDER. The audio thread records the duration of each block
+// into histograms that other threads can read at any time, without locking.
+
+#ifndef PLAITS_DSP_RENDER_PROFILER_H_
+#define PLAITS_DSP_RENDER_PROFILER_H_
+
+#include "stmlib/stmlib.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+namespace plaits {
+
+// Durations are in TSC ticks on x86, in nanoseconds elsewhere.
+inline uint64_t ReadRenderTimer() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return static_cast<uint64_t>(t.tv_sec) * 1000000000 + t.tv_nsec;
+#endif
+}
+
+// Log-scale buckets: 8 per octave, with exact values below 16.
+const int kRenderHistogramResolution = 3;
+const int kRenderHistogramMaxOctave = 47;
+const int kRenderHistogramNumBuckets = \
+    (kRenderHistogramMaxOctave - 1) << kRenderHistogramResolution;
+
+struct RenderHistogramSnapshot {
+  uint32_t counts[kRenderHistogramNumBuckets];
+  
+  uint64_t total() const {
+    uint64_t total = 0;
+    for (int i = 0; i < kRenderHistogramNumBuckets; ++i) {
+      total += counts[i];
+    }
+    return total;
+  }
+  
+  // Removes the blocks already counted in an earlier snapshot, to get the
+  // statistics of a time window.
+  void Subtract(const RenderHistogramSnapshot& earlier) {
+    for (int i = 0; i < kRenderHistogramNumBuckets; ++i) {
+      counts[i] -= earlier.counts[i];
+    }
+  }
+  
+  // Returns the duration below which a fraction q of the blocks have been
+  // rendered, to within 1/16th.
+  uint64_t Quantile(float q) const;
+};
+
+class RenderHistogram {
+ public:
+  RenderHistogram() { }
+  ~RenderHistogram() { }
+  
+  void Init() {
+    memset(counts_, 0, sizeof(counts_));
+  }
+  
+  // Only one thread may add values.
+  inline void Add(uint64_t duration) {
+    uint32_t* count = &counts_[bucket(duration)];
+    __atomic_store_n(
+        count,
+        __atomic_load_n(count, __ATOMIC_RELAXED) + 1,
+        __ATOMIC_RELAXED);
+  }
+  
+  // Can be called from any thread.
+  void Read(RenderHistogramSnapshot* snapshot) const {
+    for (int i = 0; i < kRenderHistogramNumBuckets; ++i) {
+      snapshot->counts[i] = __atomic_load_n(&counts_[i], __ATOMIC_RELAXED);
+    }
+  }
+  
+  static inline int bucket(uint64_t duration) {
+    const uint64_t exact = 2 << kRenderHistogramResolution;
+    if (duration < exact) {
+      return static_cast<int>(duration);
+    }
+    int octave = 63 - __builtin_clzll(duration);
+    if (octave > kRenderHistogramMaxOctave) {
+      return kRenderHistogramNumBuckets - 1;
+    }
+    int shift = octave - kRenderHistogramResolution;
+    int mantissa = static_cast<int>(duration >> shift) & \
+        ((1 << kRenderHistogramResolution) - 1);
+    return ((octave - kRenderHistogramResolution + 1) << \
+        kRenderHistogramResolution) + mantissa;
+  }
+  
+  // Middle of the range of durations falling in a bucket.
+  static inline uint64_t value(int bucket) {
+    const int exact = 2 << kRenderHistogramResolution;
+    if (bucket < exact) {
+      return bucket;
+    }
+    int octave = (bucket >> kRenderHistogramResolution) + \
+        kRenderHistogramResolution - 1;
+    int shift = octave - kRenderHistogramResolution;
+    uint64_t mantissa = (bucket & ((1 << kRenderHistogramResolution) - 1)) + \
+        (1 << kRenderHistogramResolution);
+    return (mantissa << shift) + ((uint64_t(1) << shift) >> 1);
+  }
+
+ private:
+  uint32_t counts_[kRenderHistogramNumBuckets];
+  
+  DISALLOW_COPY_AND_ASSIGN(RenderHistogram);
+};
+
+inline uint64_t RenderHistogramSnapshot::Quantile(float q) const {
+  const uint64_t target = static_cast<uint64_t>(
+      q * static_cast<float>(total()) + 0.5f);
+  uint64_t sum = 0;
+  for (int i = 0; i < kRenderHistogramNumBuckets; ++i) {
+    sum += counts[i];
+    if (counts[i] && sum >= target) {
+      return RenderHistogram::value(i);
+    }
+  }
+  return 0;
+}
+
+template<int num_engines>
+class RenderProfiler {
+ public:
+  RenderProfiler() { }
+  ~RenderProfiler() { }
+  
+  void Init() {
+    for (int i = 0; i < num_engines; ++i) {
+      engine_[i].Init();
+      post_processing_[i].Init();
+    }
+  }
+  
+  // Duration of the engine's Render() call, per block.
+  inline RenderHistogram* engine(int index) {
+    return &engine_[index];
+  }
+  inline const RenderHistogram& engine(int index) const {
+    return engine_[index];
+  }
+  
+  // Duration of the LPG envelope and of both channel post-processors, per
+  // block, for each engine.
+  inline RenderHistogram* post_processing(int index) {
+    return &post_processing_[index];
+  }
+  inline const RenderHistogram& post_processing(int index) const {
+    return post_processing_[index];
+  }
+  
+ private:
+  RenderHistogram engine_[num_engines];
+  RenderHistogram post_processing_[num_engines];
+  
+  DISALLOW_COPY_AND_ASSIGN(RenderProfiler);
+};
+
+}  // namespace plaits
+
+#endif  // PLAITS_DSP_RENDER_PROFILER_H_
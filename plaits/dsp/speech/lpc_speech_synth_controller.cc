@@ -116,8 +116,12 @@ void LPCSpeechSynthWordBank::Init(
     BufferAllocator* allocator) {
   word_banks_ = word_banks;
   num_banks_ = num_banks;
-  frames_ = allocator->Allocate<LPCSpeechSynth::Frame>(
-      kLPCSpeechSynthMaxFrames);
+  // The banks the cache does not hold - if it is smaller, or failed to
+  // allocate all of them - are decoded into our own buffer.
+  frames_buffer_ = cache_ && cache_->num_banks() >= num_banks
+      ? NULL
+      : allocator->Allocate<LPCSpeechSynth::Frame>(kLPCSpeechSynthMaxFrames);
+  frames_ = frames_buffer_;
   Reset();
 }
 
@@ -174,7 +178,7 @@ size_t LPCSpeechSynthWordBank::LoadNextWord(const uint8_t* data) {
         }
       }
     }
-    frames_[num_frames_++] = frame;
+    frames_buffer_[num_frames_++] = frame;
   }
   return bitstream.ptr() - data;
 }
@@ -183,7 +187,25 @@ bool LPCSpeechSynthWordBank::Load(int bank) {
   if (bank == loaded_bank_ || bank >= num_banks_) {
     return false;
   }
-
+  
+  if (cache_ && bank < cache_->num_banks()) {
+    const LPCSpeechSynthWordBank& cached = cache_->bank(bank);
+    frames_ = cached.frames_;
+    num_frames_ = cached.num_frames_;
+    num_words_ = cached.num_words_;
+    copy(
+        &cached.word_boundaries_[0],
+        &cached.word_boundaries_[kLPCSpeechSynthMaxWords],
+        &word_boundaries_[0]);
+    loaded_bank_ = bank;
+    return true;
+  }
+  
+  if (!frames_buffer_) {
+    return false;
+  }
+  
+  frames_ = frames_buffer_;
   num_frames_ = 0;
   num_words_ = 0;
   
@@ -203,6 +225,22 @@ bool LPCSpeechSynthWordBank::Load(int bank) {
   return true;
 }
 
+bool LPCSpeechSynthWordBankCache::Init(
+    const LPCSpeechSynthWordBankData* word_banks,
+    int num_banks,
+    BufferAllocator* allocator) {
+  num_banks_ = min(num_banks, kLPCSpeechSynthMaxWordBanks);
+  for (int i = 0; i < num_banks_; ++i) {
+    bank_[i].Init(word_banks, num_banks_, allocator);
+    if (!bank_[i].frames_buffer_) {
+      num_banks_ = i;
+      return false;
+    }
+    bank_[i].Load(i);
+  }
+  return true;
+}
+
 void LPCSpeechSynthController::Init(LPCSpeechSynthWordBank* word_bank) {
   word_bank_ = word_bank;
   
@@ -86,6 +86,7 @@ class BitStream {
 
 const int kLPCSpeechSynthMaxWords = 32;
 const int kLPCSpeechSynthMaxFrames = 1024;
+const int kLPCSpeechSynthMaxWordBanks = 8;
 const int kLPCSpeechSynthNumVowels = 5;
 const int kLPCSpeechSynthNumConsonants = 10;
 const int kLPCSpeechSynthNumPhonemes = \
@@ -97,9 +98,11 @@ struct LPCSpeechSynthWordBankData {
   size_t size;
 };
 
+class LPCSpeechSynthWordBankCache;
+
 class LPCSpeechSynthWordBank {
  public:
-  LPCSpeechSynthWordBank() { }
+  LPCSpeechSynthWordBank() : cache_(NULL) { }
   ~LPCSpeechSynthWordBank() { }
 
   void Init(
@@ -110,6 +113,14 @@ class LPCSpeechSynthWordBank {
   bool Load(int index);
   void Reset();
   
+  // When a cache is set, Load() points to the frames decoded by the cache
+  // instead of decoding the bank again. Must be set before Init() - and after
+  // the cache has been initialized - for the frame buffer to be spared. It is
+  // still allocated when the cache holds fewer banks than the word bank.
+  inline void set_cache(const LPCSpeechSynthWordBankCache* cache) {
+    cache_ = cache;
+  }
+  
   inline int num_frames() const { return num_frames_; }
   inline const LPCSpeechSynth::Frame* frames() const { return frames_; }
   
@@ -127,6 +138,8 @@ class LPCSpeechSynthWordBank {
   }
   
  private:
+  friend class LPCSpeechSynthWordBankCache;
+  
   size_t LoadNextWord(const uint8_t* data);
   
   const LPCSpeechSynthWordBankData* word_banks_;
@@ -137,7 +150,9 @@ class LPCSpeechSynthWordBank {
   int num_words_;
   int word_boundaries_[kLPCSpeechSynthMaxWords];
   
-  LPCSpeechSynth::Frame* frames_;
+  const LPCSpeechSynth::Frame* frames_;
+  LPCSpeechSynth::Frame* frames_buffer_;
+  const LPCSpeechSynthWordBankCache* cache_;
   
   static uint8_t energy_lut_[16];
   static uint8_t period_lut_[64];
@@ -153,6 +168,33 @@ class LPCSpeechSynthWordBank {
   static int8_t k9_lut_[8];
 };
 
+// Read-only copy of all the word banks, decoded once and shared by any number
+// of LPCSpeechSynthWordBank instances - so that changing bank or triggering
+// many speech voices no longer re-decodes the bitstream. Takes
+// num_banks * kLPCSpeechSynthMaxFrames frames of RAM: for hosts, not for the
+// module.
+class LPCSpeechSynthWordBankCache {
+ public:
+  LPCSpeechSynthWordBankCache() { }
+  ~LPCSpeechSynthWordBankCache() { }
+  
+  bool Init(
+      const LPCSpeechSynthWordBankData* word_banks,
+      int num_banks,
+      stmlib::BufferAllocator* allocator);
+  
+  inline int num_banks() const { return num_banks_; }
+  inline const LPCSpeechSynthWordBank& bank(int index) const {
+    return bank_[index];
+  }
+
+ private:
+  int num_banks_;
+  LPCSpeechSynthWordBank bank_[kLPCSpeechSynthMaxWordBanks];
+  
+  DISALLOW_COPY_AND_ASSIGN(LPCSpeechSynthWordBankCache);
+};
+
 class LPCSpeechSynthController {
  public:
   LPCSpeechSynthController() { }
@@ -52,11 +52,13 @@ void Voice::Init(BufferAllocator* allocator) {
   engines_.RegisterInstance(&bass_drum_engine_, true, 0.8f, 0.8f);
   engines_.RegisterInstance(&snare_drum_engine_, true, 0.8f, 0.8f);
   engines_.RegisterInstance(&hi_hat_engine_, true, 0.8f, 0.8f);
-  for (int i = 0; i < engines_.size(); ++i) {
-    // All engines will share the same RAM space.
-    allocator->Free();
-    engines_.get(i)->Init(allocator);
-  }
+  
+  // All engines share the same RAM space. They are initialized the first time
+  // they are selected, or all at once by InitEngines().
+  const size_t ram_size = allocator->free();
+  allocator_.Init(allocator->Allocate<uint8_t>(ram_size), ram_size);
+  fill(&engine_initialized_[0], &engine_initialized_[kMaxEngines], false);
+  fill(&engine_ram_usage_[0], &engine_ram_usage_[kMaxEngines], 0);
   
   engine_quantizer_.Init();
   previous_engine_index_ = -1;
@@ -70,8 +72,38 @@ void Voice::Init(BufferAllocator* allocator) {
   
   trigger_state_ = false;
   previous_note_ = 0.0f;
+  has_previous_parameters_ = false;
   
   trigger_delay_.Init(trigger_delay_line_);
+  
+#ifdef PROFILE_RENDER
+  profiler_.Init();
+#endif  // PROFILE_RENDER
+}
+
+void Voice::InitEngine(int index) {
+  allocator_.Free();
+  const size_t ram_size = allocator_.free();
+  engines_.get(index)->Init(&allocator_);
+  engine_ram_usage_[index] = ram_size - allocator_.free();
+  engine_initialized_[index] = true;
+}
+
+void Voice::InitEngines() {
+  for (int i = 0; i < engines_.size(); ++i) {
+    InitEngine(i);
+  }
+  // The engines share their RAM: the selected engine must be reset.
+  previous_engine_index_ = -1;
+}
+
+size_t Voice::ComputeRamUsage() {
+  InitEngines();
+  size_t ram_usage = 0;
+  for (int i = 0; i < engines_.size(); ++i) {
+    ram_usage = max(ram_usage, engine_ram_usage_[i]);
+  }
+  return ram_usage;
 }
 
 void Voice::Render(
@@ -79,6 +111,150 @@ void Voice::Render(
     const Modulations& modulations,
     Frame* frames,
     size_t size) {
+  RenderChunks(patch, modulations, frames, NULL, NULL, 0, size);
+}
+
+void Voice::Render(
+    const Patch& patch,
+    const Modulations& modulations,
+    float* out,
+    float* aux,
+    size_t size,
+    size_t stride) {
+  RenderChunks(patch, modulations, NULL, out, aux, stride, size);
+}
+
+void Voice::RenderChunks(
+    const Patch& patch,
+    const Modulations& modulations,
+    Frame* frames,
+    float* out,
+    float* aux,
+    size_t stride,
+    size_t size) {
+  if (size <= kMaxBlockSize) {
+    RenderBlock(patch, modulations, frames, out, aux, stride, size);
+  } else {
+    size_t done = 0;
+    while (done < size) {
+      size_t chunk_size = min(size - done, kMaxBlockSize);
+      size_t offset = done;
+      done += chunk_size;
+      
+      Patch p;
+      Modulations m;
+      ComputeChunkParameters(patch, modulations, done, size, &p, &m);
+      RenderBlock(
+          p, m,
+          frames ? frames + offset : NULL,
+          out ? out + offset * stride : NULL,
+          aux ? aux + offset * stride : NULL,
+          stride,
+          chunk_size);
+    }
+  }
+  EndBlock(patch, modulations);
+}
+
+void Voice::ComputeChunkParameters(
+    const Patch& patch,
+    const Modulations& modulations,
+    size_t end,
+    size_t size,
+    Patch* chunk_patch,
+    Modulations* chunk_modulations) {
+  if (!has_previous_parameters_) {
+    previous_patch_ = patch;
+    previous_modulations_ = modulations;
+    has_previous_parameters_ = true;
+  }
+  if (end == size) {
+    *chunk_patch = patch;
+    *chunk_modulations = modulations;
+  } else {
+    // The parameters are linearly interpolated over the whole block. When
+    // they do not change, this is identical to successive calls with
+    // kMaxBlockSize samples.
+    const float scale = 1.0f / static_cast<float>(size);
+    InterpolateParameters(
+        patch,
+        modulations,
+        static_cast<float>(end) * scale,
+        chunk_patch,
+        chunk_modulations);
+  }
+}
+
+void Voice::EndBlock(const Patch& patch, const Modulations& modulations) {
+  previous_patch_ = patch;
+  previous_modulations_ = modulations;
+  has_previous_parameters_ = true;
+}
+
+void Voice::InterpolateParameters(
+    const Patch& patch,
+    const Modulations& modulations,
+    float t,
+    Patch* p,
+    Modulations* m) const {
+  *p = patch;
+  *m = modulations;
+  
+  const Patch& a = previous_patch_;
+  p->note = Crossfade(a.note, patch.note, t);
+  p->harmonics = Crossfade(a.harmonics, patch.harmonics, t);
+  p->timbre = Crossfade(a.timbre, patch.timbre, t);
+  p->morph = Crossfade(a.morph, patch.morph, t);
+  p->frequency_modulation_amount = Crossfade(
+      a.frequency_modulation_amount, patch.frequency_modulation_amount, t);
+  p->timbre_modulation_amount = Crossfade(
+      a.timbre_modulation_amount, patch.timbre_modulation_amount, t);
+  p->morph_modulation_amount = Crossfade(
+      a.morph_modulation_amount, patch.morph_modulation_amount, t);
+  p->decay = Crossfade(a.decay, patch.decay, t);
+  p->lpg_colour = Crossfade(a.lpg_colour, patch.lpg_colour, t);
+  
+  // The engine CV and the trigger are not interpolated.
+  const Modulations& b = previous_modulations_;
+  m->note = Crossfade(b.note, modulations.note, t);
+  m->frequency = Crossfade(b.frequency, modulations.frequency, t);
+  m->harmonics = Crossfade(b.harmonics, modulations.harmonics, t);
+  m->timbre = Crossfade(b.timbre, modulations.timbre, t);
+  m->morph = Crossfade(b.morph, modulations.morph, t);
+  m->level = Crossfade(b.level, modulations.level, t);
+}
+
+void Voice::RenderBlock(
+    const Patch& patch,
+    const Modulations& modulations,
+    Frame* frames,
+    float* out,
+    float* aux,
+    size_t stride,
+    size_t size) {
+  ComputeEngineParameters(patch, modulations);
+  if (frames) {
+    RenderEngine(out_buffer_, aux_buffer_, size);
+    PostProcess(patch, modulations, out_buffer_, aux_buffer_, frames, size);
+  } else if (stride == 1) {
+    // Planar output: render and post-process directly in the output buffers.
+    RenderEngine(out, aux, size);
+    PostProcess(patch, modulations, out, aux, size);
+  } else {
+    RenderEngine(out_buffer_, aux_buffer_, size);
+    PostProcess(patch, modulations, out_buffer_, aux_buffer_, size);
+    for (size_t i = 0; i < size; ++i) {
+      *out = out_buffer_[i];
+      *aux = aux_buffer_[i];
+      out += stride;
+      aux += stride;
+    }
+  }
+}
+
+int Voice::ComputeEngineParameters(
+    const Patch& patch,
+    const Modulations& modulations) {
   // Trigger, LPG, internal envelope.
       
   // Delay trigger by 1ms to deal with sequencers or MIDI interfaces whose
@@ -115,16 +291,18 @@ void Voice::Render(
   Engine* e = engines_.get(engine_index);
   
   if (engine_index != previous_engine_index_) {
+    if (!engine_initialized_[engine_index]) {
+      InitEngine(engine_index);
+    }
     e->Reset();
     out_post_processor_.Reset();
     previous_engine_index_ = engine_index;
   }
-  EngineParameters p;
+  EngineParameters& p = parameters_;
 
   bool rising_edge = trigger_state_ && !previous_trigger_state;
   float note = (modulations.note + previous_note_) * 0.5f;
   previous_note_ = modulations.note;
-  const PostProcessingSettings& pp_s = e->post_processing_settings;
 
   if (modulations.trigger_patched) {
     p.trigger = rising_edge ? TRIGGER_RISING_EDGE : TRIGGER_LOW;
@@ -132,15 +310,15 @@ void Voice::Render(
     p.trigger = TRIGGER_UNPATCHED;
   }
   
-  const float short_decay = (200.0f * kBlockSize) / kSampleRate *
+  short_decay_ = (200.0f * kBlockSize) / kSampleRate *
       SemitonesToRatio(-96.0f * patch.decay);
 
-  decay_envelope_.Process(short_decay * 2.0f);
+  decay_envelope_.Process(short_decay_ * 2.0f);
 
-  const float compressed_level = max(
+  compressed_level_ = max(
       1.3f * modulations.level / (0.3f + fabsf(modulations.level)),
       0.0f);
-  p.accent = modulations.level_patched ? compressed_level : 0.8f;
+  p.accent = modulations.level_patched ? compressed_level_ : 0.8f;
 
   bool use_internal_envelope = modulations.trigger_patched;
 
@@ -194,26 +372,58 @@ void Voice::Render(
       0.0f,
       0.0f,
       1.0f);
-
-  bool already_enveloped = pp_s.already_enveloped;
-  e->Render(p, out_buffer_, aux_buffer_, size, &already_enveloped);
   
-  bool lpg_bypass = already_enveloped || \
+  return engine_index;
+}
+
+void Voice::RenderEngine(float* out, float* aux, size_t size) {
+  Engine* e = engines_.get(previous_engine_index_);
+  already_enveloped_ = e->post_processing_settings.already_enveloped;
+#ifdef PROFILE_RENDER
+  uint64_t start = ReadRenderTimer();
+#endif  // PROFILE_RENDER
+  e->Render(parameters_, out, aux, size, &already_enveloped_);
+#ifdef PROFILE_RENDER
+  profiler_.engine(previous_engine_index_)->Add(ReadRenderTimer() - start);
+#endif  // PROFILE_RENDER
+}
+
+bool Voice::ProcessLPGEnvelope(
+    const Patch& patch,
+    const Modulations& modulations) {
+  bool lpg_bypass = already_enveloped_ || \
       (!modulations.level_patched && !modulations.trigger_patched);
   
   // Compute LPG parameters.
   if (!lpg_bypass) {
     const float hf = patch.lpg_colour;
     const float decay_tail = (20.0f * kBlockSize) / kSampleRate *
-        SemitonesToRatio(-72.0f * patch.decay + 12.0f * hf) - short_decay;
+        SemitonesToRatio(-72.0f * patch.decay + 12.0f * hf) - short_decay_;
     
     if (modulations.level_patched) {
-      lpg_envelope_.ProcessLP(compressed_level, short_decay, decay_tail, hf);
+      lpg_envelope_.ProcessLP(compressed_level_, short_decay_, decay_tail, hf);
     } else {
-      const float attack = NoteToFrequency(p.note) * float(kBlockSize) * 2.0f;
-      lpg_envelope_.ProcessPing(attack, short_decay, decay_tail, hf);
+      const float attack = NoteToFrequency(parameters_.note) * \
+          float(kBlockSize) * 2.0f;
+      lpg_envelope_.ProcessPing(attack, short_decay_, decay_tail, hf);
     }
   }
+  return lpg_bypass;
+}
+
+void Voice::PostProcess(
+    const Patch& patch,
+    const Modulations& modulations,
+    float* out,
+    float* aux,
+    Frame* frames,
+    size_t size) {
+#ifdef PROFILE_RENDER
+  uint64_t start = ReadRenderTimer();
+#endif  // PROFILE_RENDER
+  const PostProcessingSettings& pp_s = \
+      engines_.get(previous_engine_index_)->post_processing_settings;
+  bool lpg_bypass = ProcessLPGEnvelope(patch, modulations);
   
   out_post_processor_.Process(
       pp_s.out_gain,
@@ -221,7 +431,7 @@ void Voice::Render(
       lpg_envelope_.gain(),
       lpg_envelope_.frequency(),
       lpg_envelope_.hf_bleed(),
-      out_buffer_,
+      out,
       &frames->out,
       size,
       2);
@@ -232,10 +442,50 @@ void Voice::Render(
       lpg_envelope_.gain(),
       lpg_envelope_.frequency(),
       lpg_envelope_.hf_bleed(),
-      aux_buffer_,
+      aux,
       &frames->aux,
       size,
       2);
+#ifdef PROFILE_RENDER
+  profiler_.post_processing(previous_engine_index_)->Add(
+      ReadRenderTimer() - start);
+#endif  // PROFILE_RENDER
+}
+
+void Voice::PostProcess(
+    const Patch& patch,
+    const Modulations& modulations,
+    float* out,
+    float* aux,
+    size_t size) {
+#ifdef PROFILE_RENDER
+  uint64_t start = ReadRenderTimer();
+#endif  // PROFILE_RENDER
+  const PostProcessingSettings& pp_s = \
+      engines_.get(previous_engine_index_)->post_processing_settings;
+  bool lpg_bypass = ProcessLPGEnvelope(patch, modulations);
+  
+  out_post_processor_.Process(
+      pp_s.out_gain,
+      lpg_bypass,
+      lpg_envelope_.gain(),
+      lpg_envelope_.frequency(),
+      lpg_envelope_.hf_bleed(),
+      out,
+      size);
+
+  aux_post_processor_.Process(
+      pp_s.aux_gain,
+      lpg_bypass,
+      lpg_envelope_.gain(),
+      lpg_envelope_.frequency(),
+      lpg_envelope_.hf_bleed(),
+      aux,
+      size);
+#ifdef PROFILE_RENDER
+  profiler_.post_processing(previous_engine_index_)->Add(
+      ReadRenderTimer() - start);
+#endif  // PROFILE_RENDER
 }
   
 }  // namespace plaits
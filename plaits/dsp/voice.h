@@ -56,6 +56,9 @@
 #include "plaits/dsp/envelope.h"
 
 #include "plaits/dsp/fx/low_pass_gate.h"
+#ifdef PROFILE_RENDER
+#include "plaits/dsp/render_profiler.h"
+#endif  // PROFILE_RENDER
 
 namespace plaits {
 
@@ -108,6 +111,35 @@ class ChannelPostProcessor {
     }
   }
   
+  // Same as above, with a floating point output. A sample value of 1.0
+  // corresponds to 32767 in the 16-bit output. The signal is processed in
+  // place.
+  void Process(
+      float gain,
+      bool bypass_lpg,
+      float low_pass_gate_gain,
+      float low_pass_gate_frequency,
+      float low_pass_gate_hf_bleed,
+      float* in_out,
+      size_t size) {
+    if (gain < 0.0f) {
+      limiter_.Process(-gain, in_out, size);
+    }
+    const float post_gain = (gain < 0.0f ? 1.0f : gain) * -1.0f;
+    if (!bypass_lpg) {
+      lpg_.Process(
+          post_gain * low_pass_gate_gain,
+          low_pass_gate_frequency,
+          low_pass_gate_hf_bleed,
+          in_out,
+          size);
+    } else {
+      while (size--) {
+        *in_out++ *= post_gain;
+      }
+    }
+  }
+  
  private:
   stmlib::Limiter limiter_;
   LowPassGate lpg_;
@@ -156,15 +188,142 @@ class Voice {
     short aux;
   };
   
+  // The voice keeps for its engines all the space left in the allocator.
   void Init(stmlib::BufferAllocator* allocator);
+  
+  // Blocks larger than kMaxBlockSize are rendered in chunks, with the
+  // parameters interpolated from their values at the previous call. Each
+  // chunk runs all three stages below, so this is no faster than successive
+  // calls with kMaxBlockSize samples - only smoother.
+  void Render(
+      const Patch& patch,
+      const Modulations& modulations,
+      Frame* frames,
+      size_t size);
+  
+  // Floating point output, with a full scale of 1.0. out and aux can be two
+  // separate buffers (stride = 1, in which case the engine and the LPG
+  // directly write into them), or interleaved in the same buffer (for
+  // example: out = buffer, aux = buffer + 1, stride = 2).
   void Render(
       const Patch& patch,
       const Modulations& modulations,
+      float* out,
+      float* aux,
+      size_t size,
+      size_t stride);
+  
+  // Render() is made of three stages, which can also be called individually
+  // - this is used by PolyVoice to run the engine stage of all the voices
+  // using the same engine in a row.
+  //
+  // 1. Process triggers and envelopes, select the engine, and compute the
+  //    engine parameters. Returns the index of the selected engine.
+  int ComputeEngineParameters(
+      const Patch& patch,
+      const Modulations& modulations);
+  
+  // 2. Render the selected engine.
+  void RenderEngine(float* out, float* aux, size_t size);
+  
+  // 3. Apply LPG, limiter and output gain. out and aux are modified in place,
+  //    and written to frames, if provided, as 16-bit samples.
+  void PostProcess(
+      const Patch& patch,
+      const Modulations& modulations,
+      float* out,
+      float* aux,
       Frame* frames,
       size_t size);
+  void PostProcess(
+      const Patch& patch,
+      const Modulations& modulations,
+      float* out,
+      float* aux,
+      size_t size);
+
+  // Used by PolyVoice to split blocks larger than kMaxBlockSize the same way
+  // as Render(): computes the parameters of the chunk of a size-sample block
+  // ending at sample end. EndBlock() must be called once the whole block -
+  // large or not - has been rendered, to record the parameters the next block
+  // will be interpolated from.
+  void ComputeChunkParameters(
+      const Patch& patch,
+      const Modulations& modulations,
+      size_t end,
+      size_t size,
+      Patch* chunk_patch,
+      Modulations* chunk_modulations);
+  void EndBlock(const Patch& patch, const Modulations& modulations);
+
   inline int active_engine() const { return previous_engine_index_; }
+  
+  // Number of bytes of RAM allocated by an engine. Engines are initialized
+  // the first time they are selected - until then, this returns 0.
+  inline size_t engine_ram_usage(int index) const {
+    return engine_ram_usage_[index];
+  }
+  
+  // Initializes all engines now, as Init() did before engines were
+  // initialized lazily. The output is the same either way, but the first
+  // Render() call after an engine change can then take up to the time of one
+  // engine initialization: hosts rendering from a real-time thread call this
+  // from another thread before rendering.
+  void InitEngines();
+  
+  // Initializes all engines and returns the largest amount of RAM used by an
+  // engine, that is to say the smallest buffer that can be given to Init().
+  // Should be called before rendering, on a voice initialized with a large
+  // enough buffer.
+  size_t ComputeRamUsage();
+  
+  // Shares a set of pre-decoded LPC word banks between voices. When set
+  // before the speech engine is first selected, the engine no longer needs
+  // RAM to decode the word banks.
+  inline void set_speech_word_bank_cache(
+      const LPCSpeechSynthWordBankCache* cache) {
+    speech_engine_.set_word_bank_cache(cache);
+  }
+  
+  // Renders the wavetable engine from a band-limited mipmap pyramid.
+  inline void set_wavetable_mipmaps(const WavetableMipmaps* mipmaps) {
+    wavetable_engine_.set_mipmaps(mipmaps);
+  }
+  
+#ifdef PROFILE_RENDER
+  // Can be read by another thread while the voice is rendering.
+  inline const RenderProfiler<kMaxEngines>& profiler() const {
+    return profiler_;
+  }
+#endif  // PROFILE_RENDER
     
  private:
+  void InitEngine(int index);
+  void RenderChunks(
+      const Patch& patch,
+      const Modulations& modulations,
+      Frame* frames,
+      float* out,
+      float* aux,
+      size_t stride,
+      size_t size);
+  void RenderBlock(
+      const Patch& patch,
+      const Modulations& modulations,
+      Frame* frames,
+      float* out,
+      float* aux,
+      size_t stride,
+      size_t size);
+  bool ProcessLPGEnvelope(
+      const Patch& patch,
+      const Modulations& modulations);
+  void InterpolateParameters(
+      const Patch& patch,
+      const Modulations& modulations,
+      float t,
+      Patch* interpolated_patch,
+      Modulations* interpolated_modulations) const;
   void ComputeDecayParameters(const Patch& settings);
   
   inline float ApplyModulations(
@@ -214,6 +373,15 @@ class Voice {
   float previous_note_;
   bool trigger_state_;
   
+  Patch previous_patch_;
+  Modulations previous_modulations_;
+  bool has_previous_parameters_;
+  
+  EngineParameters parameters_;
+  bool already_enveloped_;
+  float short_decay_;
+  float compressed_level_;
+  
   DecayEnvelope decay_envelope_;
   LPGEnvelope lpg_envelope_;
   
@@ -225,9 +393,17 @@ class Voice {
   
   EngineRegistry<kMaxEngines> engines_;
   
+  stmlib::BufferAllocator allocator_;
+  bool engine_initialized_[kMaxEngines];
+  size_t engine_ram_usage_[kMaxEngines];
+  
   float out_buffer_[kMaxBlockSize];
   float aux_buffer_[kMaxBlockSize];
   
+#ifdef PROFILE_RENDER
+  RenderProfiler<kMaxEngines> profiler_;
+#endif  // PROFILE_RENDER
+  
   DISALLOW_COPY_AND_ASSIGN(Voice);
 };
 
@@ -0,0 +1,107 @@
+#!/usr/bin/python2.7
+#
+# Copyright 2016 Emilie Gillet.
+#
+# Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+# 
+# See http://creativecommons.org/licenses/MIT/ for more information.
+#
+# -----------------------------------------------------------------------------
+#
+# Band-limited mipmap pyramid of the wavetables, for hosts.
+#
+# Level n of the pyramid only contains the harmonics 1 to 128 >> n of each
+# wave, so that a wave can be played without aliasing up to a frequency of
+# 0.5 / (128 >> n) (as a fraction of the sample rate). The pyramid is too large
+# to be compiled into resources.cc and is written to a file, memory-mapped at
+# startup by plaits::WavetableMipmaps.
+#
+# Usage: python2.7 plaits/resources/wavetable_mipmaps.py output.bin
+#
+# Needs Python 2.7 (wavetables.py is Python 2 code, and b'' literals need 2.6)
+# and numpy 1.9 or later for ndarray.tobytes().
+#
+# File layout (little endian):
+#   header: 'PWMM', version, num_waves, num_levels, table_size, padded to 32
+#       bytes.
+#   data: int16_t[num_levels][num_waves][table_size + 1]. The last sample of
+#       each table is a copy of the first one, for interpolation. Full scale
+#       is 16384 - leaving room for the Gibbs overshoot.
+
+import struct
+import sys
+
+import numpy
+
+import wavetables
+
+
+MAGIC = 'PWMM'
+VERSION = 1
+NUM_LEVELS = 8
+HEADER_SIZE = 32
+FULL_SCALE = 16384.0
+
+
+def band_limit(wave, num_harmonics):
+  spectrum = numpy.fft.rfft(wave)
+  spectrum[0] = 0.0
+  spectrum[num_harmonics + 1:] = 0.0
+  return numpy.fft.irfft(spectrum, len(wave))
+
+
+def make_pyramid(waves):
+  size = wavetables.WAVETABLE_SIZE
+  levels = []
+  for level in range(NUM_LEVELS):
+    num_harmonics = min(size // 2 - 1, (size // 2) >> level)
+    tables = []
+    for wave in waves:
+      # Same normalization as the integrated waves used by the engine.
+      x = numpy.array(wave, dtype=float)
+      x -= x.mean()
+      x /= numpy.abs(x).max()
+      x = band_limit(x, num_harmonics)
+      x = numpy.round(x * FULL_SCALE)
+      x = numpy.clip(x, -32768, 32767).astype(numpy.int16)
+      tables.append(numpy.append(x, x[0]))
+    levels.append(tables)
+  return levels
+
+
+def write_pyramid(levels, path):
+  num_waves = len(levels[0])
+  size = wavetables.WAVETABLE_SIZE
+  header = struct.pack(
+      '<4sIIII', MAGIC.encode('ascii'), VERSION, num_waves, len(levels), size)
+  f = open(path, 'wb')
+  f.write(header + b'\0' * (HEADER_SIZE - len(header)))
+  for tables in levels:
+    for table in tables:
+      f.write(table.astype('<i2').tobytes())
+  f.close()
+
+
+if __name__ == '__main__':
+  if len(sys.argv) != 2:
+    print('Usage: wavetable_mipmaps.py output.bin')
+    sys.exit(1)
+  write_pyramid(make_pyramid(wavetables.all_waves), sys.argv[1])
@@ -0,0 +1,350 @@
+// Copyright 2016 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Offline renderer: plays a parameter automation script through a Voice and
+// writes the result to a WAV file, reporting the real-time factor of each
+// engine.
+//
+// Usage: plaits_render [options] script.{csv,json} [output.wav]
+//        plaits_render [options] --benchmark [output.wav]
+//
+// Options:
+//   --block-size n   Size of the blocks given to Voice::Render (default: 24).
+//   --duration s     Length of the render (default: last event + 2s).
+//   --seed n         Seed of the random number generator (default: 0).
+//
+// When built with -DPROFILE_RENDER, the median and 99th percentile of the
+// time spent per block in each engine and in the post-processing are also
+// reported.
+//
+// A script is a list of events. Each event has a time (in seconds, positive
+// or zero) and sets some of the following fields, which keep their value until
+// the next event setting them: engine (0 to 15), note, harmonics, timbre,
+// morph, decay, lpg_colour, level. An event with a non-zero trigger field
+// fires a trigger. When no event has a level or trigger field, the
+// corresponding input is left unpatched.
+//
+// CSV scripts start with a header row naming the columns, one of which must be
+// "time". Empty cells leave a field unchanged. Lines starting with # are
+// ignored.
+//
+//   time,engine,note,timbre,trigger
+//   0.0,8,48,0.5,1
+//   0.5,,55,,1
+//
+// JSON scripts contain a list of objects, optionally as the "events" member of
+// a top-level object:
+//
+//   [{ "time": 0.0, "engine": 8, "note": 48, "trigger": 1 },
+//    { "time": 0.5, "note": 55, "trigger": 1 }]
+//
+// --benchmark renders all engines in turn, with a fixed sequence of triggers
+// and parameter changes, and can be used as a throughput and regression
+// baseline.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <xmmintrin.h>
+
+#include "stmlib/utils/random.h"
+
+#include "plaits/dsp/dsp.h"
+#include "plaits/dsp/voice.h"
+
+#include "host/event_script.h"
+#include "stmlib/test/wav_writer.h"
+
+using namespace plaits;
+using namespace std;
+using namespace stmlib;
+
+const size_t kDefaultBlockSize = 24;
+const float kTailDuration = 2.0f;
+const float kTriggerDuration = 0.005f;
+const float kBenchmarkEngineDuration = 4.0f;
+
+enum Field {
+  FIELD_ENGINE,
+  FIELD_NOTE,
+  FIELD_HARMONICS,
+  FIELD_TIMBRE,
+  FIELD_MORPH,
+  FIELD_DECAY,
+  FIELD_LPG_COLOUR,
+  FIELD_LEVEL,
+  FIELD_TRIGGER,
+  FIELD_LAST
+};
+
+const char* field_names[FIELD_LAST] = {
+  "engine",
+  "note",
+  "harmonics",
+  "timbre",
+  "morph",
+  "decay",
+  "lpg_colour",
+  "level",
+  "trigger"
+};
+
+typedef host::ScriptEvent<FIELD_LAST> Event;
+typedef host::EventScriptParser<FIELD_LAST> Parser;
+
+void MakeBenchmark(vector<Event>* events) {
+  for (int engine = 0; engine < kMaxEngines; ++engine) {
+    float start = engine * kBenchmarkEngineDuration;
+    for (int i = 0; i < 16; ++i) {
+      Event e;
+      e.time = start + i * kBenchmarkEngineDuration / 16.0f;
+      if (i == 0) {
+        e.Set(FIELD_ENGINE, engine);
+        e.Set(FIELD_DECAY, 0.5f);
+        e.Set(FIELD_LPG_COLOUR, 0.5f);
+      }
+      e.Set(FIELD_NOTE, 36.0f + (i * 7) % 24);
+      e.Set(FIELD_HARMONICS, (i % 4) / 3.0f);
+      e.Set(FIELD_TIMBRE, ((i / 4) % 4) / 3.0f);
+      e.Set(FIELD_MORPH, (i % 3) / 2.0f);
+      e.Set(FIELD_TRIGGER, 1.0f);
+      events->push_back(e);
+    }
+  }
+}
+
+struct EngineStats {
+  size_t samples;
+  clock_t elapsed;
+};
+
+int main(int argc, char** argv) {
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+  
+  size_t block_size = kDefaultBlockSize;
+  float duration = -1.0f;
+  uint32_t seed = 0;
+  bool benchmark = false;
+  vector<const char*> files;
+  
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--benchmark")) {
+      benchmark = true;
+    } else if (!strcmp(argv[i], "--block-size") && i + 1 < argc) {
+      block_size = max(atoi(argv[++i]), 1);
+    } else if (!strcmp(argv[i], "--duration") && i + 1 < argc) {
+      duration = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = strtoul(argv[++i], NULL, 0);
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  
+  size_t num_scripts = benchmark ? 0 : 1;
+  if (files.size() < num_scripts || files.size() > num_scripts + 1) {
+    fprintf(stderr,
+        "Usage: %s [--block-size n] [--duration s] [--seed n] "
+        "(script.csv|script.json|--benchmark) [output.wav]\n", argv[0]);
+    return 1;
+  }
+  
+  vector<Event> events;
+  if (benchmark) {
+    MakeBenchmark(&events);
+  } else {
+    Parser parser(field_names);
+    if (!parser.Load(files[0], &events) || \
+        !parser.CheckIndex(events, FIELD_ENGINE, kMaxEngines)) {
+      return 1;
+    }
+  }
+  const char* output = files.size() > num_scripts ? files[num_scripts] : NULL;
+  
+  if (duration < 0.0f) {
+    if (benchmark) {
+      duration = kMaxEngines * kBenchmarkEngineDuration;
+    } else {
+      duration = (events.empty() ? 0.0f : events.back().time) + kTailDuration;
+    }
+  }
+  // WavWriter works with whole seconds.
+  duration = ceilf(duration);
+  const size_t num_samples = static_cast<size_t>(duration * kSampleRate);
+  
+  // Default patch: that of a module with all knobs at noon, nothing patched.
+  Patch patch;
+  patch.engine = 0;
+  patch.note = 48.0f;
+  patch.harmonics = 0.5f;
+  patch.timbre = 0.5f;
+  patch.morph = 0.5f;
+  patch.frequency_modulation_amount = 0.0f;
+  patch.timbre_modulation_amount = 0.0f;
+  patch.morph_modulation_amount = 0.0f;
+  patch.decay = 0.5f;
+  patch.lpg_colour = 0.5f;
+  
+  Modulations modulations;
+  modulations.engine = 0.0f;
+  modulations.note = 0.0f;
+  modulations.frequency = 0.0f;
+  modulations.harmonics = 0.0f;
+  modulations.timbre = 0.0f;
+  modulations.morph = 0.0f;
+  modulations.trigger = 0.0f;
+  modulations.level = 1.0f;
+  modulations.frequency_patched = false;
+  modulations.timbre_patched = false;
+  modulations.morph_patched = false;
+  modulations.trigger_patched = false;
+  modulations.level_patched = false;
+  for (size_t i = 0; i < events.size(); ++i) {
+    if (events[i].mask & (1 << FIELD_TRIGGER)) {
+      modulations.trigger_patched = true;
+    }
+    if (events[i].mask & (1 << FIELD_LEVEL)) {
+      modulations.level_patched = true;
+    }
+  }
+  
+  static char ram_block[16 * 1024];
+  BufferAllocator allocator(ram_block, sizeof(ram_block));
+  Voice voice;
+  voice.Init(&allocator);
+  Random::Seed(seed);
+  
+  WavWriter* wav_writer = NULL;
+  if (output) {
+    wav_writer = new WavWriter(2, kSampleRate, static_cast<size_t>(duration));
+    wav_writer->Open(output);
+  }
+  
+  vector<Voice::Frame> frames(block_size);
+  EngineStats stats[kMaxEngines];
+  memset(stats, 0, sizeof(stats));
+  
+  float* targets[FIELD_LAST] = {
+    NULL,
+    &patch.note,
+    &patch.harmonics,
+    &patch.timbre,
+    &patch.morph,
+    &patch.decay,
+    &patch.lpg_colour,
+    &modulations.level,
+    NULL
+  };
+  
+  const size_t trigger_duration = static_cast<size_t>(
+      kTriggerDuration * kSampleRate);
+  size_t trigger_end = 0;
+  size_t next_event = 0;
+  size_t position = 0;
+  while (position < num_samples) {
+    while (next_event < events.size() && \
+           static_cast<size_t>(events[next_event].time * kSampleRate) <= \
+               position) {
+      const Event& e = events[next_event++];
+      for (int field = 0; field < FIELD_LAST; ++field) {
+        if (!(e.mask & (1 << field))) {
+          continue;
+        }
+        const float value = e.value[field];
+        if (field == FIELD_ENGINE) {
+          patch.engine = static_cast<int>(value);
+        } else if (field == FIELD_TRIGGER) {
+          if (value != 0.0f) {
+            trigger_end = position + trigger_duration;
+          }
+        } else {
+          *targets[field] = value;
+        }
+      }
+    }
+    
+    // Blocks are cut at event and trigger boundaries, so that events are
+    // sample-accurate whatever the block size.
+    size_t size = min(block_size, num_samples - position);
+    if (next_event < events.size()) {
+      size_t event_position = static_cast<size_t>(
+          events[next_event].time * kSampleRate);
+      size = min(size, event_position - position);
+    }
+    if (trigger_end > position) {
+      size = min(size, trigger_end - position);
+    }
+    modulations.trigger = trigger_end > position ? 1.0f : 0.0f;
+    
+    clock_t start = clock();
+    voice.Render(patch, modulations, &frames[0], size);
+    EngineStats* s = &stats[patch.engine];
+    s->elapsed += clock() - start;
+    s->samples += size;
+    
+    if (wav_writer) {
+      wav_writer->WriteFrames(&frames[0].out, size);
+    }
+    position += size;
+  }
+  delete wav_writer;
+  
+  printf("engine     audio (s)    cpu (s)    x realtime\n");
+  EngineStats total = { 0, 0 };
+  for (int i = 0; i < kMaxEngines; ++i) {
+    if (!stats[i].samples) {
+      continue;
+    }
+    float audio = static_cast<float>(stats[i].samples) / kSampleRate;
+    float cpu = static_cast<float>(stats[i].elapsed) / CLOCKS_PER_SEC;
+    printf("%6d  %12.3f  %9.3f  %12.1f\n", i, audio, cpu,
+        cpu > 0.0f ? audio / cpu : 0.0f);
+    total.samples += stats[i].samples;
+    total.elapsed += stats[i].elapsed;
+  }
+  float audio = static_cast<float>(total.samples) / kSampleRate;
+  float cpu = static_cast<float>(total.elapsed) / CLOCKS_PER_SEC;
+  printf(" total  %12.3f  %9.3f  %12.1f\n", audio, cpu,
+      cpu > 0.0f ? audio / cpu : 0.0f);
+  
+#ifdef PROFILE_RENDER
+  printf("\nTicks per block    render p50  render p99    post p50    post p99\n");
+  RenderHistogramSnapshot render;
+  RenderHistogramSnapshot post_processing;
+  for (int i = 0; i < kMaxEngines; ++i) {
+    voice.profiler().engine(i).Read(&render);
+    voice.profiler().post_processing(i).Read(&post_processing);
+    if (!render.total()) {
+      continue;
+    }
+    printf("%6d           %11llu %11llu %11llu %11llu\n", i,
+        (unsigned long long) render.Quantile(0.5f),
+        (unsigned long long) render.Quantile(0.99f),
+        (unsigned long long) post_processing.Quantile(0.5f),
+        (unsigned long long) post_processing.Quantile(0.99f));
+  }
+#endif  // PROFILE_RENDER
+  return 0;
+}
@@ -18,6 +18,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <vector>
 #include <xmmintrin.h>
 
 #include "plaits/dsp/dsp.h"
@@ -48,9 +50,14 @@
 #include "plaits/dsp/oscillator/string_synth_oscillator.h"
 #include "plaits/dsp/oscillator/variable_saw_oscillator.h"
 #include "plaits/dsp/oscillator/variable_shape_oscillator.h"
+#include "plaits/dsp/oscillator/wavetable_mipmaps.h"
 #include "plaits/dsp/oscillator/vosim_oscillator.h"
 #include "plaits/dsp/oscillator/z_oscillator.h"
 
+#include "plaits/dsp/physical_modelling/resonator.h"
+
+#include "plaits/dsp/poly_voice.h"
+#include "plaits/dsp/speech/lpc_speech_synth_words.h"
 #include "plaits/dsp/voice.h"
 
 #include "stmlib/test/wav_writer.h"
@@ -676,6 +683,51 @@ void TestWavetableEngine() {
   }
 }
 
+void TestWavetableMipmaps() {
+  const size_t kDuration = 10;
+  
+  WavetableMipmaps mipmaps;
+  if (!mipmaps.Map("plaits_wavetable_mipmaps.bin")) {
+    printf("Generate plaits_wavetable_mipmaps.bin with "
+           "plaits/resources/wavetable_mipmaps.py\n");
+    return;
+  }
+  
+  WavWriter wav_writer(2, kSampleRate, kDuration);
+  wav_writer.Open("plaits_wavetable_mipmaps.wav");
+  
+  WavetableEngine e[2];
+  e[0].Init(NULL);
+  e[1].set_mipmaps(&mipmaps);
+  e[1].Init(NULL);
+  
+  EngineParameters p;
+  p.trigger = TRIGGER_LOW;
+  
+  // Left: integrated waves. Right: mipmaps.
+  clock_t elapsed[2] = { 0, 0 };
+  for (size_t i = 0; i < kSampleRate * kDuration; i += kAudioBlockSize) {
+    float out[2][kAudioBlockSize];
+    float aux[kAudioBlockSize];
+    p.note = 36.0f + 84.0f * wav_writer.triangle(kDuration);
+    p.timbre = wav_writer.triangle(3);
+    p.morph = wav_writer.triangle(5);
+    p.harmonics = wav_writer.triangle(7);
+    
+    for (int j = 0; j < 2; ++j) {
+      bool already_enveloped;
+      clock_t start = clock();
+      e[j].Render(p, out[j], aux, kAudioBlockSize, &already_enveloped);
+      elapsed[j] += clock() - start;
+    }
+    wav_writer.Write(out[0], out[1], kAudioBlockSize);
+  }
+  printf(
+      "Integrated waves: %.3fs, mipmaps: %.3fs\n",
+      static_cast<float>(elapsed[0]) / CLOCKS_PER_SEC,
+      static_cast<float>(elapsed[1]) / CLOCKS_PER_SEC);
+}
+
 void EnumerateWavetables() {
   WavWriter wav_writer(1, kSampleRate, 64);
   wav_writer.Open("plaits_wavetable_enumeration.wav");
@@ -1015,6 +1067,593 @@ void TestLimiterGlitch() {
   }
 }
 
+void TestPolyVoice() {
+  const int kNumVoices = 64;
+  const size_t kDuration = 10;
+  
+  static PolyVoice<kNumVoices> poly_voice;
+  static char poly_voice_ram[kNumVoices * 16384];
+  BufferAllocator poly_voice_allocator(poly_voice_ram, sizeof(poly_voice_ram));
+  if (!poly_voice.Init(&poly_voice_allocator, kNumVoices)) {
+    printf("PolyVoice: not enough RAM\n");
+    return;
+  }
+  const size_t voice_ram_size = poly_voice.voice_ram_size();
+  
+  static Voice voice[kNumVoices];
+  vector<char> voice_ram(kNumVoices * voice_ram_size);
+  for (int i = 0; i < kNumVoices; ++i) {
+    BufferAllocator allocator(&voice_ram[i * voice_ram_size], voice_ram_size);
+    voice[i].Init(&allocator);
+  }
+  
+  // Voices spread over the engines that do not use the shared random number
+  // generator, so that both renderers produce the same output.
+  const int engines[] = { 0, 1, 2, 4, 5, 6 };
+  Patch patch[kNumVoices];
+  Modulations modulations[kNumVoices];
+  for (int i = 0; i < kNumVoices; ++i) {
+    Patch* p = &patch[i];
+    p->engine = engines[i % 6];
+    p->note = 36.0f + (i * 7) % 36;
+    p->harmonics = 0.3f;
+    p->timbre = 0.5f;
+    p->morph = 0.5f;
+    p->frequency_modulation_amount = 0.0f;
+    p->timbre_modulation_amount = 0.3f;
+    p->morph_modulation_amount = 0.0f;
+    p->decay = 0.5f;
+    p->lpg_colour = 0.5f;
+    
+    Modulations* m = &modulations[i];
+    m->engine = 0.0f;
+    m->note = 0.0f;
+    m->frequency = 0.0f;
+    m->harmonics = 0.0f;
+    m->timbre = 0.0f;
+    m->morph = 0.0f;
+    m->trigger = 0.0f;
+    m->level = 0.0f;
+    m->frequency_patched = false;
+    m->timbre_patched = false;
+    m->morph_patched = false;
+    m->trigger_patched = true;
+    m->level_patched = false;
+  }
+  
+  static Voice::Frame poly_frames[kNumVoices * kAudioBlockSize];
+  static Voice::Frame frames[kNumVoices * kAudioBlockSize];
+  
+  clock_t poly_voice_time = 0;
+  clock_t voice_time = 0;
+  size_t num_errors = 0;
+  for (size_t i = 0; i < kSampleRate * kDuration; i += kAudioBlockSize) {
+    for (int j = 0; j < kNumVoices; ++j) {
+      size_t t = i + j * kAudioBlockSize * 10;
+      modulations[j].trigger = t % (kAudioBlockSize * 500) <= \
+          kAudioBlockSize * 5 ? 1.0f : 0.0f;
+    }
+    
+    clock_t start = clock();
+    poly_voice.Render(patch, modulations, poly_frames, kAudioBlockSize);
+    poly_voice_time += clock() - start;
+    
+    start = clock();
+    for (int j = 0; j < kNumVoices; ++j) {
+      voice[j].Render(
+          patch[j],
+          modulations[j],
+          &frames[j * kAudioBlockSize],
+          kAudioBlockSize);
+    }
+    voice_time += clock() - start;
+    
+    for (size_t j = 0; j < kNumVoices * kAudioBlockSize; ++j) {
+      if (poly_frames[j].out != frames[j].out ||
+          poly_frames[j].aux != frames[j].aux) {
+        ++num_errors;
+      }
+    }
+  }
+  
+  // Blocks larger than kMaxBlockSize, with parameters interpolated from
+  // the previous block.
+  for (int j = 0; j < kNumVoices; ++j) {
+    patch[j].note += 7.0f;
+    patch[j].timbre = 0.9f;
+    modulations[j].morph = 0.2f;
+  }
+  const size_t kLargeBlockSize = kMaxBlockSize * 4 + 5;
+  static Voice::Frame poly_large_frames[kNumVoices * kLargeBlockSize];
+  static Voice::Frame large_frames[kNumVoices * kLargeBlockSize];
+  poly_voice.Render(patch, modulations, poly_large_frames, kLargeBlockSize);
+  for (int j = 0; j < kNumVoices; ++j) {
+    voice[j].Render(
+        patch[j],
+        modulations[j],
+        &large_frames[j * kLargeBlockSize],
+        kLargeBlockSize);
+  }
+  for (size_t j = 0; j < kNumVoices * kLargeBlockSize; ++j) {
+    if (poly_large_frames[j].out != large_frames[j].out ||
+        poly_large_frames[j].aux != large_frames[j].aux) {
+      ++num_errors;
+    }
+  }
+  
+  float duration = static_cast<float>(kDuration);
+  printf(
+      "PolyVoice: %d voices, %zu bytes per voice, %zu mismatched frames\n",
+      kNumVoices, voice_ram_size, num_errors);
+  printf(
+      "Voice::Render: %.1f voices per core\n",
+      kNumVoices * duration * CLOCKS_PER_SEC / voice_time);
+  printf(
+      "PolyVoice::Render: %.1f voices per core\n",
+      kNumVoices * duration * CLOCKS_PER_SEC / poly_voice_time);
+}
+
+template<int batch_size, bool vectorized>
+clock_t RenderResonatorSvfBank(
+    int num_modes,
+    const float* in,
+    float* out,
+    size_t size) {
+  const int num_batches = num_modes / batch_size;
+  ResonatorSvf<batch_size, vectorized> bank[64 / batch_size];
+  float f[64];
+  float q[64];
+  float gain[64];
+  for (int i = 0; i < num_modes; ++i) {
+    f[i] = min(0.002f * (i + 1) * (1.0f + 0.01f * i), 0.499f);
+    q[i] = 1.0f + f[i] * 2000.0f;
+    gain[i] = 0.25f * (1.0f - 2.0f * f[i]);
+  }
+  for (int i = 0; i < num_batches; ++i) {
+    bank[i].Init();
+  }
+  
+  clock_t start = clock();
+  for (size_t i = 0; i < size; i += kAudioBlockSize) {
+    fill(&out[i], &out[i + kAudioBlockSize], 0.0f);
+    for (int j = 0; j < num_batches; ++j) {
+      bank[j].template Process<FILTER_MODE_BAND_PASS, true>(
+          &f[j * batch_size],
+          &q[j * batch_size],
+          &gain[j * batch_size],
+          &in[i],
+          &out[i],
+          kAudioBlockSize);
+    }
+  }
+  return clock() - start;
+}
+
+void TestResonatorSvfSpeed() {
+  if (kModeVectorSize == 1) {
+    printf("ResonatorSvf: no vectorized version, build with -mavx\n");
+    return;
+  }
+  
+  const size_t size = kSampleRate * 10;
+  vector<float> in(size);
+  vector<float> scalar_out(size);
+  vector<float> vector_out(size);
+  for (size_t i = 0; i < size; ++i) {
+    in[i] = i % 4800 == 0 ? 1.0f : 0.0f;
+  }
+  
+  const int num_modes[] = { 24, 64 };
+  for (int i = 0; i < 2; ++i) {
+    clock_t scalar_time = RenderResonatorSvfBank<4, false>(
+        num_modes[i], &in[0], &scalar_out[0], size);
+    clock_t vector_time = RenderResonatorSvfBank<kModeBatchSize, true>(
+        num_modes[i], &in[0], &vector_out[0], size);
+    
+    float error = 0.0f;
+    float peak = 0.0f;
+    for (size_t j = 0; j < size; ++j) {
+      error = max(error, fabsf(scalar_out[j] - vector_out[j]));
+      peak = max(peak, fabsf(scalar_out[j]));
+    }
+    printf(
+        "%d modes: scalar %.3fs, %d-wide vector %.3fs, max error %g (peak %g)\n",
+        num_modes[i],
+        static_cast<float>(scalar_time) / CLOCKS_PER_SEC,
+        kModeVectorSize,
+        static_cast<float>(vector_time) / CLOCKS_PER_SEC,
+        error,
+        peak);
+  }
+}
+
+void TestRamUsage() {
+  BufferAllocator allocator(ram_block, 16384);
+  Voice v;
+  v.Init(&allocator);
+  
+  size_t ram_usage = v.ComputeRamUsage();
+  for (int i = 0; i < kMaxEngines; ++i) {
+    printf("Engine %2d: %5zu bytes\n", i, v.engine_ram_usage(i));
+  }
+  printf("Required RAM per voice: %zu bytes\n", ram_usage);
+}
+
+void TestLazyEngineInit() {
+  const size_t kDuration = 20;
+  const size_t kBlocksPerEngine = kSampleRate / 4 / kBlockSize;
+  
+  static char ram[2][16384];
+  BufferAllocator allocator_eager(ram[0], 16384);
+  BufferAllocator allocator_lazy(ram[1], 16384);
+  static Voice eager;
+  static Voice lazy;
+  eager.Init(&allocator_eager);
+  eager.InitEngines();
+  lazy.Init(&allocator_lazy);
+  
+  Patch patch;
+  Modulations modulations;
+  
+  patch.engine = 0;
+  patch.note = 48.0f;
+  patch.harmonics = 0.3f;
+  patch.timbre = 0.7f;
+  patch.morph = 0.7f;
+  patch.frequency_modulation_amount = 0.0f;
+  patch.timbre_modulation_amount = 0.5f;
+  patch.morph_modulation_amount = 0.0f;
+  patch.decay = 0.5f;
+  patch.lpg_colour = 0.5f;
+  
+  modulations.engine = 0.0f;
+  modulations.note = 0.0f;
+  modulations.frequency = 0.0f;
+  modulations.harmonics = 0.0f;
+  modulations.timbre = 0.0f;
+  modulations.morph = 0.0f;
+  modulations.trigger = 0.0f;
+  modulations.level = 0.0f;
+  modulations.frequency_patched = false;
+  modulations.timbre_patched = false;
+  modulations.morph_patched = false;
+  modulations.trigger_patched = true;
+  modulations.level_patched = false;
+  
+  Voice::Frame frames_eager[kBlockSize];
+  Voice::Frame frames_lazy[kBlockSize];
+  
+  bool selected[kMaxEngines] = { false };
+  clock_t render_time = 0;
+  clock_t init_time = 0;
+  clock_t max_init_time = 0;
+  size_t num_errors = 0;
+  size_t num_blocks = kSampleRate * kDuration / kBlockSize;
+  for (size_t i = 0; i < num_blocks; ++i) {
+    // Jumps between engines every 0.25s, coming back to engines already
+    // used with the RAM overwritten by the others.
+    int engine = (i / kBlocksPerEngine * 7) % 16;
+    patch.engine = engine;
+    modulations.trigger = i % 100 == 0 ? 1.0f : 0.0f;
+    
+    uint32_t seed = Random::state();
+    eager.Render(patch, modulations, frames_eager, kBlockSize);
+    
+    Random::Seed(seed);
+    clock_t start = clock();
+    lazy.Render(patch, modulations, frames_lazy, kBlockSize);
+    clock_t elapsed = clock() - start;
+    if (!selected[lazy.active_engine()]) {
+      selected[lazy.active_engine()] = true;
+      init_time += elapsed;
+      max_init_time = max(max_init_time, elapsed);
+    } else {
+      render_time += elapsed;
+    }
+    
+    for (size_t j = 0; j < kBlockSize; ++j) {
+      if (frames_eager[j].out != frames_lazy[j].out ||
+          frames_eager[j].aux != frames_lazy[j].aux) {
+        ++num_errors;
+      }
+    }
+  }
+  
+  float block_duration = static_cast<float>(kBlockSize) / kSampleRate;
+  float clocks_to_us = 1e6f / CLOCKS_PER_SEC;
+  printf("Lazy engine init: %zu mismatched frames\n", num_errors);
+  printf(
+      "Average block: %.1f us, block with an engine init: %.1f us (max %.1f us) "
+      "for a %.1f us block\n",
+      render_time * clocks_to_us / (num_blocks - kMaxEngines),
+      init_time * clocks_to_us / kMaxEngines,
+      max_init_time * clocks_to_us,
+      block_duration * 1e6f);
+}
+
+void TestLargeBlocks() {
+  const size_t kHostBlockSize = 1024;
+  const size_t kDuration = 20;
+  
+  static char ram[2][16384];
+  BufferAllocator allocator_a(ram[0], 16384);
+  BufferAllocator allocator_b(ram[1], 16384);
+  static Voice a;
+  static Voice b;
+  a.Init(&allocator_a);
+  b.Init(&allocator_b);
+  
+  Patch patch;
+  Modulations modulations;
+  
+  patch.engine = 0;
+  patch.note = 48.0f;
+  patch.harmonics = 0.3f;
+  patch.timbre = 0.7f;
+  patch.morph = 0.7f;
+  patch.frequency_modulation_amount = 0.0f;
+  patch.timbre_modulation_amount = 0.5f;
+  patch.morph_modulation_amount = 0.0f;
+  patch.decay = 0.5f;
+  patch.lpg_colour = 0.5f;
+  
+  modulations.engine = 0.0f;
+  modulations.note = 0.0f;
+  modulations.frequency = 0.0f;
+  modulations.harmonics = 0.0f;
+  modulations.timbre = 0.0f;
+  modulations.morph = 0.0f;
+  modulations.trigger = 0.0f;
+  modulations.level = 0.0f;
+  modulations.frequency_patched = false;
+  modulations.timbre_patched = false;
+  modulations.morph_patched = false;
+  modulations.trigger_patched = true;
+  modulations.level_patched = false;
+  
+  Voice::Frame frames_a[kHostBlockSize];
+  Voice::Frame frames_b[kHostBlockSize];
+  
+  clock_t large_block_time = 0;
+  clock_t small_block_time = 0;
+  size_t num_errors = 0;
+  size_t num_blocks = kSampleRate * kDuration / kHostBlockSize;
+  for (size_t i = 0; i < num_blocks; ++i) {
+    // Parameters are static, except for the engine which changes every 2s.
+    patch.engine = static_cast<int>(
+        i * kHostBlockSize / (2 * kSampleRate)) % 16;
+    modulations.trigger = i % 20 == 0 ? 1.0f : 0.0f;
+    
+    // Both voices must see the same random numbers.
+    uint32_t seed = Random::state();
+    clock_t start = clock();
+    a.Render(patch, modulations, frames_a, kHostBlockSize);
+    large_block_time += clock() - start;
+    
+    Random::Seed(seed);
+    start = clock();
+    for (size_t j = 0; j < kHostBlockSize; j += kMaxBlockSize) {
+      size_t size = min(kHostBlockSize - j, kMaxBlockSize);
+      b.Render(patch, modulations, &frames_b[j], size);
+    }
+    small_block_time += clock() - start;
+    
+    for (size_t j = 0; j < kHostBlockSize; ++j) {
+      if (frames_a[j].out != frames_b[j].out ||
+          frames_a[j].aux != frames_b[j].aux) {
+        ++num_errors;
+      }
+    }
+  }
+  printf("Large blocks: %zu mismatched frames\n", num_errors);
+  printf(
+      "%zu samples blocks: %.3fs, %zu samples blocks: %.3fs\n",
+      kHostBlockSize,
+      static_cast<float>(large_block_time) / CLOCKS_PER_SEC,
+      kMaxBlockSize,
+      static_cast<float>(small_block_time) / CLOCKS_PER_SEC);
+}
+
+void TestFloatOutput() {
+  const size_t kDuration = 20;
+  
+  static char ram[2][16384];
+  BufferAllocator allocator_a(ram[0], 16384);
+  BufferAllocator allocator_b(ram[1], 16384);
+  static Voice a;
+  static Voice b;
+  a.Init(&allocator_a);
+  b.Init(&allocator_b);
+  
+  Patch patch;
+  Modulations modulations;
+  
+  patch.engine = 0;
+  patch.note = 48.0f;
+  patch.harmonics = 0.3f;
+  patch.timbre = 0.7f;
+  patch.morph = 0.7f;
+  patch.frequency_modulation_amount = 0.0f;
+  patch.timbre_modulation_amount = 0.5f;
+  patch.morph_modulation_amount = 0.0f;
+  patch.decay = 0.5f;
+  patch.lpg_colour = 0.5f;
+  
+  modulations.engine = 0.0f;
+  modulations.note = 0.0f;
+  modulations.frequency = 0.0f;
+  modulations.harmonics = 0.0f;
+  modulations.timbre = 0.0f;
+  modulations.morph = 0.0f;
+  modulations.trigger = 0.0f;
+  modulations.level = 0.0f;
+  modulations.frequency_patched = false;
+  modulations.timbre_patched = false;
+  modulations.morph_patched = false;
+  modulations.trigger_patched = true;
+  modulations.level_patched = false;
+  
+  Voice::Frame frames[kMaxBlockSize];
+  float out[kMaxBlockSize];
+  float aux[kMaxBlockSize];
+  
+  clock_t short_time = 0;
+  clock_t float_time = 0;
+  float error = 0.0f;
+  for (size_t i = 0; i < kSampleRate * kDuration; i += kMaxBlockSize) {
+    patch.engine = static_cast<int>(i / (2 * kSampleRate)) % 16;
+    modulations.trigger = i % (kMaxBlockSize * 200) == 0 ? 1.0f : 0.0f;
+    
+    uint32_t seed = Random::state();
+    clock_t start = clock();
+    a.Render(patch, modulations, frames, kMaxBlockSize);
+    short_time += clock() - start;
+    
+    Random::Seed(seed);
+    start = clock();
+    b.Render(patch, modulations, out, aux, kMaxBlockSize, 1);
+    float_time += clock() - start;
+    
+    for (size_t j = 0; j < kMaxBlockSize; ++j) {
+      float out_16 = static_cast<float>(Clip16(out[j] * 32767.0f));
+      float aux_16 = static_cast<float>(Clip16(aux[j] * 32767.0f));
+      error = max(error, fabsf(out_16 - frames[j].out));
+      error = max(error, fabsf(aux_16 - frames[j].aux));
+    }
+  }
+  printf("Float output: max error %.0f LSB\n", error);
+  printf(
+      "16-bit output: %.3fs, float output: %.3fs\n",
+      static_cast<float>(short_time) / CLOCKS_PER_SEC,
+      static_cast<float>(float_time) / CLOCKS_PER_SEC);
+}
+
+void TestLPCWordBankCache() {
+  const int kNumVoices = 64;
+  const int kNumTriggers = 20000;
+  
+  static char cache_ram[LPC_SPEECH_SYNTH_NUM_WORD_BANKS * 16384];
+  static char voice_ram[kNumVoices][16384];
+  
+  BufferAllocator cache_allocator(cache_ram, sizeof(cache_ram));
+  static LPCSpeechSynthWordBankCache cache;
+  if (!cache.Init(
+          word_banks_, LPC_SPEECH_SYNTH_NUM_WORD_BANKS, &cache_allocator)) {
+    printf("Not enough RAM for the cache\n");
+    return;
+  }
+  
+  static LPCSpeechSynthWordBank decoding[kNumVoices];
+  static LPCSpeechSynthWordBank cached[kNumVoices];
+  static LPCSpeechSynthController controller[2][kNumVoices];
+  for (int i = 0; i < kNumVoices; ++i) {
+    BufferAllocator allocator(voice_ram[i], 16384);
+    cached[i].set_cache(&cache);
+    decoding[i].Init(word_banks_, LPC_SPEECH_SYNTH_NUM_WORD_BANKS, &allocator);
+    cached[i].Init(word_banks_, LPC_SPEECH_SYNTH_NUM_WORD_BANKS, &allocator);
+    controller[0][i].Init(&decoding[i]);
+    controller[1][i].Init(&cached[i]);
+  }
+  
+  float excitation[kMaxBlockSize];
+  float output[2][kMaxBlockSize];
+  
+  // Each trigger selects a random word in a random bank, as when many voices
+  // are sequenced with the bank under CV.
+  clock_t elapsed[2] = { 0, 0 };
+  size_t mismatches = 0;
+  for (int i = 0; i < kNumTriggers; ++i) {
+    int voice = i % kNumVoices;
+    int bank = (Random::GetWord() >> 8) % LPC_SPEECH_SYNTH_NUM_WORD_BANKS;
+    float address = Random::GetFloat();
+    uint32_t seed = Random::state();
+    for (int j = 0; j < 2; ++j) {
+      Random::Seed(seed);
+      clock_t start = clock();
+      controller[j][voice].Render(
+          false, true, bank, 100.0f / kSampleRate, 0.0f, 0.5f, address,
+          0.5f, 1.0f, excitation, output[j], kMaxBlockSize);
+      elapsed[j] += clock() - start;
+    }
+    for (size_t j = 0; j < kMaxBlockSize; ++j) {
+      mismatches += output[0][j] != output[1][j] ? 1 : 0;
+    }
+  }
+  for (int j = 0; j < 2; ++j) {
+    printf(
+        "%s: %.0f triggers/s\n",
+        j == 0 ? "Decoding" : "Cached",
+        static_cast<float>(kNumTriggers) * CLOCKS_PER_SEC / \
+            static_cast<float>(elapsed[j]));
+  }
+  printf("Cache RAM: %zu bytes, mismatches: %zu\n",
+      sizeof(cache_ram) - cache_allocator.free(), mismatches);
+  
+  // A cache holding only the first bank: the other ones are decoded into
+  // the word bank's own buffer.
+  static char partial_cache_ram[16384];
+  static char partial_voice_ram[16384];
+  BufferAllocator partial_cache_allocator(
+      partial_cache_ram, sizeof(partial_cache_ram));
+  static LPCSpeechSynthWordBankCache partial_cache;
+  partial_cache.Init(word_banks_, 1, &partial_cache_allocator);
+  
+  BufferAllocator partial_allocator(
+      partial_voice_ram, sizeof(partial_voice_ram));
+  static LPCSpeechSynthWordBank partial;
+  partial.set_cache(&partial_cache);
+  partial.Init(
+      word_banks_, LPC_SPEECH_SYNTH_NUM_WORD_BANKS, &partial_allocator);
+  
+  size_t partial_mismatches = 0;
+  for (int bank = 0; bank < LPC_SPEECH_SYNTH_NUM_WORD_BANKS; ++bank) {
+    partial.Load(bank);
+    decoding[0].Load(bank);
+    if (partial.num_frames() != decoding[0].num_frames()) {
+      ++partial_mismatches;
+      continue;
+    }
+    for (int i = 0; i < partial.num_frames(); ++i) {
+      const LPCSpeechSynth::Frame& a = partial.frames()[i];
+      const LPCSpeechSynth::Frame& b = decoding[0].frames()[i];
+      partial_mismatches += a.energy != b.energy || a.period != b.period || \
+          a.k0 != b.k0 || a.k9 != b.k9 ? 1 : 0;
+    }
+  }
+  printf("Partial cache: %zu mismatches\n", partial_mismatches);
+}
+
+void TestRenderProfiler() {
+#ifdef PROFILE_RENDER
+  static RenderHistogram histogram;
+  histogram.Init();
+  
+  // Durations uniformly distributed between 1000 and 2000, with 2% of
+  // outliers at 10000.
+  for (int i = 0; i < 10000; ++i) {
+    histogram.Add(i % 50 == 0 ? 10000 : 1000 + (i * 7919) % 1000);
+  }
+  
+  RenderHistogramSnapshot snapshot;
+  histogram.Read(&snapshot);
+  printf("Blocks: %llu, p50: %llu (1500), p99: %llu (10000)\n",
+      (unsigned long long) snapshot.total(),
+      (unsigned long long) snapshot.Quantile(0.5f),
+      (unsigned long long) snapshot.Quantile(0.99f));
+  
+  for (uint64_t d = 0; d < 1000000; d = d * 5 / 4 + 1) {
+    uint64_t v = RenderHistogram::value(RenderHistogram::bucket(d));
+    float error = fabsf(static_cast<float>(v) - static_cast<float>(d));
+    if (error > 0.0625f * static_cast<float>(d) + 0.5f) {
+      printf("Duration %llu read as %llu\n",
+          (unsigned long long) d, (unsigned long long) v);
+    }
+  }
+#else
+  printf("Build with -DPROFILE_RENDER\n");
+#endif  // PROFILE_RENDER
+}
+
 int main(void) {
   _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
   // TestFormantOscillator();
@@ -1050,6 +1689,15 @@ int main(void) {
   // TestVoice();
   // TestFMGlitch();
   // TestLimiterGlitch();
+  // TestPolyVoice();
+  // TestResonatorSvfSpeed();
+  // TestRamUsage();
+  // TestLazyEngineInit();
+  // TestLargeBlocks();
+  // TestFloatOutput();
+  // TestLPCWordBankCache();
+  // TestRenderProfiler();
+  // TestWavetableMipmaps();
   // EnumerateWavetables();
   
   // TestLPGAttackDecay();
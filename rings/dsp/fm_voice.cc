@@ -61,6 +61,7 @@ void FMVoice::Init() {
   modulator_phase_ = 0;
   gain_ = 0.0f;
   fm_amount_ = 0.0f;
+  previous_sample_ = 0.0f;
   
   follower_.Init(
       8.0f / kSampleRate,
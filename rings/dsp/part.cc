@@ -29,6 +29,7 @@
 #include "rings/dsp/part.h"
 
 #include "stmlib/dsp/units.h"
+#include "stmlib/utils/random.h"
 
 #include "rings/resources.h"
 
@@ -41,15 +42,21 @@ void Part::Init(uint16_t* reverb_buffer) {
   active_voice_ = 0;
   
   fill(&note_[0], &note_[kMaxPolyphony], 0.0f);
+  fill(&voice_level_[0], &voice_level_[kMaxPolyphony], 0.0f);
+  num_sounding_voices_ = 0;
+  num_voice_blocks_ = 0;
+  num_skipped_voice_blocks_ = 0;
   
   bypass_ = false;
   polyphony_ = 1;
   model_ = RESONATOR_MODEL_MODAL;
   dirty_ = true;
   
+  random_.Init(kDefaultRandomSeed);
+  seeded_ = false;
   for (int32_t i = 0; i < kMaxPolyphony; ++i) {
     excitation_filter_[i].Init();
-    plucker_[i].Init();
+    plucker_[i].Init(&random_);
     dc_blocker_[i].Init(1.0f - 10.0f / kSampleRate);
   }
   
@@ -72,7 +79,7 @@ void Part::ConfigureResonators() {
   switch (model_) {
     case RESONATOR_MODEL_MODAL:
       {
-        int32_t resolution = 64 / polyphony_ - 4;
+        int32_t resolution = max(64 / polyphony_ - 4, 12);
         for (int32_t i = 0; i < polyphony_; ++i) {
           resonator_[i].Init();
           resonator_[i].set_resolution(resolution);
@@ -85,20 +92,20 @@ void Part::ConfigureResonators() {
     case RESONATOR_MODEL_SYMPATHETIC_STRING_QUANTIZED:
     case RESONATOR_MODEL_STRING_AND_REVERB:
       {
-        float lfo_frequencies[kNumStrings] = {
+        float lfo_frequencies[kNumModuleStrings] = {
           0.5f, 0.4f, 0.35f, 0.23f, 0.211f, 0.2f, 0.171f
         };
         for (int32_t i = 0; i < kNumStrings; ++i) {
           bool has_dispersion = model_ == RESONATOR_MODEL_STRING || \
               model_ == RESONATOR_MODEL_STRING_AND_REVERB;
-          string_[i].Init(has_dispersion);
+          string_[i].Init(has_dispersion, &random_);
 
           float f_lfo = float(kMaxBlockSize) / float(kSampleRate);
-          f_lfo *= lfo_frequencies[i];
+          f_lfo *= lfo_frequencies[i % kNumModuleStrings];
           lfo_[i].Init<COSINE_OSCILLATOR_APPROXIMATE>(f_lfo);
         }
         for (int32_t i = 0; i < polyphony_; ++i) {
-          plucker_[i].Init();
+          plucker_[i].Init(&random_);
         }
       }
       break;
@@ -124,7 +131,7 @@ void Part::ConfigureResonators() {
 #ifdef BRYAN_CHORDS
 
 // Chord table by Bryan Noll:
-float chords[kMaxPolyphony][11][8] = {
+float chords[kModulePolyphony][11][8] = {
   {
     { -12.0f, -0.01f, 0.0f,  0.01f, 0.02f, 11.98f, 11.99f, 12.0f }, // OCT
     { -12.0f, -5.0f,  0.0f,  6.99f, 7.0f,  11.99f, 12.0f,  19.0f }, // 5
@@ -182,7 +189,7 @@ float chords[kMaxPolyphony][11][8] = {
 #else
 
 // Original chord table
-float chords[kMaxPolyphony][11][8] = {
+float chords[kModulePolyphony][11][8] = {
   {
     { -12.0f, 0.0f, 0.01f, 0.02f, 0.03f, 11.98f, 11.99f, 12.0f },
     { -12.0f, 0.0f, 3.0f,  3.01f, 7.0f,  9.99f,  10.0f,  19.0f },
@@ -265,7 +272,8 @@ void Part::ComputeSympatheticStringsNotes(
   if (parameter >= 2.0f) {
     // Quantized chords
     int32_t chord_index = parameter - 2.0f;
-    const float* chord = chords[polyphony_ - 1][chord_index];
+    int32_t chord_table = min(polyphony_, kModulePolyphony) - 1;
+    const float* chord = chords[chord_table][chord_index];
     for (size_t i = 0; i < num_strings; ++i) {
       destination[i] = chord[i] + note;
     }
@@ -360,7 +368,7 @@ void Part::RenderStringVoice(
 
   if (model_ == RESONATOR_MODEL_SYMPATHETIC_STRING ||
       model_ == RESONATOR_MODEL_SYMPATHETIC_STRING_QUANTIZED) {
-    num_strings = 2 * kMaxPolyphony / polyphony_;
+    num_strings = max(kNumModuleStrings / polyphony_, 2);
     float parameter = model_ == RESONATOR_MODEL_SYMPATHETIC_STRING
         ? patch.structure
         : 2.0f + performance_state.chord;
@@ -460,6 +468,40 @@ const int32_t kPingPattern[] = {
   1, 0, 2, 1, 0, 2, 1, 0
 };
 
+int32_t Part::AllocateVoice() const {
+  // First idle voice after the active one - or the quietest voice.
+  int32_t quietest_voice = active_voice_;
+  float quietest_level = voice_level_[active_voice_];
+  for (int32_t i = 1; i <= polyphony_; ++i) {
+    int32_t voice = (active_voice_ + i) % polyphony_;
+    if (voice_level_[voice] < kSilenceThreshold) {
+      return voice;
+    }
+    if (voice_level_[voice] < quietest_level) {
+      quietest_voice = voice;
+      quietest_level = voice_level_[voice];
+    }
+  }
+  return quietest_voice;
+}
+
+int32_t Part::ScheduleVoices(const Patch& patch) {
+  // With a high damping setting, the FM voice keeps playing without input.
+  bool drone = model_ == RESONATOR_MODEL_FM_VOICE && patch.damping >= 0.9f;
+  int32_t num_voices = 0;
+  for (int32_t voice = 0; voice < polyphony_; ++voice) {
+    if (voice == active_voice_ ||
+        drone ||
+        voice_level_[voice] >= kSilenceThreshold) {
+      voice_schedule_[num_voices++] = voice;
+    }
+  }
+  num_sounding_voices_ = num_voices;
+  num_voice_blocks_ += polyphony_;
+  num_skipped_voice_blocks_ += polyphony_ - num_voices;
+  return num_voices;
+}
+
 void Part::Process(
     const PerformanceState& performance_state,
     const Patch& patch,
@@ -475,6 +517,14 @@ void Part::Process(
     return;
   }
   
+  // Unless the part has been given its own seed, its generator continues the
+  // sequence of stmlib::Random, from which the rest of the module also draws:
+  // the module's noise bursts and dispersion are those of the global
+  // generator.
+  if (!seeded_) {
+    random_.Init(Random::state());
+  }
+  
   ConfigureResonators();
   
   note_filter_.Process(
@@ -483,7 +533,9 @@ void Part::Process(
 
   if (performance_state.strum) {
     note_[active_voice_] = note_filter_.stable_note();
-    if (polyphony_ > 1 && polyphony_ & 1) {
+    if (polyphony_ > kModulePolyphony) {
+      active_voice_ = AllocateVoice();
+    } else if (polyphony_ > 1 && polyphony_ & 1) {
       active_voice_ = kPingPattern[step_counter_ % 8];
       step_counter_ = (step_counter_ + 1) % 8;
     } else {
@@ -495,7 +547,19 @@ void Part::Process(
   
   fill(&out[0], &out[size], 0.0f);
   fill(&aux[0], &aux[size], 0.0f);
-  for (int32_t voice = 0; voice < polyphony_; ++voice) {
+  
+  RenderFn render_fn = &Part::RenderStringVoice;
+  if (model_ == RESONATOR_MODEL_MODAL) {
+    render_fn = &Part::RenderModalVoice;
+  } else if (model_ == RESONATOR_MODEL_FM_VOICE) {
+    render_fn = &Part::RenderFMVoice;
+  }
+  
+  // Idle voices are skipped, the output of their resonators having decayed
+  // to silence.
+  int32_t num_voices = ScheduleVoices(patch);
+  for (int32_t n = 0; n < num_voices; ++n) {
+    int32_t voice = voice_schedule_[n];
     // Compute MIDI note value, frequency, and cutoff frequency for excitation
     // filter.
     float cutoff = patch.brightness * (2.0f - patch.brightness);
@@ -517,16 +581,12 @@ void Part::Process(
       fill(&resonator_input_[0], &resonator_input_[size], 0.0f);
     }
     
-    if (model_ == RESONATOR_MODEL_MODAL) {
-      RenderModalVoice(
-          voice, performance_state, patch, frequency, filter_cutoff, size);
-    } else if (model_ == RESONATOR_MODEL_FM_VOICE) {
-      RenderFMVoice(
-          voice, performance_state, patch, frequency, filter_cutoff, size);
-    } else {
-      RenderStringVoice(
-          voice, performance_state, patch, frequency, filter_cutoff, size);
-    }
+    (this->*render_fn)(
+        voice, performance_state, patch, frequency, filter_cutoff, size);
+    
+    voice_level_[voice] = max(
+        BlockPeak(out_buffer_, size),
+        BlockPeak(aux_buffer_, size));
     
     if (polyphony_ == 1) {
       // Send the two sets of harmonics / pickups to individual outputs.
@@ -563,6 +623,10 @@ void Part::Process(
   
   // Apply limiter to string output.
   limiter_.Process(out, aux, size, model_gains_[model_]);
+  
+  if (!seeded_) {
+    Random::Seed(random_.state());
+  }
 }
 
 /* static */
@@ -43,9 +43,17 @@
 #include "rings/dsp/patch.h"
 #include "rings/dsp/performance_state.h"
 #include "rings/dsp/plucker.h"
+#include "rings/dsp/random.h"
 #include "rings/dsp/resonator.h"
+#include "rings/dsp/silence_detector.h"
 #include "rings/dsp/string.h"
 
+// The module plays up to 4 voices. Host builds can raise this limit: above 4
+// voices, a new note goes to an idle voice, or steals the quietest one.
+#ifndef MAX_POLYPHONY
+#define MAX_POLYPHONY 4
+#endif  // MAX_POLYPHONY
+
 namespace rings {
 
 enum ResonatorModel {
@@ -60,8 +68,18 @@ enum ResonatorModel {
   RESONATOR_MODEL_LAST
 };
 
-const int32_t kMaxPolyphony = 4;
-const int32_t kNumStrings = kMaxPolyphony * 2;
+const int32_t kMaxPolyphony = MAX_POLYPHONY;
+
+// Polyphony of the module, for which the chord tables and the allocation of
+// the 8 strings between the voices are designed. Beyond it, each voice has
+// 2 strings.
+const int32_t kModulePolyphony = 4;
+const int32_t kNumModuleStrings = kModulePolyphony * 2;
+const int32_t kNumStrings = kMaxPolyphony > kModulePolyphony
+    ? kMaxPolyphony * 2
+    : kNumModuleStrings;
+
+const uint32_t kDefaultRandomSeed = 0x21;
 
 class Part {
  public:
@@ -91,6 +109,25 @@ class Part {
     dirty_ = true;
   }
   
+  // Seeds the generator of the noise bursts and of the string dispersion.
+  // Until then, the part draws from stmlib::Random, like the module does.
+  // Parts rendered side by side, on several threads, must have their own
+  // seeds - different ones.
+  inline void set_seed(uint32_t seed) {
+    random_.Init(seed);
+    seeded_ = true;
+  }
+  
+  // Number of voices rendered during the last block.
+  inline int32_t num_sounding_voices() const { return num_sounding_voices_; }
+  
+  // Number of voice-blocks since Init, and number of voice-blocks skipped
+  // because the voice was idle.
+  inline uint32_t num_voice_blocks() const { return num_voice_blocks_; }
+  inline uint32_t num_skipped_voice_blocks() const {
+    return num_skipped_voice_blocks_;
+  }
+  
   inline ResonatorModel model() const { return model_; }
   inline void set_model(ResonatorModel model) {
     if (model != model_) {
@@ -100,7 +137,17 @@ class Part {
   }
 
  private:
+  typedef void (Part::*RenderFn)(
+      int32_t voice,
+      const PerformanceState& performance_state,
+      const Patch& patch,
+      float frequency,
+      float filter_cutoff,
+      size_t size);
+  
   void ConfigureResonators();
+  int32_t AllocateVoice() const;
+  int32_t ScheduleVoices(const Patch& patch);
   void RenderModalVoice(
       int32_t voice,
       const PerformanceState& performance_state,
@@ -159,6 +206,12 @@ class Part {
   int32_t active_voice_;
   uint32_t step_counter_;
   int32_t polyphony_;
+  int32_t num_sounding_voices_;
+  uint32_t num_voice_blocks_;
+  uint32_t num_skipped_voice_blocks_;
+  
+  float voice_level_[kMaxPolyphony];
+  int32_t voice_schedule_[kMaxPolyphony];
   
   Resonator resonator_[kMaxPolyphony];
   String string_[kNumStrings];
@@ -168,6 +221,8 @@ class Part {
   stmlib::Svf excitation_filter_[kMaxPolyphony];
   stmlib::DCBlocker dc_blocker_[kMaxPolyphony];
   Plucker plucker_[kMaxPolyphony];
+  RandomGenerator random_;
+  bool seeded_;
 
   float note_[kMaxPolyphony];
   NoteFilter note_filter_;
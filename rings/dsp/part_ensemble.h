@@ -0,0 +1,175 @@
+// Copyright 2015 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Ensemble of independent Parts (each with its own strummer, reverb buffer
+// and random generator) rendered block by block on a pool of threads. Host
+// only.
+//
+// Each worker owns a contiguous range of parts, so that a part is usually
+// rendered by the same core from one block to the next. A worker which has
+// rendered its range steals the remaining parts of the other ranges. Process
+// returns once all the parts have been rendered. The output does not depend
+// on the number of workers.
+//
+// The parts are rendered one after the other by each worker: their states are
+// not interleaved to run the same stages of several parts in SIMD lanes. This
+// would require splitting Part::Process into stages shared by all the parts,
+// and changing the layout of every filter, delay line and reverb - the
+// ensemble only scales across cores. TestEnsemble checks the speedup with 2
+// and 4 workers on a host with that many cores.
+
+#ifndef RINGS_DSP_PART_ENSEMBLE_H_
+#define RINGS_DSP_PART_ENSEMBLE_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "host/worker_pool.h"
+
+#include "rings/dsp/dsp.h"
+#include "rings/dsp/part.h"
+#include "rings/dsp/patch.h"
+#include "rings/dsp/performance_state.h"
+#include "rings/dsp/strummer.h"
+
+namespace rings {
+
+const size_t kEnsembleReverbBufferSize = 32768;
+
+struct EnsembleMember {
+  Part part;
+  Strummer strummer;
+  PerformanceState performance_state;
+  Patch patch;
+  
+  float in[kMaxBlockSize];
+  float out[kMaxBlockSize];
+  float aux[kMaxBlockSize];
+  
+  uint16_t reverb_buffer[kEnsembleReverbBufferSize];
+};
+
+class PartEnsemble {
+ public:
+  PartEnsemble() : members_(NULL), num_parts_(0) { }
+  ~PartEnsemble() { delete[] members_; }
+  
+  // The number of workers is capped to the number of cores.
+  void Init(int32_t num_parts, int32_t num_workers) {
+    workers_.Init(num_workers);
+    delete[] members_;
+    num_parts_ = num_parts;
+    members_ = new EnsembleMember[num_parts_];
+    for (int32_t i = 0; i < num_parts_; ++i) {
+      EnsembleMember* m = &members_[i];
+      m->strummer.Init(0.01f, kSampleRate / kMaxBlockSize);
+      m->part.Init(m->reverb_buffer);
+      m->part.set_seed(kDefaultRandomSeed + i);
+      m->performance_state.strum = false;
+      m->performance_state.internal_exciter = true;
+      m->performance_state.internal_strum = false;
+      m->performance_state.internal_note = false;
+      m->performance_state.tonic = 0.0f;
+      m->performance_state.note = 48.0f;
+      m->performance_state.fm = 0.0f;
+      m->performance_state.chord = 0;
+      m->patch.structure = 0.25f;
+      m->patch.brightness = 0.5f;
+      m->patch.damping = 0.5f;
+      m->patch.position = 0.5f;
+      std::fill(&m->in[0], &m->in[kMaxBlockSize], 0.0f);
+    }
+  }
+  
+  // Renders a block of all the parts. The inputs, performance states and
+  // patches of the parts are read, and their outputs written, before and
+  // after this call - not during.
+  void Process(size_t size) {
+    size_ = size;
+    int32_t num_workers = workers_.num_workers();
+    for (int32_t i = 0; i < num_workers; ++i) {
+      range_[i].next.store(
+          i * num_parts_ / num_workers, std::memory_order_relaxed);
+      range_[i].end = (i + 1) * num_parts_ / num_workers;
+    }
+    workers_.Run(&RenderTask, this);
+  }
+  
+  inline int32_t num_parts() const { return num_parts_; }
+  inline int32_t num_workers() const { return workers_.num_workers(); }
+  
+  inline Part* mutable_part(int32_t i) { return &members_[i].part; }
+  inline PerformanceState* mutable_performance_state(int32_t i) {
+    return &members_[i].performance_state;
+  }
+  inline Patch* mutable_patch(int32_t i) { return &members_[i].patch; }
+  inline float* mutable_in(int32_t i) { return members_[i].in; }
+  inline const float* out(int32_t i) const { return members_[i].out; }
+  inline const float* aux(int32_t i) const { return members_[i].aux; }
+
+ private:
+  // Parts left to render in the range of a worker. On its own cache line, to
+  // avoid false sharing between workers.
+  struct alignas(64) Range {
+    std::atomic<int32_t> next;
+    int32_t end;
+  };
+  
+  static void RenderTask(void* context, int32_t worker, int32_t num_workers) {
+    PartEnsemble* ensemble = static_cast<PartEnsemble*>(context);
+    // Own range first, then the other ones, starting with the next worker's.
+    for (int32_t n = 0; n < num_workers; ++n) {
+      Range* range = &ensemble->range_[(worker + n) % num_workers];
+      int32_t i;
+      while ((i = range->next.fetch_add(1, std::memory_order_relaxed)) < \
+                 range->end) {
+        ensemble->RenderPart(i);
+      }
+    }
+  }
+  
+  inline void RenderPart(int32_t i) {
+    EnsembleMember* m = &members_[i];
+    m->strummer.Process(m->in, size_, &m->performance_state);
+    m->part.Process(
+        m->performance_state, m->patch, m->in, m->out, m->aux, size_);
+  }
+  
+  EnsembleMember* members_;
+  int32_t num_parts_;
+  size_t size_;
+  
+  Range range_[host::kMaxNumWorkers];
+  host::WorkerPool workers_;
+  
+  DISALLOW_COPY_AND_ASSIGN(PartEnsemble);
+};
+
+}  // namespace rings
+
+#endif  // RINGS_DSP_PART_ENSEMBLE_H_
@@ -35,7 +35,8 @@
 
 #include "stmlib/dsp/filter.h"
 #include "stmlib/dsp/delay_line.h"
-#include "stmlib/utils/random.h"
+
+#include "rings/dsp/random.h"
 
 namespace rings {
 
@@ -44,7 +45,8 @@ class Plucker {
   Plucker() { }
   ~Plucker() { }
   
-  void Init() {
+  void Init(RandomGenerator* random) {
+    random_ = random;
     svf_.Init();
     comb_filter_.Init();
     remaining_samples_ = 0;
@@ -69,7 +71,7 @@ class Plucker {
     for (size_t i = 0; i < size; ++i) {
       float in = 0.0f;
       if (remaining_samples_) {
-        in = 2.0f * Random::GetFloat() - 1.0f;
+        in = 2.0f * random_->GetFloat() - 1.0f;
         --remaining_samples_;
       }
       out[i] = in + comb_gain * comb_filter_.Read(comb_delay);
@@ -79,6 +81,7 @@ class Plucker {
   }
 
  private:
+  RandomGenerator* random_;
   stmlib::Svf svf_;
   stmlib::DelayLine<float, 256> comb_filter_;
   size_t remaining_samples_;
@@ -28,6 +28,10 @@
 
 #include "rings/dsp/resonator.h"
 
+#ifdef __SSE2__
+#include <xmmintrin.h>
+#endif  // __SSE2__
+
 #include "stmlib/dsp/dsp.h"
 #include "stmlib/dsp/cosine_oscillator.h"
 #include "stmlib/dsp/parameter_interpolator.h"
@@ -39,9 +43,20 @@ namespace rings {
 using namespace std;
 using namespace stmlib;
 
+#ifdef USE_FILTER_UPDATE_THRESHOLD
+// The filters are recomputed only when one of their parameters has moved by
+// more than this amount (relative, for the frequency) since the last update.
+const float kFilterUpdateThreshold = 1e-5f;
+#endif  // USE_FILTER_UPDATE_THRESHOLD
+
 void Resonator::Init() {
+  Svf f;
+  f.Init();
   for (int32_t i = 0; i < kMaxModes; ++i) {
-    f_[i].Init();
+    g_[i] = f.g();
+    r_[i] = f.r();
+    h_[i] = f.h();
+    state_1_[i] = state_2_[i] = 0.0f;
   }
 
   set_frequency(220.0f / kSampleRate);
@@ -51,9 +66,43 @@ void Resonator::Init() {
   set_position(0.999f);
   previous_position_ = 0.0f;
   set_resolution(kMaxModes);
+  
+#ifdef USE_FILTER_UPDATE_THRESHOLD
+  // Forces the computation of the filters on the first block.
+  filter_frequency_ = -1.0f;
+  filter_structure_ = filter_brightness_ = filter_damping_ = 0.0f;
+  filter_resolution_ = 0;
+  num_modes_ = 0;
+#endif  // USE_FILTER_UPDATE_THRESHOLD
+  num_blocks_ = 0;
+  num_filter_updates_ = 0;
+  silence_detector_.Init();
 }
 
+#ifdef USE_FILTER_UPDATE_THRESHOLD
+bool Resonator::FiltersNeedUpdate() const {
+  float frequency_threshold = kFilterUpdateThreshold * frequency_;
+  return fabsf(frequency_ - filter_frequency_) > frequency_threshold ||
+      resolution_ != filter_resolution_ ||
+      fabsf(structure_ - filter_structure_) > kFilterUpdateThreshold ||
+      fabsf(brightness_ - filter_brightness_) > kFilterUpdateThreshold ||
+      fabsf(damping_ - filter_damping_) > kFilterUpdateThreshold;
+}
+#endif  // USE_FILTER_UPDATE_THRESHOLD
+
 int32_t Resonator::ComputeFilters() {
+#ifdef USE_FILTER_UPDATE_THRESHOLD
+  if (!FiltersNeedUpdate()) {
+    return num_modes_;
+  }
+  filter_frequency_ = frequency_;
+  filter_structure_ = structure_;
+  filter_brightness_ = brightness_;
+  filter_damping_ = damping_;
+  filter_resolution_ = resolution_;
+#endif  // USE_FILTER_UPDATE_THRESHOLD
+  ++num_filter_updates_;
+  
   float stiffness = Interpolate(lut_stiffness, structure_, 256.0f);
   float harmonic = frequency_;
   float stretch_factor = 1.0f; 
@@ -78,9 +127,9 @@ int32_t Resonator::ComputeFilters() {
     } else {
       num_modes = i + 1;
     }
-    f_[i].set_f_q<FREQUENCY_FAST>(
-        partial_frequency,
-        1.0f + partial_frequency * q);
+    g_[i] = OnePole::tan<FREQUENCY_FAST>(partial_frequency);
+    r_[i] = 1.0f / (1.0f + partial_frequency * q);
+    h_[i] = 1.0f / (1.0f + r_[i] * g_[i] + g_[i] * g_[i]);
     stretch_factor += stiffness;
     if (stiffness < 0.0f) {
       // Make sure that the partials do not fold back into negative frequencies.
@@ -95,10 +144,39 @@ int32_t Resonator::ComputeFilters() {
     q *= q_loss;
   }
   
+#ifdef USE_FILTER_UPDATE_THRESHOLD
+  num_modes_ = num_modes;
+#endif  // USE_FILTER_UPDATE_THRESHOLD
   return num_modes;
 }
 
 void Resonator::Process(const float* in, float* out, float* aux, size_t size) {
+  ++num_blocks_;
+  if (silence_detector_.Sleep(in, size)) {
+    previous_position_ = position_;
+    fill(&out[0], &out[size], 0.0f);
+    fill(&aux[0], &aux[size], 0.0f);
+    return;
+  }
+  
+#ifdef USE_SIMD_MODAL_BANK
+  ProcessSIMD(in, out, aux, size);
+#else
+  ProcessScalar(in, out, aux, size);
+#endif  // USE_SIMD_MODAL_BANK
+
+  float level = max(BlockPeak(out, size), BlockPeak(aux, size));
+  if (silence_detector_.Process(level, size, 0)) {
+    fill(&state_1_[0], &state_1_[kMaxModes], 0.0f);
+    fill(&state_2_[0], &state_2_[kMaxModes], 0.0f);
+  }
+}
+
+void Resonator::ProcessScalar(
+    const float* in,
+    float* out,
+    float* aux,
+    size_t size) {
   int32_t num_modes = ComputeFilters();
   
   ParameterInterpolator position(&previous_position_, position_, size);
@@ -111,12 +189,94 @@ void Resonator::Process(const float* in, float* out, float* aux, size_t size) {
     float even = 0.0f;
     amplitudes.Start();
     for (int32_t i = 0; i < num_modes;) {
-      odd += amplitudes.Next() * f_[i++].Process<FILTER_MODE_BAND_PASS>(input);
-      even += amplitudes.Next() * f_[i++].Process<FILTER_MODE_BAND_PASS>(input);
+      odd += amplitudes.Next() * ProcessMode(i++, input);
+      even += amplitudes.Next() * ProcessMode(i++, input);
     }
     *out++ = odd;
     *aux++ = even;
   }
 }
 
+#ifdef __SSE2__
+
+void Resonator::ComputeWeights(
+    float position,
+    int32_t num_modes,
+    float* weight) {
+  CosineOscillator amplitudes;
+  amplitudes.Init<COSINE_OSCILLATOR_APPROXIMATE>(position);
+  amplitudes.Start();
+  for (int32_t i = 0; i < num_modes; ++i) {
+    weight[i] = amplitudes.Next();
+  }
+}
+
+void Resonator::ProcessSIMD(
+    const float* in,
+    float* out,
+    float* aux,
+    size_t size) {
+  int32_t num_modes = ComputeFilters();
+  // The scalar version processes the modes by pairs. Here they are processed
+  // by groups of 4, the extra modes having a weight of 0.
+  int32_t num_weighted_modes = (num_modes + 1) & ~1;
+  int32_t num_simd_modes = (num_modes + 3) & ~3;
+  
+  // The weights are computed for the first and last samples of the block,
+  // and linearly interpolated in-between - they are exact when the position
+  // does not move.
+  float weight[kMaxModes];
+  float weight_increment[kMaxModes];
+  float position_increment = (position_ - previous_position_) / size;
+  float first_position = previous_position_ + position_increment;
+  ComputeWeights(first_position, num_weighted_modes, weight);
+  ComputeWeights(position_, num_weighted_modes, weight_increment);
+  float scale = size > 1 ? 1.0f / static_cast<float>(size - 1) : 0.0f;
+  for (int32_t i = 0; i < num_weighted_modes; ++i) {
+    weight_increment[i] = (weight_increment[i] - weight[i]) * scale;
+  }
+  for (int32_t i = num_weighted_modes; i < num_simd_modes; ++i) {
+    weight[i] = weight_increment[i] = 0.0f;
+  }
+  previous_position_ = position_;
+  
+  // All the groups of 4 modes are updated for each sample, so that their
+  // computations can overlap.
+  for (size_t t = 0; t < size; ++t) {
+    const __m128 x = _mm_set1_ps(*in++ * 0.125f);
+    const __m128 step = _mm_set1_ps(static_cast<float>(t));
+    __m128 sum = _mm_setzero_ps();
+    for (int32_t i = 0; i < num_simd_modes; i += 4) {
+      const __m128 g = _mm_loadu_ps(&g_[i]);
+      const __m128 r = _mm_loadu_ps(&r_[i]);
+      const __m128 h = _mm_loadu_ps(&h_[i]);
+      __m128 state_1 = _mm_loadu_ps(&state_1_[i]);
+      __m128 state_2 = _mm_loadu_ps(&state_2_[i]);
+      __m128 hp = _mm_sub_ps(x, _mm_mul_ps(r, state_1));
+      hp = _mm_sub_ps(hp, _mm_mul_ps(g, state_1));
+      hp = _mm_mul_ps(_mm_sub_ps(hp, state_2), h);
+      __m128 g_hp = _mm_mul_ps(g, hp);
+      __m128 bp = _mm_add_ps(g_hp, state_1);
+      state_1 = _mm_add_ps(g_hp, bp);
+      __m128 g_bp = _mm_mul_ps(g, bp);
+      __m128 lp = _mm_add_ps(g_bp, state_2);
+      state_2 = _mm_add_ps(g_bp, lp);
+      _mm_storeu_ps(&state_1_[i], state_1);
+      _mm_storeu_ps(&state_2_[i], state_2);
+      __m128 w = _mm_add_ps(
+          _mm_loadu_ps(&weight[i]),
+          _mm_mul_ps(_mm_loadu_ps(&weight_increment[i]), step));
+      sum = _mm_add_ps(sum, _mm_mul_ps(w, bp));
+    }
+    
+    // Even lanes hold the odd modes (1st, 3rd...), odd lanes the even ones.
+    float s[4];
+    _mm_storeu_ps(s, sum);
+    *out++ = s[0] + s[2];
+    *aux++ = s[1] + s[3];
+  }
+}
+
+#endif  // __SSE2__
+
 }  // namespace rings
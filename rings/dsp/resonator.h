@@ -25,6 +25,15 @@
 // -----------------------------------------------------------------------------
 //
 // Resonator.
+//
+// The modes are stored as a structure of arrays. The SIMD version of Process
+// updates 4 band-pass filters per instruction, and applies the amplitude of
+// each mode (which depends on the excitation position) in the same pass. The
+// amplitudes are computed at both ends of the block and interpolated, instead
+// of being computed for each sample.
+//
+// The resonator goes to sleep once its input and output have been silent for
+// a few blocks, and is not processed until it is excited again.
 
 #ifndef RINGS_DSP_RESONATOR_H_
 #define RINGS_DSP_RESONATOR_H_
@@ -34,9 +43,18 @@
 #include <algorithm>
 
 #include "rings/dsp/dsp.h"
+#include "rings/dsp/silence_detector.h"
 #include "stmlib/dsp/filter.h"
 #include "stmlib/dsp/delay_line.h"
 
+// #define USE_SIMD_MODAL_BANK
+
+// When defined, the filter coefficients are only recomputed when a parameter
+// has moved by more than 1e-5 since their last computation. This saves time
+// on the SIMD bank only, and detunes the modes by up to 0.02 cents - so it is
+// left disabled on the module.
+// #define USE_FILTER_UPDATE_THRESHOLD
+
 namespace rings {
 
 const int32_t kMaxModes = 64;
@@ -53,6 +71,20 @@ class Resonator {
       float* aux,
       size_t size);
   
+  void ProcessScalar(
+      const float* in,
+      float* out,
+      float* aux,
+      size_t size);
+  
+#ifdef __SSE2__
+  void ProcessSIMD(
+      const float* in,
+      float* out,
+      float* aux,
+      size_t size);
+#endif  // __SSE2__
+  
   inline void set_frequency(float frequency) {
     frequency_ = frequency;
   }
@@ -78,8 +110,36 @@ class Resonator {
     resolution_ = std::min(resolution, kMaxModes);
   }
   
+  // Number of blocks processed since Init, number of blocks for which the
+  // filter coefficients had to be recomputed, and number of blocks skipped
+  // while sleeping.
+  inline uint32_t num_blocks() const { return num_blocks_; }
+  inline uint32_t num_filter_updates() const { return num_filter_updates_; }
+  inline uint32_t num_sleeping_blocks() const {
+    return silence_detector_.num_sleeping_blocks();
+  }
+  inline bool sleeping() const { return silence_detector_.sleeping(); }
+  
  private:
+#ifdef USE_FILTER_UPDATE_THRESHOLD
+  bool FiltersNeedUpdate() const;
+#endif  // USE_FILTER_UPDATE_THRESHOLD
   int32_t ComputeFilters();
+#ifdef __SSE2__
+  void ComputeWeights(float position, int32_t num_modes, float* weight);
+#endif  // __SSE2__
+  
+  // Same computation as stmlib::Svf::Process<FILTER_MODE_BAND_PASS>.
+  inline float ProcessMode(int32_t i, float in) {
+    float hp = (in - r_[i] * state_1_[i] - g_[i] * state_1_[i] - state_2_[i]);
+    hp *= h_[i];
+    float bp = g_[i] * hp + state_1_[i];
+    state_1_[i] = g_[i] * hp + bp;
+    float lp = g_[i] * bp + state_2_[i];
+    state_2_[i] = g_[i] * bp + lp;
+    return bp;
+  }
+  
   float frequency_;
   float structure_;
   float brightness_;
@@ -89,7 +149,26 @@ class Resonator {
   
   int32_t resolution_;
   
-  stmlib::Svf f_[kMaxModes];
+#ifdef USE_FILTER_UPDATE_THRESHOLD
+  // Parameters for which the filters were last computed.
+  float filter_frequency_;
+  float filter_structure_;
+  float filter_brightness_;
+  float filter_damping_;
+  int32_t filter_resolution_;
+  int32_t num_modes_;
+#endif  // USE_FILTER_UPDATE_THRESHOLD
+  
+  uint32_t num_blocks_;
+  uint32_t num_filter_updates_;
+  
+  SilenceDetector silence_detector_;
+  
+  float g_[kMaxModes];
+  float r_[kMaxModes];
+  float h_[kMaxModes];
+  float state_1_[kMaxModes];
+  float state_2_[kMaxModes];
   
   DISALLOW_COPY_AND_ASSIGN(Resonator);
 };
@@ -0,0 +1,115 @@
+// Copyright 2015 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Puts a string or a resonator to sleep once its input and its output have
+// been silent for a few blocks - and, for a string, for longer than it takes
+// the excitation to travel through the delay line. A sleeping string or
+// resonator is not processed; it is woken up by the next excitation.
+
+#ifndef RINGS_DSP_SILENCE_DETECTOR_H_
+#define RINGS_DSP_SILENCE_DETECTOR_H_
+
+#include "stmlib/stmlib.h"
+
+#include <cmath>
+
+namespace rings {
+
+// Level below which a signal is considered silent (-100 dB).
+const float kSilenceThreshold = 1.0e-5f;
+
+// Number of silent blocks after which the string or resonator goes to sleep,
+// in addition to its latency.
+const size_t kSleepDelay = 8;
+
+inline float BlockPeak(const float* x, size_t size) {
+  float peak = 0.0f;
+  for (size_t i = 0; i < size; ++i) {
+    float a = fabsf(x[i]);
+    peak = a > peak ? a : peak;
+  }
+  return peak;
+}
+
+class SilenceDetector {
+ public:
+  SilenceDetector() { }
+  ~SilenceDetector() { }
+  
+  void Init() {
+    sleeping_ = false;
+    silent_input_ = false;
+    num_silent_samples_ = 0;
+    num_sleeping_blocks_ = 0;
+  }
+  
+  // Called before processing a block. Returns true if the block can be
+  // skipped.
+  inline bool Sleep(const float* in, size_t size) {
+    silent_input_ = BlockPeak(in, size) < kSilenceThreshold;
+    if (sleeping_ && silent_input_) {
+      ++num_sleeping_blocks_;
+      return true;
+    }
+    sleeping_ = false;
+    return false;
+  }
+  
+  // Called after processing a block, with the peak level of the output.
+  // latency is the number of samples it can take for the input to reach the
+  // output (the length of the delay line of a string): until then, a silent
+  // output does not mean that the string has stopped ringing.
+  // Returns true when going to sleep - the state of the string or resonator
+  // must then be cleared, so that no denormals linger in it.
+  inline bool Process(float output_level, size_t size, size_t latency) {
+    if (silent_input_ && output_level < kSilenceThreshold) {
+      num_silent_samples_ += size;
+      if (num_silent_samples_ >= latency + kSleepDelay * size) {
+        num_silent_samples_ = 0;
+        sleeping_ = true;
+        return true;
+      }
+    } else {
+      num_silent_samples_ = 0;
+    }
+    return false;
+  }
+  
+  inline bool sleeping() const { return sleeping_; }
+  inline uint32_t num_sleeping_blocks() const { return num_sleeping_blocks_; }
+  
+ private:
+  bool sleeping_;
+  bool silent_input_;
+  size_t num_silent_samples_;
+  uint32_t num_sleeping_blocks_;
+  
+  DISALLOW_COPY_AND_ASSIGN(SilenceDetector);
+};
+
+}  // namespace rings
+
+#endif  // RINGS_DSP_SILENCE_DETECTOR_H_
@@ -33,7 +33,6 @@
 #include "stmlib/dsp/dsp.h"
 #include "stmlib/dsp/parameter_interpolator.h"
 #include "stmlib/dsp/units.h"
-#include "stmlib/utils/random.h"
 
 #include "rings/resources.h"
 
@@ -42,8 +41,9 @@ namespace rings {
 using namespace std;
 using namespace stmlib;
 
-void String::Init(bool enable_dispersion) {
+void String::Init(bool enable_dispersion, RandomGenerator* random) {
   enable_dispersion_ = enable_dispersion;
+  random_ = random;
   
   string_.Init();
   stretch_.Init();
@@ -67,10 +67,25 @@ void String::Init(bool enable_dispersion) {
   aux_sample_[0] = aux_sample_[1] = 0.0f;
   
   dc_blocker_.Init(1.0f - 20.0f / kSampleRate);
+  
+  num_blocks_ = 0;
+  silence_detector_.Init();
+}
+
+void String::Clear() {
+  string_.Reset();
+  stretch_.Reset();
+  fir_damping_filter_.Reset();
+  iir_damping_filter_.Reset();
+  dc_blocker_.Init(1.0f - 20.0f / kSampleRate);
+  dispersion_noise_ = 0.0f;
+  curved_bridge_ = 0.0f;
+  out_sample_[0] = out_sample_[1] = 0.0f;
+  aux_sample_[0] = aux_sample_[1] = 0.0f;
 }
 
 template<bool enable_dispersion>
-void String::ProcessInternal(
+float String::ProcessInternal(
     const float* in,
     float* out,
     float* aux,
@@ -127,6 +142,7 @@ void String::ProcessInternal(
       1.0f - Interpolate(lut_svf_shift, damping_cutoff, 1.0f),
       size);
   
+  float level = 0.0f;
   while (size--) {
     src_phase_ += src_ratio;
     if (src_phase_ > 1.0f) {
@@ -143,7 +159,7 @@ void String::ProcessInternal(
       float s = 0.0f;
 
       if (enable_dispersion) {
-        float noise = 2.0f * Random::GetFloat() - 1.0f;
+        float noise = 2.0f * random_->GetFloat() - 1.0f;
         noise *= 1.0f / (0.2f + noise_filter);
         dispersion_noise_ += noise_filter * (noise - dispersion_noise_);
 
@@ -200,18 +216,31 @@ void String::ProcessInternal(
 
       out_sample_[0] = s;
       aux_sample_[0] = string_.Read(comb_delay);
+      level = max(level, fabsf(s));
     }
     *out++ += Crossfade(out_sample_[1], out_sample_[0], src_phase_);
     *aux++ += Crossfade(aux_sample_[1], aux_sample_[0], src_phase_);
     in++;
   }
+  return level;
 }
 
 void String::Process(const float* in, float* out, float* aux, size_t size) {
-  if (enable_dispersion_) {
-    ProcessInternal<true>(in, out, aux, size);
-  } else {
-    ProcessInternal<false>(in, out, aux, size);
+  ++num_blocks_;
+  // The output is accumulated: nothing to do when sleeping.
+  if (silence_detector_.Sleep(in, size)) {
+    return;
+  }
+  
+  float level = enable_dispersion_
+      ? ProcessInternal<true>(in, out, aux, size)
+      : ProcessInternal<false>(in, out, aux, size);
+  
+  // The excitation reaches the output again after a period of the string -
+  // longer than the delay line itself when f0 < 11.7 Hz.
+  float period = min(1.0f / frequency_, kMaxSleepLatency);
+  if (silence_detector_.Process(level, size, static_cast<size_t>(period))) {
+    Clear();
   }
 }
 
@@ -25,6 +25,9 @@
 // -----------------------------------------------------------------------------
 //
 // Comb filter / KS string.
+//
+// The string goes to sleep once its input and output have been silent for a
+// few blocks, and is not processed until it is excited again.
 
 #ifndef RINGS_DSP_STRING_H_
 #define RINGS_DSP_STRING_H_
@@ -37,24 +40,34 @@
 #include "stmlib/dsp/filter.h"
 
 #include "rings/dsp/dsp.h"
+#include "rings/dsp/random.h"
+#include "rings/dsp/silence_detector.h"
 
 namespace rings {
 
 const size_t kDelayLineSize = 2048;
 
+// Longest silence, in samples, a string waits for its excitation to come back
+// before going to sleep (its period, capped for sub-audio frequencies).
+const float kMaxSleepLatency = 16.0f * kDelayLineSize;
+
 class DampingFilter {
  public:
   DampingFilter() { }
   ~DampingFilter() { }
   
   void Init() {
-    x_ = 0.0f;
-    x__ = 0.0f;
+    Reset();
     brightness_ = 0.0f;
     brightness_increment_ = 0.0f;
     damping_ = 0.0f;
     damping_increment_ = 0.0f;
   }
+  
+  void Reset() {
+    x_ = 0.0f;
+    x__ = 0.0f;
+  }
    
   inline void Configure(float damping, float brightness, size_t size) {
     if (!size) {
@@ -98,7 +111,7 @@ class String {
   String() { }
   ~String() { }
   
-  void Init(bool enable_dispersion);
+  void Init(bool enable_dispersion, RandomGenerator* random);
   void Process(const float* in, float* out, float* aux, size_t size);
   
   inline void set_frequency(float frequency) {
@@ -127,9 +140,20 @@ class String {
   
   inline StringDelayLine* mutable_string() { return &string_; }
   
+  // Number of blocks processed since Init, and number of blocks skipped while
+  // sleeping.
+  inline uint32_t num_blocks() const { return num_blocks_; }
+  inline uint32_t num_sleeping_blocks() const {
+    return silence_detector_.num_sleeping_blocks();
+  }
+  inline bool sleeping() const { return silence_detector_.sleeping(); }
+  
  private:
+  // Returns the peak level of the string output during the block.
   template<bool enable_dispersion>
-  void ProcessInternal(const float* in, float* out, float* aux, size_t size);
+  float ProcessInternal(const float* in, float* out, float* aux, size_t size);
+  
+  void Clear();
    
   float frequency_;
   float dispersion_;
@@ -144,6 +168,7 @@ class String {
   
   bool enable_dispersion_;
   bool enable_iir_damping_;
+  RandomGenerator* random_;
   float dispersion_noise_;
   
   // Very crappy linear interpolation upsampler used for low pitches that
@@ -161,6 +186,9 @@ class String {
   stmlib::Svf iir_damping_filter_;
   stmlib::DCBlocker dc_blocker_;
   
+  uint32_t num_blocks_;
+  SilenceDetector silence_detector_;
+  
   DISALLOW_COPY_AND_ASSIGN(String);
 };
 
@@ -13,13 +13,16 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
 #include <xmmintrin.h>
 
 #include "rings/dsp/part.h"
+#include "rings/dsp/part_ensemble.h"
 #include "rings/dsp/onset_detector.h"
 #include "rings/dsp/string_synth_part.h"
 #include "rings/dsp/string_synth_oscillator.h"
@@ -556,6 +559,529 @@ void TestStringSynthPart() {
   }
 }
 
+void TestModalBank() {
+  const size_t kNumSamples = ::kSampleRate * 4;
+  const int32_t kResolutions[] = { 16, 32, 64 };
+  const float kNotes[kMaxPolyphony] = { 45.0f, 52.0f, 57.0f, 64.0f };
+  static float in[kNumSamples];
+  static float out[2][kMaxPolyphony][kNumSamples];
+  static float aux[2][kMaxPolyphony][kNumSamples];
+  
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    float gate = (i % (::kSampleRate / 2)) < 64 ? 1.0f : 0.0f;
+    in[i] = (Random::GetFloat() - 0.5f) * gate;
+  }
+  
+  for (size_t n = 0; n < sizeof(kResolutions) / sizeof(int32_t); ++n) {
+    float elapsed[2];
+    for (int variant = 0; variant < 2; ++variant) {
+      Resonator resonator[kMaxPolyphony];
+      for (int32_t v = 0; v < kMaxPolyphony; ++v) {
+        Resonator& r = resonator[v];
+        r.Init();
+        r.set_resolution(kResolutions[n]);
+        r.set_frequency(a3 * SemitonesToRatio(kNotes[v] - 69.0f));
+        r.set_structure(0.2f + 0.1f * v);
+        r.set_brightness(0.5f);
+        r.set_damping(0.7f);
+        // Settles the position.
+        float silence[kAudioBlockSize] = { 0.0f };
+        float scratch[2][kAudioBlockSize];
+        r.set_position(0.3f);
+        r.ProcessScalar(silence, scratch[0], scratch[1], kAudioBlockSize);
+      }
+      
+      clock_t start = clock();
+      for (size_t i = 0; i < kNumSamples; i += kAudioBlockSize) {
+        // The position is fixed during the first half, then modulated.
+        float position = i < kNumSamples / 2
+            ? 0.3f
+            : 0.3f + 0.2f * sinf(i * 2.0f * M_PI / ::kSampleRate);
+        for (int32_t v = 0; v < kMaxPolyphony; ++v) {
+          Resonator& r = resonator[v];
+          r.set_position(position);
+          if (variant == 0) {
+            r.ProcessScalar(
+                &in[i], &out[0][v][i], &aux[0][v][i], kAudioBlockSize);
+          } else {
+            r.ProcessSIMD(
+                &in[i], &out[1][v][i], &aux[1][v][i], kAudioBlockSize);
+          }
+        }
+      }
+      elapsed[variant] = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    }
+    
+    // Errors relative to the peak level, with a fixed and a modulated
+    // position.
+    float peak = 0.0f;
+    float error[2] = { 0.0f, 0.0f };
+    for (int32_t v = 0; v < kMaxPolyphony; ++v) {
+      for (size_t i = 0; i < kNumSamples; ++i) {
+        float* e = &error[i < kNumSamples / 2 ? 0 : 1];
+        peak = std::max(peak, fabsf(out[0][v][i]));
+        peak = std::max(peak, fabsf(aux[0][v][i]));
+        *e = std::max(*e, fabsf(out[1][v][i] - out[0][v][i]));
+        *e = std::max(*e, fabsf(aux[1][v][i] - aux[0][v][i]));
+      }
+    }
+    printf("Modal bank, %2d modes x %d voices: scalar %.2f ns/sample, "
+        "SIMD %.2f ns/sample, error %.1e (fixed) %.1e (modulated): %s\n",
+        kResolutions[n],
+        kMaxPolyphony,
+        elapsed[0] * 1e9f / kNumSamples,
+        elapsed[1] * 1e9f / kNumSamples,
+        error[0] / peak,
+        error[1] / peak,
+        error[0] <= 1e-5f * peak && error[1] <= 1e-2f * peak ? "PASS" : "FAIL");
+  }
+}
+
+void TestFilterUpdates() {
+  const size_t kNumBlocks = ::kSampleRate * 10 / kAudioBlockSize;
+  const char* kScenarios[] = {
+    "held note",
+    "held note, knob noise",
+    "vibrato",
+    "structure sweep",
+    "arpeggio"
+  };
+  const size_t kNumScenarios = sizeof(kScenarios) / sizeof(const char*);
+  
+#ifndef USE_FILTER_UPDATE_THRESHOLD
+  printf("Filter updates: USE_FILTER_UPDATE_THRESHOLD is not defined, the "
+      "filters are computed on every block\n");
+#endif  // USE_FILTER_UPDATE_THRESHOLD
+  for (size_t scenario = 0; scenario < kNumScenarios; ++scenario) {
+    Resonator resonator;
+    resonator.Init();
+    resonator.set_position(0.3f);
+    
+    float in[kAudioBlockSize];
+    float out[kAudioBlockSize];
+    float aux[kAudioBlockSize];
+    clock_t start = clock();
+    for (size_t block = 0; block < kNumBlocks; ++block) {
+      float t = static_cast<float>(block * kAudioBlockSize) / ::kSampleRate;
+      float note = 48.0f;
+      float structure = 0.25f;
+      float brightness = 0.5f;
+      float damping = 0.7f;
+      switch (scenario) {
+        case 1:
+          structure += (Random::GetFloat() - 0.5f) * 1e-5f;
+          brightness += (Random::GetFloat() - 0.5f) * 1e-5f;
+          damping += (Random::GetFloat() - 0.5f) * 1e-5f;
+          break;
+        case 2:
+          note += 0.1f * sinf(t * 5.0f * 2.0f * M_PI);
+          break;
+        case 3:
+          structure = t / 10.0f;
+          break;
+        case 4:
+          note += static_cast<float>((block / 250) % 8) * 3.0f;
+          break;
+      }
+      resonator.set_frequency(a3 * SemitonesToRatio(note - 69.0f));
+      resonator.set_structure(structure);
+      resonator.set_brightness(brightness);
+      resonator.set_damping(damping);
+      for (size_t i = 0; i < kAudioBlockSize; ++i) {
+        in[i] = block % 250 == 0 && i == 0 ? 1.0f : 0.0f;
+      }
+      resonator.Process(in, out, aux, kAudioBlockSize);
+    }
+    float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    printf("Filter updates, %-22s %6.1f/s out of %.0f blocks/s, "
+        "%.2f ns/sample\n",
+        kScenarios[scenario],
+        resonator.num_filter_updates() / 10.0f,
+        resonator.num_blocks() / 10.0f,
+        elapsed * 1e9f / (kNumBlocks * kAudioBlockSize));
+  }
+}
+
+void TestPolyphony() {
+  const int32_t kPolyphonies[] = { 4, 16, 32 };
+  const float kStrumRates[] = { 2.0f, 8.0f };
+  const uint32_t kNumBlocks = ::kSampleRate * 10 / kAudioBlockSize;
+  
+  for (size_t n = 0; n < sizeof(kPolyphonies) / sizeof(int32_t); ++n) {
+    if (kPolyphonies[n] > kMaxPolyphony) {
+      printf("Polyphony %d: MAX_POLYPHONY too small\n", kPolyphonies[n]);
+      continue;
+    }
+    for (size_t r = 0; r < sizeof(kStrumRates) / sizeof(float); ++r) {
+      static Part part;
+      part.Init(reverb_buffer);
+      part.set_polyphony(kPolyphonies[n]);
+      part.set_model(RESONATOR_MODEL_MODAL);
+      
+      Patch patch;
+      patch.structure = 0.4f;
+      patch.brightness = 0.6f;
+      patch.damping = 0.6f;
+      patch.position = 0.3f;
+      
+      const uint32_t strum_period = ::kSampleRate / kStrumRates[r] / \
+          kAudioBlockSize;
+      float note = 48.0f;
+      uint32_t num_sounding_voices = 0;
+      Random::Seed(0x21);
+      clock_t start = clock();
+      for (uint32_t block = 0; block < kNumBlocks; ++block) {
+        PerformanceState performance;
+        performance.strum = block % strum_period == 0;
+        if (performance.strum) {
+          note = 48.0f + static_cast<float>(Random::GetWord() % 24);
+        }
+        performance.note = note;
+        performance.tonic = 0.0f;
+        performance.fm = 0.0f;
+        performance.chord = 0;
+        performance.internal_exciter = true;
+        
+        float in[kAudioBlockSize] = { 0.0f };
+        float out[kAudioBlockSize];
+        float aux[kAudioBlockSize];
+        part.Process(performance, patch, in, out, aux, kAudioBlockSize);
+        num_sounding_voices += part.num_sounding_voices();
+      }
+      float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+      printf("Polyphony %2d, %.0f notes/s: %.1f sounding voices on average, "
+          "%.1f%% CPU\n",
+          kPolyphonies[n],
+          kStrumRates[r],
+          static_cast<float>(num_sounding_voices) / kNumBlocks,
+          elapsed * 100.0f / 10.0f);
+    }
+  }
+}
+
+void TestVoiceSleep() {
+  const size_t kNumBlocks = ::kSampleRate * 20 / kAudioBlockSize;
+  const size_t kNumInstances = 8;
+  // Each instance is excited every 4s, one after the other.
+  const size_t kPeriod = ::kSampleRate * 4 / kAudioBlockSize;
+  
+  float in[kAudioBlockSize];
+  float silence[kAudioBlockSize] = { 0.0f };
+  float out[kAudioBlockSize];
+  float aux[kAudioBlockSize];
+  
+  static Resonator resonator[kNumInstances];
+  static String string[kNumInstances];
+  RandomGenerator random;
+  random.Init(kDefaultRandomSeed);
+  for (size_t n = 0; n < kNumInstances; ++n) {
+    float frequency = a3 * SemitonesToRatio(static_cast<float>(n * 3) - 24.0f);
+    resonator[n].Init();
+    resonator[n].set_frequency(frequency);
+    resonator[n].set_structure(0.4f);
+    resonator[n].set_damping(0.5f);
+    resonator[n].set_position(0.3f);
+    string[n].Init(true, &random);
+    string[n].set_frequency(frequency);
+    string[n].set_damping(0.5f);
+  }
+  
+  for (int32_t model = 0; model < 2; ++model) {
+    clock_t start = clock();
+    for (size_t block = 0; block < kNumBlocks; ++block) {
+      for (size_t n = 0; n < kNumInstances; ++n) {
+        bool strike = block % kPeriod == n * kPeriod / kNumInstances;
+        const float* input = silence;
+        if (strike) {
+          for (size_t i = 0; i < kAudioBlockSize; ++i) {
+            in[i] = i == 0 ? 1.0f : 0.0f;
+          }
+          input = in;
+        }
+        if (model == 0) {
+          resonator[n].Process(input, out, aux, kAudioBlockSize);
+        } else {
+          fill(&out[0], &out[kAudioBlockSize], 0.0f);
+          fill(&aux[0], &aux[kAudioBlockSize], 0.0f);
+          string[n].Process(input, out, aux, kAudioBlockSize);
+        }
+      }
+    }
+    float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    uint32_t num_blocks = 0;
+    uint32_t num_sleeping_blocks = 0;
+    for (size_t n = 0; n < kNumInstances; ++n) {
+      num_blocks += model == 0
+          ? resonator[n].num_blocks()
+          : string[n].num_blocks();
+      num_sleeping_blocks += model == 0
+          ? resonator[n].num_sleeping_blocks()
+          : string[n].num_sleeping_blocks();
+    }
+    printf("%-9s x%d: %.1f%% of the blocks skipped, %.2f ns/sample\n",
+        model == 0 ? "Resonator" : "String",
+        static_cast<int>(kNumInstances),
+        num_sleeping_blocks * 100.0f / num_blocks,
+        elapsed * 1e9f / (kNumBlocks * kAudioBlockSize));
+  }
+  
+  const ResonatorModel kModels[] = {
+    RESONATOR_MODEL_MODAL,
+    RESONATOR_MODEL_STRING
+  };
+  for (size_t m = 0; m < sizeof(kModels) / sizeof(ResonatorModel); ++m) {
+    static Part part;
+    part.Init(reverb_buffer);
+    part.set_polyphony(4);
+    part.set_model(kModels[m]);
+    
+    Patch patch;
+    patch.structure = 0.4f;
+    patch.brightness = 0.6f;
+    patch.damping = 0.5f;
+    patch.position = 0.3f;
+    
+    clock_t start = clock();
+    for (size_t block = 0; block < kNumBlocks; ++block) {
+      PerformanceState performance;
+      performance.strum = block % kPeriod == 0;
+      performance.note = 48.0f;
+      performance.tonic = 0.0f;
+      performance.fm = 0.0f;
+      performance.chord = 0;
+      performance.internal_exciter = true;
+      part.Process(performance, patch, silence, out, aux, kAudioBlockSize);
+    }
+    float elapsed = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    printf("Part, model %d: %.1f%% of the voice-blocks skipped, %.1f%% CPU\n",
+        kModels[m],
+        part.num_skipped_voice_blocks() * 100.0f / part.num_voice_blocks(),
+        elapsed * 100.0f / 20.0f);
+  }
+}
+
+void TestStringSleepLowNote() {
+  // A short excitation of a low string: the output stays silent until the
+  // pulse comes back from the end of the delay line, 960 samples later. The
+  // string must not go to sleep in the meantime.
+  const size_t kPulseSize = 48;
+  const size_t kNumBlocks = ::kSampleRate * 10 / kAudioBlockSize;
+  const size_t kCheckBlock = ::kSampleRate / 20 / kAudioBlockSize;
+  
+  float in[kAudioBlockSize];
+  float out[kAudioBlockSize];
+  float aux[kAudioBlockSize];
+  
+  RandomGenerator random;
+  random.Init(kDefaultRandomSeed);
+  static String string;
+  string.Init(true, &random);
+  string.set_frequency(50.0f / ::kSampleRate);
+  string.set_damping(0.5f);
+  
+  float peak = 0.0f;
+  size_t sleep_block = 0;
+  for (size_t block = 0; block < kNumBlocks; ++block) {
+    for (size_t i = 0; i < kAudioBlockSize; ++i) {
+      size_t t = block * kAudioBlockSize + i;
+      in[i] = t < kPulseSize / 2 ? 1.0f : (t < kPulseSize ? -1.0f : 0.0f);
+    }
+    fill(&out[0], &out[kAudioBlockSize], 0.0f);
+    fill(&aux[0], &aux[kAudioBlockSize], 0.0f);
+    string.Process(in, out, aux, kAudioBlockSize);
+    if (block >= kCheckBlock && block < 2 * kCheckBlock) {
+      peak = max(peak, max(BlockPeak(out, kAudioBlockSize),
+                           BlockPeak(aux, kAudioBlockSize)));
+    }
+    if (!sleep_block && string.sleeping()) {
+      sleep_block = block;
+    }
+  }
+  printf("Peak 50-100ms: %.3f, asleep after %.2fs: %s\n",
+      peak,
+      static_cast<float>(sleep_block * kAudioBlockSize) / ::kSampleRate,
+      peak > 0.01f && sleep_block > 2 * kCheckBlock ? "PASS" : "FAIL");
+}
+
+void TestEnsemble() {
+  const int32_t kNumParts = 64;
+  const int32_t kNumWorkers[] = { 1, 2, 4 };
+  const size_t kNumBlocks = ::kSampleRate * 10 / kAudioBlockSize;
+  const ResonatorModel kModels[] = {
+    RESONATOR_MODEL_MODAL,
+    RESONATOR_MODEL_SYMPATHETIC_STRING,
+    RESONATOR_MODEL_STRING,
+    RESONATOR_MODEL_FM_VOICE
+  };
+  
+  float reference_elapsed = 0.0f;
+  uint32_t reference_hash = 0;
+  for (size_t n = 0; n < sizeof(kNumWorkers) / sizeof(int32_t); ++n) {
+    static PartEnsemble ensemble;
+    ensemble.Init(kNumParts, kNumWorkers[n]);
+    for (int32_t i = 0; i < kNumParts; ++i) {
+      ensemble.mutable_part(i)->set_model(kModels[i % 4]);
+      ensemble.mutable_patch(i)->position = 0.1f + (i % 8) * 0.1f;
+    }
+    
+    // FNV-1a hash of the outputs, which must not depend on the number of
+    // workers.
+    uint32_t hash = 2166136261u;
+    Random::Seed(0x25);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (size_t block = 0; block < kNumBlocks; ++block) {
+      for (int32_t i = 0; i < kNumParts; ++i) {
+        PerformanceState* performance = ensemble.mutable_performance_state(i);
+        performance->strum = Random::GetWord() % 2000 == 0;
+        if (performance->strum) {
+          performance->note = 36.0f + static_cast<float>(
+              Random::GetWord() % 36);
+        }
+      }
+      ensemble.Process(kAudioBlockSize);
+      for (int32_t i = 0; i < kNumParts; ++i) {
+        uint32_t word[kAudioBlockSize];
+        memcpy(word, ensemble.out(i), sizeof(word));
+        for (size_t j = 0; j < kAudioBlockSize; ++j) {
+          hash = (hash ^ word[j]) * 16777619u;
+        }
+      }
+    }
+    float elapsed = std::chrono::duration<float>(
+        std::chrono::steady_clock::now() - start).count();
+    if (n == 0) {
+      reference_elapsed = elapsed;
+      reference_hash = hash;
+    }
+    
+    // Expect at least 60% of a linear speedup with the number of workers
+    // actually used - the pool does not use more workers than cores.
+    int32_t num_workers = ensemble.num_workers();
+    float speedup = reference_elapsed / elapsed;
+    const char* scaling = num_workers == 1
+        ? "n/a"
+        : (speedup >= 0.6f * num_workers ? "PASS" : "FAIL");
+    printf("Ensemble of %d parts, %d worker(s) (%d requested): "
+        "%.1f%% of real time, speedup %.2f (%s), output %s\n",
+        kNumParts,
+        num_workers,
+        kNumWorkers[n],
+        elapsed * 100.0f / 10.0f,
+        speedup,
+        scaling,
+        hash == reference_hash ? "identical" : "DIFFERENT");
+  }
+}
+
+void TestPartRandom() {
+  // A part which has not been seeded draws from stmlib::Random, like the
+  // module's part did before parts had their own generators: its output must
+  // be the same as that of a part seeded with the state of stmlib::Random.
+  const uint32_t kNumBlocks = ::kSampleRate * 5 / kAudioBlockSize;
+  const uint32_t kSeed = 0x1234;
+  
+  uint32_t hash[2];
+  uint32_t state[2];
+  for (int32_t n = 0; n < 2; ++n) {
+    static Part part;
+    part.Init(reverb_buffer);
+    part.set_model(RESONATOR_MODEL_STRING);
+    if (n == 1) {
+      part.set_seed(kSeed);
+    }
+    
+    Patch patch;
+    patch.structure = 0.4f;
+    patch.brightness = 0.6f;
+    patch.damping = 0.6f;
+    patch.position = 0.3f;
+    
+    Random::Seed(kSeed);
+    hash[n] = 2166136261u;
+    for (uint32_t block = 0; block < kNumBlocks; ++block) {
+      PerformanceState performance;
+      performance.strum = block % 500 == 0;
+      performance.note = 48.0f + static_cast<float>(block / 500 % 12);
+      performance.tonic = 0.0f;
+      performance.fm = 0.0f;
+      performance.chord = 0;
+      performance.internal_exciter = true;
+      
+      float in[kAudioBlockSize] = { 0.0f };
+      float out[kAudioBlockSize];
+      float aux[kAudioBlockSize];
+      part.Process(performance, patch, in, out, aux, kAudioBlockSize);
+      uint32_t word[kAudioBlockSize];
+      memcpy(word, out, sizeof(word));
+      for (size_t i = 0; i < kAudioBlockSize; ++i) {
+        hash[n] = (hash[n] ^ word[i]) * 16777619u;
+      }
+    }
+    state[n] = Random::state();
+  }
+  printf("Unseeded part: output %s, stmlib::Random %s: %s\n",
+      hash[0] == hash[1] ? "identical" : "DIFFERENT",
+      state[0] != kSeed ? "advanced" : "unused",
+      hash[0] == hash[1] && state[0] != kSeed && state[1] == kSeed
+          ? "PASS" : "FAIL");
+}
+
+void TestReverb() {
+  const size_t kNumSamples = ::kSampleRate * 10;
+  const size_t kBlockSizes[] = { 32, 64, 128, 256 };
+  static float in_l[kNumSamples];
+  static float in_r[kNumSamples];
+  static float l[2][kNumSamples];
+  static float r[2][kNumSamples];
+  
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    float gate = (i % ::kSampleRate) < (::kSampleRate / 8) ? 1.0f : 0.0f;
+    in_l[i] = (Random::GetFloat() - 0.5f) * gate;
+    in_r[i] = (Random::GetFloat() - 0.5f) * gate;
+  }
+  
+  for (size_t b = 0; b < sizeof(kBlockSizes) / sizeof(size_t); ++b) {
+    size_t block_size = kBlockSizes[b];
+    float elapsed[2];
+    for (int variant = 0; variant < 2; ++variant) {
+      Reverb reverb;
+      reverb.Init(variant == 0 ? &reverb_buffer[0] : &reverb_buffer[32768]);
+      reverb.set_amount(0.5f);
+      reverb.set_diffusion(0.625f);
+      reverb.set_time(0.9f);
+      reverb.set_input_gain(0.2f);
+      reverb.set_lp(0.6f);
+      copy(&in_l[0], &in_l[kNumSamples], &l[variant][0]);
+      copy(&in_r[0], &in_r[kNumSamples], &r[variant][0]);
+      
+      clock_t start = clock();
+      for (size_t i = 0; i < kNumSamples; i += block_size) {
+        if (variant == 0) {
+          reverb.ProcessSamples(&l[variant][i], &r[variant][i], block_size);
+        } else {
+          reverb.ProcessBlocks(&l[variant][i], &r[variant][i], block_size);
+        }
+      }
+      elapsed[variant] = static_cast<float>(clock() - start) / CLOCKS_PER_SEC;
+    }
+    
+    size_t mismatches = 0;
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      if (l[0][i] != l[1][i] || r[0][i] != r[1][i]) {
+        ++mismatches;
+      }
+    }
+    printf("Reverb, %3zu samples blocks: sample by sample %.2f ns/sample, "
+        "by block %.2f ns/sample, %zu mismatches: %s\n",
+        block_size,
+        elapsed[0] * 1e9f / kNumSamples,
+        elapsed[1] * 1e9f / kNumSamples,
+        mismatches,
+        mismatches == 0 ? "PASS" : "FAIL");
+  }
+}
+
 int main(void) {
   _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
   TestNoteFilter();
@@ -569,4 +1095,12 @@ int main(void) {
   TestStringSynthOscillator();
   TestStringSynthVoice();
   TestStringSynthPart();
+  // TestReverb();
+  // TestModalBank();
+  // TestFilterUpdates();
+  // TestPolyphony();
+  // TestVoiceSleep();
+  // TestStringSleepLowNote();
+  // TestEnsemble();
+  // TestPartRandom();
 }